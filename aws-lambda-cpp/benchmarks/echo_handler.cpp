@@ -0,0 +1,40 @@
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// The smallest possible handler, returning its payload unchanged. Run it under runtime-api-emulator to get a baseline
+// for the runtime's own latency before measuring a real handler.
+//
+//   usage: echo-handler [--metrics]
+//
+// --metrics logs the runtime's per-invocation metrics as EMF records.
+
+#include <aws/lambda-runtime/runtime.h>
+
+#include <cstring>
+#include <utility>
+
+using namespace aws::lambda_runtime;
+
+int main(int argc, char* argv[])
+{
+    runtime_options options;
+    options.log_metrics = argc > 1 && std::strcmp(argv[1], "--metrics") == 0;
+    run_consuming_handler(
+        [](invocation_request&& req) {
+            return invocation_response::success(std::move(req.payload), "application/json");
+        },
+        options);
+    return 0;
+}
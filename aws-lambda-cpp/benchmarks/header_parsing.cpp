@@ -0,0 +1,178 @@
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Measures the per-request cost of parsing the headers of a /next response and looking up the lambda-runtime-*
+// headers, in time and heap allocations. The header lines are the ones the Runtime API sends, delivered one at a time
+// as the transport's header callback receives them.
+//
+//   usage: header-parsing [requests=1000000]
+//
+// 'strings' is how headers used to be parsed: a copy of every name and value, trimmed and lower-cased into a vector
+// that is searched by name. 'slots' is http::response::add_header on the raw line.
+
+#include <aws/http/response.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+std::atomic<size_t> allocations{0};
+
+char const* const header_lines[] = {
+    "HTTP/1.1 200 OK\r\n",
+    "Content-Type: application/json\r\n",
+    "Lambda-Runtime-Aws-Request-Id: 8476a536-e9f4-11e8-9739-2dfe598c3fcd\r\n",
+    "Lambda-Runtime-Deadline-Ms: 1542409706888\r\n",
+    "Lambda-Runtime-Invoked-Function-Arn: arn:aws:lambda:us-east-2:123456789012:function:custom-runtime\r\n",
+    "Lambda-Runtime-Trace-Id: Root=1-5bef4de7-ad49b0e87f6ef6c87fc2e700;Parent=9a9197af755a6419;Sampled=1\r\n",
+    "Date: Fri, 16 Nov 2018 22:08:26 GMT\r\n",
+    "Content-Length: 21\r\n",
+    "\r\n",
+};
+
+char const* const lambda_headers[] = {
+    "lambda-runtime-aws-request-id",
+    "lambda-runtime-trace-id",
+    "lambda-runtime-client-context",
+    "lambda-runtime-cognito-identity",
+    "lambda-runtime-deadline-ms",
+    "lambda-runtime-invoked-function-arn",
+};
+
+std::string trim(std::string s)
+{
+    auto const not_space = [](int ch) { return !::isspace(ch); };
+    s.erase(std::find_if(s.rbegin(), s.rend(), not_space).base(), s.end());
+    s.erase(s.begin(), std::find_if(s.begin(), s.end(), not_space));
+    return s;
+}
+
+struct string_headers {
+    std::vector<std::pair<std::string, std::string>> headers;
+
+    void parse(char const* ptr, size_t length)
+    {
+        // the debug log argument was built whether or not debug logging was enabled
+        std::string const logged(ptr, length);
+        (void)logged;
+        for (size_t i = 0; i < length; i++) {
+            if (ptr[i] != ':') {
+                continue;
+            }
+            std::string key = trim(std::string{ptr, i});
+            std::string const value = trim(std::string{ptr + i + 1, length - i - 1});
+            std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+            headers.emplace_back(key, value);
+            break;
+        }
+    }
+
+    size_t lookup() const
+    {
+        size_t found = 0;
+        for (auto const name : lambda_headers) {
+            auto const it = std::find_if(headers.begin(), headers.end(), [name](std::pair<std::string, std::string> const& p) {
+                return p.first == name;
+            });
+            found += it != headers.end() ? it->second.size() : 0;
+        }
+        return found;
+    }
+};
+
+size_t run_strings(size_t requests)
+{
+    size_t checksum = 0;
+    string_headers resp;
+    for (size_t r = 0; r < requests; r++) {
+        resp.headers.clear();
+        for (auto const line : header_lines) {
+            resp.parse(line, std::strlen(line));
+        }
+        checksum += resp.lookup();
+    }
+    return checksum;
+}
+
+size_t run_slots(size_t requests)
+{
+    size_t checksum = 0;
+    aws::http::response resp;
+    for (size_t r = 0; r < requests; r++) {
+        resp.clear();
+        for (auto const line : header_lines) {
+            resp.add_header(line, std::strlen(line));
+        }
+        for (size_t h = 0; h < aws::http::lambda_header_count; h++) {
+            auto const header = static_cast<aws::http::lambda_header>(h);
+            checksum += resp.has_header(header) ? resp.get_header(header).size() : 0;
+        }
+    }
+    return checksum;
+}
+
+template <typename Fn>
+void measure(char const* name, size_t requests, Fn const& fn)
+{
+    fn(1000); // warm up, e.g. let reused storage reach its capacity
+    size_t const allocations_before = allocations.load();
+    auto const start = std::chrono::steady_clock::now();
+    size_t const checksum = fn(requests);
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    size_t const allocated = allocations.load() - allocations_before;
+    printf(
+        "%-8s %8.1f ns/request %6.2f allocations/request (checksum %zu)\n",
+        name,
+        std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(requests),
+        static_cast<double>(allocated) / static_cast<double>(requests),
+        checksum);
+}
+
+} // namespace
+
+void* operator new(size_t size)
+{
+    allocations++;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t const requests = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    if (requests == 0) {
+        fprintf(stderr, "need at least 1 request\n");
+        return 1;
+    }
+    measure("strings", requests, run_strings);
+    measure("slots", requests, run_slots);
+    return 0;
+}
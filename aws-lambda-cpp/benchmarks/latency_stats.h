@@ -0,0 +1,67 @@
+#pragma once
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+namespace aws {
+namespace lambda_runtime {
+namespace benchmarks {
+
+template <typename Duration>
+inline double micros(Duration d)
+{
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+/**
+ * Nearest-rank percentile of an already sorted sample.
+ */
+inline double percentile(std::vector<double> const& sorted, double q)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    auto const i = std::min(sorted.size() - 1, static_cast<size_t>(q * static_cast<double>(sorted.size())));
+    return sorted[i];
+}
+
+/**
+ * Print one line with the mean, the usual percentiles and the maximum of 'samples', given in microseconds.
+ */
+inline void report(char const* name, std::vector<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    double sum = 0;
+    for (double s : samples) {
+        sum += s;
+    }
+    double const mean = samples.empty() ? 0 : sum / static_cast<double>(samples.size());
+    printf(
+        "%-22s mean %9.1f us  p50 %9.1f us  p90 %9.1f us  p99 %9.1f us  max %9.1f us\n",
+        name,
+        mean,
+        percentile(samples, 0.50),
+        percentile(samples, 0.90),
+        percentile(samples, 0.99),
+        samples.empty() ? 0 : samples.back());
+}
+
+} // namespace benchmarks
+} // namespace lambda_runtime
+} // namespace aws
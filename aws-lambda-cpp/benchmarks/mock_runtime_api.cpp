@@ -0,0 +1,454 @@
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "mock_runtime_api.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace aws {
+namespace lambda_runtime {
+namespace benchmarks {
+
+static constexpr char const INVOCATION_PREFIX[] = "/2018-06-01/runtime/invocation/";
+static constexpr char const NEXT_PATH[] = "/2018-06-01/runtime/invocation/next";
+static constexpr char const INIT_ERROR_PATH[] = "/2018-06-01/runtime/init/error";
+
+static bool send_all(int fd, std::string const& data)
+{
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t const n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool fill(int fd, std::string& buffer)
+{
+    char chunk[64 * 1024];
+    ssize_t const n = ::recv(fd, chunk, sizeof(chunk), 0);
+    if (n <= 0) {
+        return false;
+    }
+    buffer.append(chunk, static_cast<size_t>(n));
+    return true;
+}
+
+static bool equals_ignore_case(std::string const& a, char const* b)
+{
+    size_t const len = std::strlen(b);
+    if (a.size() != len) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static std::string trim(std::string const& s)
+{
+    auto const first = s.find_first_not_of(" \t");
+    if (first == std::string::npos) {
+        return {};
+    }
+    auto const last = s.find_last_not_of(" \t\r");
+    return s.substr(first, last - first + 1);
+}
+
+static std::string reply(std::string const& status, std::string const& headers, std::string const& body)
+{
+    std::string out = "HTTP/1.1 ";
+    out += status;
+    out += "\r\n";
+    out += headers;
+    out += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    out += body;
+    return out;
+}
+
+mock_runtime_api::~mock_runtime_api()
+{
+    stop();
+}
+
+bool mock_runtime_api::start(uint16_t port)
+{
+    m_listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listen_fd < 0) {
+        return false;
+    }
+
+    int one = 1;
+    ::setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (::bind(m_listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(m_listen_fd, 64) != 0) {
+        ::close(m_listen_fd);
+        m_listen_fd = -1;
+        return false;
+    }
+
+    socklen_t len = sizeof(addr);
+    ::getsockname(m_listen_fd, reinterpret_cast<sockaddr*>(&addr), &len);
+    m_port = ntohs(addr.sin_port);
+    m_accept_thread = std::thread([this] { accept_loop(); });
+    return true;
+}
+
+void mock_runtime_api::stop()
+{
+    if (m_listen_fd < 0) {
+        return;
+    }
+
+    m_stopping = true;
+    m_cv.notify_all();
+    ::shutdown(m_listen_fd, SHUT_RDWR);
+    m_accept_thread.join();
+    ::close(m_listen_fd);
+    m_listen_fd = -1;
+
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (int fd : m_connections) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+        threads.swap(m_connection_threads);
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+}
+
+void mock_runtime_api::enqueue(event e)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(e));
+        invocation inv;
+        inv.request_id = m_queue.back().request_id;
+        inv.enqueued = clock::now();
+        m_in_flight.push_back(std::move(inv));
+    }
+    m_cv.notify_all();
+}
+
+void mock_runtime_api::inject_faults(size_t count, int status)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_faults.insert(m_faults.end(), count, status);
+}
+
+void mock_runtime_api::drop_replies(size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_dropped_replies = count;
+}
+
+std::vector<mock_runtime_api::invocation> mock_runtime_api::wait_for_completions(size_t count)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [&] { return m_completed.size() >= count; });
+    return m_completed;
+}
+
+bool mock_runtime_api::wait_for_completions(size_t count, clock::duration timeout)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_cv.wait_for(lock, timeout, [&] { return m_completed.size() >= count; });
+}
+
+std::vector<mock_runtime_api::invocation> mock_runtime_api::completed()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_completed;
+}
+
+std::vector<std::string> mock_runtime_api::init_errors()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_init_errors;
+}
+
+void mock_runtime_api::accept_loop()
+{
+    while (!m_stopping) {
+        int const fd = ::accept(m_listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            continue;
+        }
+
+        int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stopping) {
+            ::close(fd);
+            break;
+        }
+        m_connections.push_back(fd);
+        m_connection_threads.emplace_back([this, fd] { serve(fd); });
+    }
+}
+
+void mock_runtime_api::serve(int fd)
+{
+    std::string buffer;
+    request req;
+    while (read_request(fd, buffer, req)) {
+        auto const received = clock::now();
+        std::string out;
+        std::string completed_id;
+        bool completed_success = false;
+        bool drop_reply = false;
+        int fault_status = -1;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_faults.empty()) {
+                fault_status = m_faults.front();
+                m_faults.pop_front();
+            }
+        }
+
+        if (fault_status == 0) {
+            break;
+        }
+        else if (fault_status > 0) {
+            out = reply(std::to_string(fault_status) + " Injected Fault", "", "");
+        }
+        else if (req.method == "GET" && req.path == NEXT_PATH) {
+            event e;
+            if (!next_event(e)) {
+                break;
+            }
+            auto const deadline = std::chrono::duration_cast<std::chrono::milliseconds>(
+                                      std::chrono::system_clock::now().time_since_epoch() + m_invocation_timeout)
+                                      .count();
+            out = reply(
+                "200 OK",
+                "Content-Type: application/json\r\n"
+                "Lambda-Runtime-Aws-Request-Id: " +
+                    e.request_id +
+                    "\r\n"
+                    "Lambda-Runtime-Deadline-Ms: " +
+                    std::to_string(deadline) +
+                    "\r\n"
+                    "Lambda-Runtime-Invoked-Function-Arn: arn:aws:lambda:us-east-1:000000000000:function:mock\r\n",
+                e.payload);
+        }
+        else if (req.method == "POST" && req.path == INIT_ERROR_PATH) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_init_errors.push_back(std::move(req.body));
+            }
+            out = reply("202 Accepted", "Content-Type: application/json\r\n", R"({"status":"OK"})");
+        }
+        else if (req.method == "POST" && req.path.compare(0, sizeof(INVOCATION_PREFIX) - 1, INVOCATION_PREFIX) == 0) {
+            auto const rest = req.path.substr(sizeof(INVOCATION_PREFIX) - 1);
+            auto const slash = rest.find('/');
+            auto const kind = slash == std::string::npos ? std::string{} : rest.substr(slash + 1);
+            if ((kind == "response" || kind == "error") && !is_in_flight(rest.substr(0, slash))) {
+                // like the real endpoint, refuse a second result for the same invocation
+                out = reply(
+                    "400 Bad Request", "Content-Type: application/json\r\n", R"({"errorType":"InvalidRequestID"})");
+            }
+            else if (kind == "response" || kind == "error") {
+                // only completed once the reply is out, so stopping after the last completion never cuts it off
+                completed_id = rest.substr(0, slash);
+                completed_success = kind == "response";
+                out = reply("202 Accepted", "Content-Type: application/json\r\n", R"({"status":"OK"})");
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_dropped_replies > 0) {
+                    m_dropped_replies--;
+                    drop_reply = true;
+                }
+            }
+            else {
+                out = reply("404 Not Found", "", "");
+            }
+        }
+        else {
+            out = reply("404 Not Found", "", "");
+        }
+
+        if (m_response_delay.count() > 0) {
+            std::this_thread::sleep_for(m_response_delay);
+        }
+        bool const sent = !drop_reply && send_all(fd, out);
+        if (!completed_id.empty()) {
+            complete(completed_id, completed_success, std::move(req.body), received);
+        }
+        if (!sent || req.close) {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_connections.erase(std::remove(m_connections.begin(), m_connections.end(), fd), m_connections.end());
+    ::close(fd);
+}
+
+bool mock_runtime_api::read_request(int fd, std::string& buffer, request& req)
+{
+    size_t header_end;
+    while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (!fill(fd, buffer)) {
+            return false;
+        }
+    }
+
+    req = request{};
+    size_t content_length = 0;
+    bool chunked = false;
+
+    size_t line_start = 0;
+    bool first = true;
+    while (line_start < header_end) {
+        auto line_end = buffer.find("\r\n", line_start);
+        auto const line = buffer.substr(line_start, line_end - line_start);
+        line_start = line_end + 2;
+        if (first) {
+            first = false;
+            auto const sp1 = line.find(' ');
+            auto const sp2 = line.find(' ', sp1 + 1);
+            if (sp1 == std::string::npos || sp2 == std::string::npos) {
+                return false;
+            }
+            req.method = line.substr(0, sp1);
+            req.path = line.substr(sp1 + 1, sp2 - sp1 - 1);
+            continue;
+        }
+
+        auto const colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        auto const name = line.substr(0, colon);
+        auto const value = trim(line.substr(colon + 1));
+        if (equals_ignore_case(name, "content-length")) {
+            content_length = std::strtoull(value.c_str(), nullptr, 10);
+        }
+        else if (equals_ignore_case(name, "transfer-encoding")) {
+            chunked = equals_ignore_case(value, "chunked");
+        }
+        else if (equals_ignore_case(name, "connection")) {
+            req.close = equals_ignore_case(value, "close");
+        }
+    }
+    buffer.erase(0, header_end + 4);
+
+    if (!chunked) {
+        while (buffer.size() < content_length) {
+            if (!fill(fd, buffer)) {
+                return false;
+            }
+        }
+        req.body.assign(buffer, 0, content_length);
+        buffer.erase(0, content_length);
+        return true;
+    }
+
+    for (;;) {
+        size_t size_end;
+        while ((size_end = buffer.find("\r\n")) == std::string::npos) {
+            if (!fill(fd, buffer)) {
+                return false;
+            }
+        }
+        size_t const chunk_size = std::strtoull(buffer.c_str(), nullptr, 16);
+        buffer.erase(0, size_end + 2);
+        while (buffer.size() < chunk_size + 2) {
+            if (!fill(fd, buffer)) {
+                return false;
+            }
+        }
+        req.body.append(buffer, 0, chunk_size);
+        buffer.erase(0, chunk_size + 2);
+        if (chunk_size == 0) {
+            return true; // no trailers are ever sent by the runtime
+        }
+    }
+}
+
+bool mock_runtime_api::next_event(event& e)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+    if (m_queue.empty()) {
+        return false;
+    }
+
+    e = std::move(m_queue.front());
+    m_queue.pop_front();
+    for (auto& inv : m_in_flight) {
+        if (inv.request_id == e.request_id) {
+            inv.delivered = clock::now();
+            break;
+        }
+    }
+    return true;
+}
+
+bool mock_runtime_api::is_in_flight(std::string const& request_id)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::any_of(m_in_flight.begin(), m_in_flight.end(), [&](invocation const& inv) {
+        return inv.request_id == request_id;
+    });
+}
+
+void mock_runtime_api::complete(
+    std::string const& request_id,
+    bool success,
+    std::string body,
+    clock::time_point received)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = std::find_if(m_in_flight.begin(), m_in_flight.end(), [&](invocation const& inv) {
+            return inv.request_id == request_id;
+        });
+        if (it == m_in_flight.end()) {
+            return;
+        }
+        it->completed = received;
+        it->success = success;
+        it->response = std::move(body);
+        m_completed.push_back(std::move(*it));
+        m_in_flight.erase(it);
+    }
+    m_cv.notify_all();
+}
+
+} // namespace benchmarks
+} // namespace lambda_runtime
+} // namespace aws
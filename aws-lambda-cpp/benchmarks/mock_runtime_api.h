@@ -0,0 +1,158 @@
+#pragma once
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace aws {
+namespace lambda_runtime {
+namespace benchmarks {
+
+/**
+ * A local stand-in for the Lambda Runtime API, serving the /next, /response, /error and /init/error endpoints over
+ * loopback HTTP/1.1 with keep-alive. Events are queued by the caller and handed out in order; every request is
+ * timestamped so benchmarks can measure the runtime's per-invocation overhead without any AWS resources.
+ */
+class mock_runtime_api {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct event {
+        std::string request_id;
+        std::string payload;
+    };
+
+    struct invocation {
+        std::string request_id;
+        clock::time_point enqueued;
+        clock::time_point delivered;
+        clock::time_point completed;
+        bool success = false;
+        std::string response;
+    };
+
+    mock_runtime_api() = default;
+    ~mock_runtime_api();
+    mock_runtime_api(mock_runtime_api const&) = delete;
+    mock_runtime_api& operator=(mock_runtime_api const&) = delete;
+
+    /**
+     * Listen on the loopback interface. Port 0 picks an ephemeral port.
+     */
+    bool start(uint16_t port = 0);
+
+    /**
+     * Close the listening socket and every open connection. Pending /next requests fail.
+     */
+    void stop();
+
+    uint16_t port() const { return m_port; }
+
+    /**
+     * The value to export as AWS_LAMBDA_RUNTIME_API.
+     */
+    std::string endpoint() const { return "127.0.0.1:" + std::to_string(m_port); }
+
+    /**
+     * Delay every reply by 'delay' to simulate the round trip to a remote endpoint. Set before start().
+     */
+    void set_response_delay(clock::duration delay) { m_response_delay = delay; }
+
+    /**
+     * The time each invocation is given, reported to the runtime through the deadline header. 60 seconds by default.
+     */
+    void set_invocation_timeout(std::chrono::milliseconds timeout) { m_invocation_timeout = timeout; }
+
+    void enqueue(event e);
+
+    /**
+     * Answer the next 'count' requests, of any kind, with HTTP status 'status' instead of serving them. Status 0 closes
+     * the connection without an answer, as if the endpoint had gone away. Faults queue up behind those injected
+     * before.
+     */
+    void inject_faults(size_t count, int status);
+
+    /**
+     * Serve the next 'count' result posts but close the connection instead of answering them, so the runtime can't tell
+     * whether they were delivered.
+     */
+    void drop_replies(size_t count);
+
+    /**
+     * Block until at least 'count' invocations have been completed and return all completed invocations in
+     * completion order.
+     */
+    std::vector<invocation> wait_for_completions(size_t count);
+
+    /**
+     * Block until at least 'count' invocations have been completed or 'timeout' has passed. Returns false on timeout.
+     */
+    bool wait_for_completions(size_t count, clock::duration timeout);
+
+    /**
+     * The invocations completed so far, in completion order.
+     */
+    std::vector<invocation> completed();
+
+    /**
+     * Bodies posted to /runtime/init/error.
+     */
+    std::vector<std::string> init_errors();
+
+private:
+    struct request {
+        std::string method;
+        std::string path;
+        std::string body;
+        bool close = false;
+    };
+
+    void accept_loop();
+    void serve(int fd);
+    bool read_request(int fd, std::string& buffer, request& req);
+    bool next_event(event& e);
+    bool is_in_flight(std::string const& request_id);
+    void complete(std::string const& request_id, bool success, std::string body, clock::time_point received);
+
+    int m_listen_fd = -1;
+    uint16_t m_port = 0;
+    clock::duration m_response_delay{0};
+    std::chrono::milliseconds m_invocation_timeout{60000};
+    std::atomic<bool> m_stopping{false};
+    std::thread m_accept_thread;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<event> m_queue;
+    std::vector<invocation> m_in_flight;
+    std::vector<invocation> m_completed;
+    std::vector<std::string> m_init_errors;
+    std::deque<int> m_faults; // statuses of the next requests
+    size_t m_dropped_replies = 0;
+    std::vector<int> m_connections;
+    std::vector<std::thread> m_connection_threads;
+};
+
+} // namespace benchmarks
+} // namespace lambda_runtime
+} // namespace aws
@@ -0,0 +1,299 @@
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// A local Runtime API emulator and load generator. It replays recorded payloads to any handler binary built against
+// this runtime and reports latency percentiles and throughput, without AWS credentials or a deployed function.
+//
+//   usage: runtime-api-emulator --payloads PATH [options] [-- handler [args...]]
+//
+//   --payloads PATH     recorded payloads: a directory holding one payload per file (replayed in file name order),
+//                       or a file holding one payload per line
+//   --count N           invocations to replay, cycling through the payloads (default: every payload once)
+//   --rate R            open loop: queue R invocations per second regardless of how fast they complete
+//   --concurrency C     closed loop (used without --rate): keep C invocations outstanding (default 1)
+//   --warmup N          leave the first N completed invocations out of the report (default 0)
+//   --timeout-ms MS     invocation timeout reported through the deadline header (default 60000)
+//   --delay-us US       delay every reply of the emulator to simulate a remote endpoint (default 0)
+//   --port P            listen on P instead of an ephemeral port
+//
+// Everything after '--' is run as the handler with AWS_LAMBDA_RUNTIME_API pointing at the emulator. Without it the
+// emulator prints the endpoint and waits for a handler to be started by hand.
+
+#include "latency_stats.h"
+#include "mock_runtime_api.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace aws::lambda_runtime::benchmarks;
+
+namespace {
+
+struct settings {
+    std::string payloads;
+    size_t count = 0;
+    double rate = 0;
+    size_t concurrency = 1;
+    size_t warmup = 0;
+    unsigned long timeout_ms = 60000;
+    unsigned long delay_us = 0;
+    uint16_t port = 0;
+    char** handler = nullptr;
+};
+
+void usage()
+{
+    fprintf(
+        stderr,
+        "usage: runtime-api-emulator --payloads PATH [--count N] [--rate R | --concurrency C] [--warmup N]\n"
+        "                            [--timeout-ms MS] [--delay-us US] [--port P] [-- handler [args...]]\n");
+}
+
+bool parse_args(int argc, char* argv[], settings& s)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string const arg = argv[i];
+        if (arg == "--") {
+            if (i + 1 < argc) {
+                s.handler = argv + i + 1;
+            }
+            break;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        char const* value = argv[++i];
+        if (arg == "--payloads") {
+            s.payloads = value;
+        }
+        else if (arg == "--count") {
+            s.count = std::strtoull(value, nullptr, 10);
+        }
+        else if (arg == "--rate") {
+            s.rate = std::strtod(value, nullptr);
+        }
+        else if (arg == "--concurrency") {
+            s.concurrency = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+        }
+        else if (arg == "--warmup") {
+            s.warmup = std::strtoull(value, nullptr, 10);
+        }
+        else if (arg == "--timeout-ms") {
+            s.timeout_ms = std::strtoul(value, nullptr, 10);
+        }
+        else if (arg == "--delay-us") {
+            s.delay_us = std::strtoul(value, nullptr, 10);
+        }
+        else if (arg == "--port") {
+            s.port = static_cast<uint16_t>(std::strtoul(value, nullptr, 10));
+        }
+        else {
+            return false;
+        }
+    }
+    return !s.payloads.empty();
+}
+
+bool read_file(std::string const& path, std::string& out)
+{
+    std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+    if (!in) {
+        return false;
+    }
+    out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool load_payloads(std::string const& path, std::vector<std::string>& payloads)
+{
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return false;
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line)) {
+            if (!line.empty()) {
+                payloads.push_back(line);
+            }
+        }
+        return true;
+    }
+
+    DIR* dir = ::opendir(path.c_str());
+    if (!dir) {
+        return false;
+    }
+    std::vector<std::string> names;
+    while (dirent* entry = ::readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            names.emplace_back(entry->d_name);
+        }
+    }
+    ::closedir(dir);
+
+    std::sort(names.begin(), names.end());
+    for (auto const& name : names) {
+        std::string payload;
+        if (read_file(path + "/" + name, payload)) {
+            payloads.push_back(std::move(payload));
+        }
+    }
+    return true;
+}
+
+pid_t spawn_handler(char** handler, std::string const& endpoint)
+{
+    pid_t const pid = ::fork();
+    if (pid == 0) {
+        setenv("AWS_LAMBDA_RUNTIME_API", endpoint.c_str(), 1);
+        ::execvp(handler[0], handler);
+        perror("failed to start the handler");
+        _exit(127);
+    }
+    return pid;
+}
+
+// The handler exits on its own once the emulator has stopped and its runtime has run out of retries.
+void reap_handler(pid_t pid)
+{
+    for (int i = 0; i < 50; i++) {
+        if (::waitpid(pid, nullptr, WNOHANG) == pid) {
+            return;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    ::kill(pid, SIGKILL);
+    ::waitpid(pid, nullptr, 0);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    settings s;
+    if (!parse_args(argc, argv, s)) {
+        usage();
+        return 1;
+    }
+
+    std::vector<std::string> payloads;
+    if (!load_payloads(s.payloads, payloads) || payloads.empty()) {
+        fprintf(stderr, "no payloads found in %s\n", s.payloads.c_str());
+        return 1;
+    }
+    size_t const count = s.count ? s.count : payloads.size();
+
+    mock_runtime_api api;
+    api.set_invocation_timeout(std::chrono::milliseconds(s.timeout_ms));
+    api.set_response_delay(std::chrono::microseconds(s.delay_us));
+    if (!api.start(s.port)) {
+        fprintf(stderr, "failed to listen on port %u\n", s.port);
+        return 1;
+    }
+
+    pid_t handler_pid = -1;
+    if (s.handler) {
+        handler_pid = spawn_handler(s.handler, api.endpoint());
+    }
+    else {
+        printf("export AWS_LAMBDA_RUNTIME_API=%s\n", api.endpoint().c_str());
+        fflush(stdout);
+    }
+
+    // An invocation that isn't answered within its timeout fails the run instead of hanging it.
+    auto const timeout = std::chrono::milliseconds(s.timeout_ms);
+    auto const start = mock_runtime_api::clock::now();
+    auto enqueue = [&](size_t i) {
+        api.enqueue({"invocation-" + std::to_string(i), payloads[i % payloads.size()]});
+    };
+
+    bool answered = true;
+    if (s.rate > 0) {
+        for (size_t i = 0; i < count; i++) {
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<mock_runtime_api::clock::duration>(
+                                                      std::chrono::duration<double>(static_cast<double>(i) / s.rate)));
+            enqueue(i);
+        }
+    }
+    else {
+        for (size_t i = 0; i < count && answered; i++) {
+            if (i >= s.concurrency) {
+                answered = api.wait_for_completions(i - s.concurrency + 1, timeout);
+            }
+            enqueue(i);
+        }
+    }
+    answered = answered && api.wait_for_completions(count, timeout);
+    api.stop();
+    if (handler_pid > 0) {
+        reap_handler(handler_pid);
+    }
+
+    auto const completed = api.completed();
+    if (!answered) {
+        fprintf(stderr, "timed out: only %zu of %zu invocations were answered\n", completed.size(), count);
+    }
+    if (completed.size() <= s.warmup) {
+        fprintf(stderr, "nothing to report after %zu warm-up invocations\n", s.warmup);
+        return 1;
+    }
+
+    std::vector<double> end_to_end, queueing, service;
+    size_t failed = 0;
+    for (size_t i = s.warmup; i < completed.size(); i++) {
+        auto const& inv = completed[i];
+        end_to_end.push_back(micros(inv.completed - inv.enqueued));
+        queueing.push_back(micros(inv.delivered - inv.enqueued));
+        service.push_back(micros(inv.completed - inv.delivered));
+        failed += inv.success ? 0 : 1;
+    }
+
+    auto const& first = completed[s.warmup];
+    auto const& last = completed.back();
+    double const seconds = std::chrono::duration<double>(last.completed - first.enqueued).count();
+    printf(
+        "invocations: %zu (%zu failed, %zu warm-up), payloads: %zu recorded\n",
+        completed.size() - s.warmup,
+        failed,
+        s.warmup,
+        payloads.size());
+    if (s.rate > 0) {
+        printf("load: open loop at %.1f invocations/s\n", s.rate);
+    }
+    else {
+        printf("load: closed loop with %zu outstanding\n", s.concurrency);
+    }
+    report("queued -> result", end_to_end);
+    report("queued -> delivered", queueing);
+    report("delivered -> result", service);
+    printf("throughput: %.1f invocations/s over %.3f s\n", static_cast<double>(end_to_end.size()) / seconds, seconds);
+    return answered ? 0 : 2;
+}
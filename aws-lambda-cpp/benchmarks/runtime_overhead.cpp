@@ -0,0 +1,152 @@
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Measures what the runtime itself costs per invocation: a no-op handler is driven through run_handler against the
+// local mock Runtime API, so everything between two consecutive /next deliveries is runtime and transport overhead.
+//
+//   usage: runtime-overhead [invocations=10000] [payload bytes=64] [modes] [endpoint delay us=0] [handler work us=0]
+//
+// Build it with -DENABLE_NATIVE_HTTP=ON as well to compare the built-in HTTP client with libcurl; 'startup' is the time
+// from calling run_handler to the first invocation being delivered, which includes setting up the transport.
+//
+// 'modes' is a comma separated list of
+//   streamed:  the handler echoes the payload through a response_producer instead of returning it in one piece
+//   pipelined: results are posted in the background while the next invocation is fetched
+//   workers=N: N workers handle invocations concurrently, see runtime_options::workers
+//
+// 'handler work' keeps the handler busy on the CPU for that long per invocation, which shows how throughput scales
+// with the number of workers.
+
+#include "latency_stats.h"
+#include "mock_runtime_api.h"
+
+#include <aws/lambda-runtime/runtime.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace aws::lambda_runtime;
+using namespace aws::lambda_runtime::benchmarks;
+
+static void keep_busy(std::chrono::microseconds work)
+{
+    auto const until = std::chrono::steady_clock::now() + work;
+    while (std::chrono::steady_clock::now() < until) {
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t const invocations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000;
+    size_t const payload_size = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 64;
+    bool const streamed = argc > 3 && std::strstr(argv[3], "streamed");
+    runtime_options options;
+    options.pipeline_posts = argc > 3 && std::strstr(argv[3], "pipelined");
+    if (char const* workers = argc > 3 ? std::strstr(argv[3], "workers=") : nullptr) {
+        options.workers = std::strtoull(workers + std::strlen("workers="), nullptr, 10);
+    }
+    auto const work = std::chrono::microseconds(argc > 5 ? std::strtoull(argv[5], nullptr, 10) : 0);
+    if (invocations < 2) {
+        fprintf(stderr, "need at least 2 invocations\n");
+        return 1;
+    }
+
+    mock_runtime_api api;
+    if (argc > 4) {
+        api.set_response_delay(std::chrono::microseconds(std::strtoull(argv[4], nullptr, 10)));
+    }
+    if (!api.start()) {
+        fprintf(stderr, "failed to start the mock Runtime API\n");
+        return 1;
+    }
+    setenv("AWS_LAMBDA_RUNTIME_API", api.endpoint().c_str(), 1);
+
+    std::string const payload(payload_size, 'x');
+    for (size_t i = 0; i < invocations; i++) {
+        api.enqueue({"request-" + std::to_string(i), payload});
+    }
+
+    // Once every event has been answered, closing the endpoint makes run_handler give up and return.
+    std::vector<mock_runtime_api::invocation> completed;
+    std::thread waiter([&] {
+        completed = api.wait_for_completions(invocations);
+        api.stop();
+    });
+
+    auto const start = mock_runtime_api::clock::now();
+    if (streamed) {
+        run_consuming_handler([work](invocation_request&& req) {
+            keep_busy(work);
+            auto payload = std::make_shared<std::string>(std::move(req.payload));
+            auto offset = std::make_shared<size_t>(0);
+            return invocation_response::stream(
+                [payload, offset](char* buffer, size_t size) {
+                    size_t const n = std::min(size, payload->size() - *offset);
+                    std::memcpy(buffer, payload->data() + *offset, n);
+                    *offset += n;
+                    return n;
+                },
+                "application/json");
+        }, options);
+    }
+    else {
+        run_consuming_handler([work](invocation_request&& req) {
+            keep_busy(work);
+            return invocation_response::success(std::move(req.payload), "application/json");
+        }, options);
+    }
+    waiter.join();
+
+    std::vector<double> cycle;       // /next delivery to the following /next delivery
+    std::vector<double> turnaround;  // /next delivery to the result being posted
+    for (size_t i = 0; i < completed.size(); i++) {
+        turnaround.push_back(micros(completed[i].completed - completed[i].delivered));
+        if (i > 0) {
+            cycle.push_back(micros(completed[i].delivered - completed[i - 1].delivered));
+        }
+    }
+
+    auto const elapsed = completed.back().completed - completed.front().delivered;
+    for (auto const& inv : completed) {
+        if (!inv.success || inv.response.size() != payload_size) {
+            fprintf(stderr, "invocation %s was not echoed back\n", inv.request_id.c_str());
+            return 1;
+        }
+    }
+
+    printf(
+        "invocations: %zu, payload: %zu bytes, %s responses%s, %zu worker(s)\n",
+        completed.size(),
+        payload_size,
+        streamed ? "streamed" : "buffered",
+        options.pipeline_posts ? ", pipelined" : "",
+        options.workers);
+    printf("startup: %.1f us to the first invocation\n", micros(completed.front().delivered - start));
+    report("invocation cycle", cycle);
+    report("next -> result posted", turnaround);
+    printf(
+        "throughput: %.0f invocations/s (wall %.1f ms including shutdown)\n",
+        static_cast<double>(completed.size()) / std::chrono::duration<double>(elapsed).count(),
+        std::chrono::duration<double, std::milli>(mock_runtime_api::clock::now() - start).count());
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+// Compares computing warm state in a fresh init with restoring it from a state_snapshot. The state is a table of
+// modular powers standing in for precomputed base tables; it is restored both by copying it out of the snapshot and by
+// using it in place, where it stays mapped.
+//
+//   usage: snapshot-load [megabytes=64] [directory=/tmp]
+//
+// The snapshot is read back right after it was written, i.e. from the page cache, as a runtime restarted in the same
+// sandbox finds it.
+
+#include <aws/lambda-runtime/snapshot.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace aws::lambda_runtime;
+
+namespace {
+
+uint64_t const modulus = 0xffffffff00000001ULL;
+
+std::vector<uint64_t> compute_table(size_t entries)
+{
+    std::vector<uint64_t> table(entries);
+    for (size_t i = 0; i < entries; i++) {
+        unsigned __int128 x = i + 2;
+        for (int round = 0; round < 16; round++) {
+            x = x * x % modulus;
+        }
+        table[i] = static_cast<uint64_t>(x);
+    }
+    return table;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    size_t const megabytes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 64;
+    std::string const directory = argc > 2 ? argv[2] : "/tmp";
+    if (megabytes == 0) {
+        fprintf(stderr, "need at least 1 megabyte of state\n");
+        return 1;
+    }
+    size_t const entries = megabytes * 1024 * 1024 / sizeof(uint64_t);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint64_t> const fresh = compute_table(entries);
+    printf("fresh init        %9.2f ms\n", elapsed_ms(start));
+
+    {
+        state_snapshot snapshot(directory);
+        snapshot.add(
+            "table",
+            1,
+            [&fresh](std::string& out) {
+                out.append(reinterpret_cast<char const*>(fresh.data()), fresh.size() * sizeof(uint64_t));
+                return true;
+            },
+            nullptr);
+        start = std::chrono::steady_clock::now();
+        if (!snapshot.save()) {
+            fprintf(stderr, "failed to write the snapshot to %s\n", snapshot.path().c_str());
+            return 1;
+        }
+        printf("save              %9.2f ms (%zu bytes)\n", elapsed_ms(start), snapshot.stats().bytes);
+    }
+
+    std::vector<uint64_t> copied;
+    uint64_t const* in_place = nullptr;
+    size_t in_place_entries = 0;
+    auto const copy = [&copied](byte_view state) {
+        copied.resize(state.size() / sizeof(uint64_t));
+        std::memcpy(copied.data(), state.data(), state.size());
+        return true;
+    };
+    auto const map = [&in_place, &in_place_entries](byte_view state) {
+        in_place = reinterpret_cast<uint64_t const*>(state.data());
+        in_place_entries = state.size() / sizeof(uint64_t);
+        return true;
+    };
+
+    char const* const names[] = {"load (copy)", "load (in place)"};
+    for (int mode = 0; mode < 2; mode++) {
+        state_snapshot snapshot(directory);
+        snapshot.add("table", 1, nullptr, mode == 0 ? state_snapshot::restore_function(copy) : map);
+        start = std::chrono::steady_clock::now();
+        bool const loaded = snapshot.load();
+        double const ms = elapsed_ms(start);
+        bool const same = mode == 0 ? copied == fresh
+                                    : in_place_entries == fresh.size() &&
+                                          std::memcmp(in_place, fresh.data(), fresh.size() * sizeof(uint64_t)) == 0;
+        printf("%-17s %9.2f ms%s\n", names[mode], ms, loaded && snapshot.restored("table") && same ? "" : " (MISMATCH)");
+        if (mode == 1) {
+            std::remove(snapshot.path().c_str());
+        }
+    }
+    return 0;
+}
@@ -1,6 +1,9 @@
 include(CMakeFindDependencyMacro)
 
-find_dependency(CURL)
+if (NOT @ENABLE_NATIVE_HTTP@)
+    find_dependency(CURL)
+endif()
+find_dependency(Threads)
 
 include(${CMAKE_CURRENT_LIST_DIR}/@CMAKE_PROJECT_NAME@-targets.cmake)
 
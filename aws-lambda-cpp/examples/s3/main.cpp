@@ -10,18 +10,13 @@
 #include <aws/s3/S3Client.h>
 #include <aws/s3/model/GetObjectRequest.h>
 #include <aws/lambda-runtime/runtime.h>
+#include <cstring>
 #include <iostream>
 #include <memory>
 
 using namespace aws::lambda_runtime;
 
-std::string download_and_encode_file(
-    Aws::S3::S3Client const& client,
-    Aws::String const& bucket,
-    Aws::String const& key,
-    Aws::String& encoded_output);
-
-std::string encode(Aws::String const& filename, Aws::String& output);
+size_t encode_next(Aws::IOStream& stream, char* buffer, size_t size);
 char const TAG[] = "LAMBDA_ALLOC";
 
 static invocation_response my_handler(invocation_request const& req, Aws::S3::S3Client const& client)
@@ -44,13 +39,21 @@ static invocation_response my_handler(invocation_request const& req, Aws::S3::S3
 
     AWS_LOGSTREAM_INFO(TAG, "Attempting to download file from s3://" << bucket << "/" << key);
 
-    Aws::String base64_encoded_file;
-    auto err = download_and_encode_file(client, bucket, key, base64_encoded_file);
-    if (!err.empty()) {
-        return invocation_response::failure(err, "DownloadFailure");
+    Aws::S3::Model::GetObjectRequest request;
+    request.WithBucket(bucket).WithKey(key);
+    auto outcome = client.GetObject(request);
+    if (!outcome.IsSuccess()) {
+        AWS_LOGSTREAM_ERROR(TAG, "Failed with error: " << outcome.GetError());
+        return invocation_response::failure(outcome.GetError().GetMessage().c_str(), "DownloadFailure");
     }
 
-    return invocation_response::success(base64_encoded_file, "application/base64");
+    AWS_LOGSTREAM_INFO(TAG, "Download completed!");
+
+    // the file is encoded piece by piece while the response is being sent, the encoded file is never held in memory
+    auto result = std::make_shared<Aws::S3::Model::GetObjectResult>(outcome.GetResultWithOwnership());
+    return invocation_response::stream(
+        [result](char* buffer, size_t size) { return encode_next(result->GetBody(), buffer, size); },
+        "application/base64");
 }
 
 std::function<std::shared_ptr<Aws::Utils::Logging::LogSystemInterface>()> GetConsoleLoggerFactory()
@@ -84,45 +87,19 @@ int main()
     return 0;
 }
 
-std::string encode(Aws::IOStream& stream, Aws::String& output)
+// Base64-encode the next part of 'stream' into 'buffer'. Only whole 3-byte groups are read until the end of the
+// stream, so the encoded parts simply concatenate and only the last one carries padding.
+size_t encode_next(Aws::IOStream& stream, char* buffer, size_t size)
 {
-    Aws::Vector<unsigned char> bits;
-    bits.reserve(stream.tellp());
-    stream.seekg(0, stream.beg);
-
-    char streamBuffer[1024 * 4];
-    while (stream.good()) {
-        stream.read(streamBuffer, sizeof(streamBuffer));
-        auto bytesRead = stream.gcount();
-
-        if (bytesRead > 0) {
-            bits.insert(bits.end(), (unsigned char*)streamBuffer, (unsigned char*)streamBuffer + bytesRead);
-        }
+    Aws::Vector<unsigned char> bits(size / 4 * 3);
+    stream.read(reinterpret_cast<char*>(bits.data()), static_cast<std::streamsize>(bits.size()));
+    auto const bytes_read = static_cast<size_t>(stream.gcount());
+    if (bytes_read == 0) {
+        return 0;
     }
-    Aws::Utils::ByteBuffer bb(bits.data(), bits.size());
-    output = Aws::Utils::HashingUtils::Base64Encode(bb);
-    return {};
-}
 
-std::string download_and_encode_file(
-    Aws::S3::S3Client const& client,
-    Aws::String const& bucket,
-    Aws::String const& key,
-    Aws::String& encoded_output)
-{
-    using namespace Aws;
-
-    S3::Model::GetObjectRequest request;
-    request.WithBucket(bucket).WithKey(key);
-
-    auto outcome = client.GetObject(request);
-    if (outcome.IsSuccess()) {
-        AWS_LOGSTREAM_INFO(TAG, "Download completed!");
-        auto& s = outcome.GetResult().GetBody();
-        return encode(s, encoded_output);
-    }
-    else {
-        AWS_LOGSTREAM_ERROR(TAG, "Failed with error: " << outcome.GetError());
-        return outcome.GetError().GetMessage();
-    }
+    Aws::Utils::ByteBuffer bb(bits.data(), bytes_read);
+    auto const encoded = Aws::Utils::HashingUtils::Base64Encode(bb);
+    std::memcpy(buffer, encoded.data(), encoded.size());
+    return encoded.size();
 }
@@ -14,33 +14,115 @@
  * permissions and limitations under the License.
  */
 
+#include <array>
 #include <string>
 #include <vector>
 #include <algorithm>
 #include <cctype> // tolower
 #include <cassert>
+#include <cstring>
+#include <utility>
 
 namespace aws {
 namespace http {
 enum class response_code;
+
+/**
+ * The headers the runtime API sends with every invocation. They are recognized while the header is parsed and kept in
+ * fixed slots of the response, so looking them up involves no search.
+ */
+enum class lambda_header {
+    request_id,
+    trace_id,
+    client_context,
+    cognito_identity,
+    deadline_ms,
+    function_arn,
+};
+
+constexpr size_t lambda_header_count = 6;
+
 class response {
 public:
     /**
      * lower-case the name but store the value as is
      */
     inline void add_header(std::string name, std::string const& value);
+
+    /**
+     * Parse one raw header line ("Name: value", optionally followed by CRLF) as delivered by the transport. Lines
+     * without a colon, such as the status line, are ignored. Lambda headers go to their slot; other headers are copied
+     * into an arena that is reused across clear(), so parsing doesn't allocate once the response has seen a few
+     * requests.
+     */
+    inline void add_header(char const* line, size_t length);
     inline void append_body(const char* p, size_t sz);
+
+    /**
+     * Look up a header by its lower-case name. Other headers than the lambda ones are rarely read, so get_header
+     * returns a copy of the value rather than a reference into the arena.
+     */
     inline bool has_header(char const* header) const;
-    inline std::string const& get_header(char const* header) const;
+    inline std::string get_header(char const* header) const;
+    inline bool has_header(lambda_header header) const;
+    inline std::string const& get_header(lambda_header header) const;
     inline response_code get_response_code() const { return m_response_code; }
     inline void set_response_code(aws::http::response_code c);
     inline void set_content_type(char const* ct);
     inline std::string const& get_body() const;
 
+    /**
+     * Whether the response announced the size of its body with a content-length header.
+     */
+    inline bool has_content_length() const { return m_has_content_length; }
+    inline size_t get_content_length() const { return m_content_length; }
+
+    /**
+     * Move the body out of the response, leaving it empty.
+     */
+    inline std::string take_body();
+
+    /**
+     * Forget everything about the previous response so the object can be reused for the next request.
+     */
+    inline void clear();
+
 private:
+    inline void store_header(char const* name, size_t name_length, char const* value, size_t value_length);
+    static inline int find_lambda_header(char const* name, size_t length);
+
+    /**
+     * Case-insensitive comparison of 'length' bytes against the all lower-case 'lower'.
+     */
+    static inline bool equals_lower(char const* s, char const* lower, size_t length);
+
+    /**
+     * Header names are ASCII, no need to go through the locale.
+     */
+    static char to_lower_ascii(char c) { return c >= 'A' && c <= 'Z' ? static_cast<char>(c + ('a' - 'A')) : c; }
+
+    /**
+     * The index of the first of the other headers named 'header', or m_headers.size() if there is none.
+     */
+    inline size_t find_header(char const* header) const;
+
     response_code m_response_code;
-    using key_value_collection = std::vector<std::pair<std::string, std::string>>;
-    key_value_collection m_headers;
+    std::array<std::string, lambda_header_count> m_lambda_headers;
+    unsigned m_present_lambda_headers = 0; // bit i is set if slot i holds a header
+
+    /**
+     * Every other header: the lower-cased name followed by the value, back to back in m_header_arena. clear() empties
+     * both but keeps their capacity.
+     */
+    struct stored_header {
+        size_t offset;
+        size_t name_length;
+        size_t value_length;
+    };
+    std::vector<stored_header> m_headers;
+    std::string m_header_arena;
+    bool m_has_content_length = false;
+    size_t m_content_length = 0;
     std::string m_body;
     std::string m_content_type;
 };
@@ -137,37 +219,190 @@ inline std::string const& response::get_body() const
 {
     return m_body;
 }
+
+inline std::string response::take_body()
+{
+    std::string body = std::move(m_body);
+    m_body.clear(); // moved-from strings are only guaranteed to be valid, not empty
+    return body;
+}
+
+inline void response::clear()
+{
+    m_response_code = response_code::REQUEST_NOT_MADE;
+    m_present_lambda_headers = 0;
+    m_headers.clear();
+    m_header_arena.clear();
+    m_has_content_length = false;
+    m_content_length = 0;
+    m_body.clear();
+    m_content_type.clear();
+}
+
+inline bool response::equals_lower(char const* s, char const* lower, size_t length)
+{
+    for (size_t i = 0; i < length; i++) {
+        if (to_lower_ascii(s[i]) != lower[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline int response::find_lambda_header(char const* name, size_t length)
+{
+    struct known_header {
+        char const* name;
+        size_t length;
+    };
+    // in the order of lambda_header
+    static constexpr known_header known[] = {
+        {"lambda-runtime-aws-request-id", sizeof("lambda-runtime-aws-request-id") - 1},
+        {"lambda-runtime-trace-id", sizeof("lambda-runtime-trace-id") - 1},
+        {"lambda-runtime-client-context", sizeof("lambda-runtime-client-context") - 1},
+        {"lambda-runtime-cognito-identity", sizeof("lambda-runtime-cognito-identity") - 1},
+        {"lambda-runtime-deadline-ms", sizeof("lambda-runtime-deadline-ms") - 1},
+        {"lambda-runtime-invoked-function-arn", sizeof("lambda-runtime-invoked-function-arn") - 1},
+    };
+    constexpr size_t prefix_length = sizeof("lambda-runtime-") - 1;
+    if (length <= prefix_length || !equals_lower(name, known[0].name, prefix_length)) {
+        return -1;
+    }
+    for (size_t i = 0; i < lambda_header_count; i++) {
+        if (known[i].length == length &&
+            equals_lower(name + prefix_length, known[i].name + prefix_length, length - prefix_length)) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+inline void response::store_header(char const* name, size_t name_length, char const* value, size_t value_length)
+{
+    int const slot = find_lambda_header(name, name_length);
+    if (slot >= 0) {
+        m_lambda_headers[static_cast<size_t>(slot)].assign(value, value_length);
+        m_present_lambda_headers |= 1u << slot;
+        return;
+    }
+
+    constexpr size_t content_length_name_length = sizeof("content-length") - 1;
+    if (name_length == content_length_name_length && equals_lower(name, "content-length", name_length)) {
+        m_has_content_length = value_length > 0;
+        m_content_length = 0;
+        for (size_t i = 0; i < value_length; i++) {
+            if (value[i] < '0' || value[i] > '9' || m_content_length > (static_cast<size_t>(-1) - 9) / 10) {
+                m_has_content_length = false;
+                break;
+            }
+            m_content_length = m_content_length * 10 + static_cast<size_t>(value[i] - '0');
+        }
+    }
+
+    size_t const offset = m_header_arena.size();
+    m_header_arena.append(name, name_length);
+    for (size_t i = offset; i < m_header_arena.size(); i++) {
+        m_header_arena[i] = to_lower_ascii(m_header_arena[i]);
+    }
+    m_header_arena.append(value, value_length);
+    m_headers.push_back({offset, name_length, value_length});
+}
+
 inline void response::add_header(std::string name, std::string const& value)
 {
-    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-    m_headers.emplace_back(name, value);
+    store_header(name.data(), name.length(), value.data(), value.length());
+}
+
+inline void response::add_header(char const* line, size_t length)
+{
+    auto const colon = static_cast<char const*>(std::memchr(line, ':', length));
+    if (!colon) {
+        return;
+    }
+
+    auto const is_space = [](char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+    char const* name_begin = line;
+    char const* name_end = colon;
+    char const* value_begin = colon + 1;
+    char const* value_end = line + length;
+    while (name_begin < name_end && is_space(*name_begin)) {
+        name_begin++;
+    }
+    while (name_end > name_begin && is_space(name_end[-1])) {
+        name_end--;
+    }
+    while (value_begin < value_end && is_space(*value_begin)) {
+        value_begin++;
+    }
+    while (value_end > value_begin && is_space(value_end[-1])) {
+        value_end--;
+    }
+    store_header(
+        name_begin,
+        static_cast<size_t>(name_end - name_begin),
+        value_begin,
+        static_cast<size_t>(value_end - value_begin));
 }
 
 inline void response::append_body(const char* p, size_t sz)
 {
     // simple and generates significantly less code than std::stringstream
     constexpr size_t min_capacity = 512;
-    if (m_body.capacity() < min_capacity) {
-        m_body.reserve(min_capacity);
+    // a bogus content-length must not reserve more than this, the body still grows past it if needed
+    constexpr size_t max_preallocated = 64 << 20;
+    if (m_body.empty()) {
+        // with a content-length the whole body is received into one allocation instead of growing by doubling
+        size_t const expected = m_has_content_length ? std::min(m_content_length, max_preallocated) : min_capacity;
+        if (m_body.capacity() < expected) {
+            m_body.reserve(expected);
+        }
     }
 
     m_body.append(p, sz);
 }
 
+inline bool response::has_header(lambda_header header) const
+{
+    return (m_present_lambda_headers & (1u << static_cast<unsigned>(header))) != 0;
+}
+
+inline std::string const& response::get_header(lambda_header header) const
+{
+    assert(has_header(header));
+    return m_lambda_headers[static_cast<size_t>(header)];
+}
+
+inline size_t response::find_header(char const* header) const
+{
+    size_t const length = std::strlen(header);
+    for (size_t i = 0; i < m_headers.size(); i++) {
+        auto const& h = m_headers[i];
+        if (h.name_length == length && m_header_arena.compare(h.offset, length, header) == 0) {
+            return i;
+        }
+    }
+    return m_headers.size();
+}
+
 inline bool response::has_header(char const* header) const
 {
-    return std::any_of(m_headers.begin(), m_headers.end(), [header](std::pair<std::string, std::string> const& p) {
-        return p.first == header;
-    });
+    int const slot = find_lambda_header(header, std::strlen(header));
+    if (slot >= 0) {
+        return has_header(static_cast<lambda_header>(slot));
+    }
+    return find_header(header) < m_headers.size();
 }
 
-inline std::string const& response::get_header(char const* header) const
+inline std::string response::get_header(char const* header) const
 {
-    auto it = std::find_if(m_headers.begin(), m_headers.end(), [header](std::pair<std::string, std::string> const& p) {
-        return p.first == header;
-    });
-    assert(it != m_headers.end());
-    return it->second;
+    int const slot = find_lambda_header(header, std::strlen(header));
+    if (slot >= 0) {
+        return get_header(static_cast<lambda_header>(slot));
+    }
+    size_t const i = find_header(header);
+    assert(i < m_headers.size());
+    auto const& h = m_headers[i];
+    return m_header_arena.substr(h.offset + h.name_length, h.value_length);
 }
 
 } // namespace http
@@ -0,0 +1,162 @@
+#pragma once
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace aws {
+namespace lambda_runtime {
+
+/**
+ * What an invocation_arena has handed out.
+ */
+struct arena_stats {
+    /**
+     * Allocations since the last reset.
+     */
+    size_t allocations = 0;
+
+    /**
+     * Bytes allocated since the last reset, not counting alignment padding.
+     */
+    size_t bytes = 0;
+
+    /**
+     * The most bytes allocated between two resets over the lifetime of the arena, i.e. the most memory any single
+     * invocation needed from it.
+     */
+    size_t high_water = 0;
+
+    /**
+     * Memory the arena holds on to, whether handed out or not.
+     */
+    size_t reserved = 0;
+};
+
+/**
+ * A monotonic arena for memory that lives no longer than one invocation. Allocating bumps a pointer into the current
+ * block, deallocating does nothing, and reset() releases everything at once. Blocks are taken from the heap as
+ * needed, each twice the size of the one before; once the arena has grown, reset() replaces its blocks with a single
+ * one of their combined size, so an invocation that needs as much as the previous ones doesn't touch the heap at all.
+ * That block is capped at max_retained_blocks times the first block's size: after an outlier invocation the arena
+ * gives the memory back rather than holding on to it for the lifetime of the process.
+ * The runtime hands every invocation an arena through invocation_request::arena and resets it once the result is
+ * posted. An arena is not thread-safe.
+ */
+class invocation_arena {
+public:
+    static constexpr size_t default_block_size = 64 * 1024;
+    static constexpr size_t max_retained_blocks = 16;
+
+    explicit invocation_arena(size_t block_size = default_block_size);
+    ~invocation_arena();
+
+    invocation_arena(invocation_arena const&) = delete;
+    invocation_arena& operator=(invocation_arena const&) = delete;
+
+    /**
+     * Allocate 'size' bytes aligned to 'alignment', which must be a power of two. Aborts if the heap is exhausted.
+     */
+    inline void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    /**
+     * Release everything allocated so far. Memory handed out before must not be used afterwards.
+     */
+    void reset();
+
+    arena_stats stats() const;
+
+private:
+    struct block;
+
+    void* allocate_block(size_t size, size_t alignment);
+    void add_block(size_t capacity);
+    void free_blocks();
+
+    block* m_blocks;
+    char* m_cursor;
+    char* m_limit;
+    size_t m_block_size;
+    size_t m_next_block_size;
+    arena_stats m_stats;
+};
+
+inline void* invocation_arena::allocate(size_t size, size_t alignment)
+{
+    size_t const remaining = static_cast<size_t>(m_limit - m_cursor);
+    size_t const padding = (alignment - reinterpret_cast<uintptr_t>(m_cursor) % alignment) % alignment;
+    if (size > remaining || padding > remaining - size) {
+        return allocate_block(size, alignment);
+    }
+    void* const p = m_cursor + padding;
+    m_cursor += padding + size;
+    m_stats.allocations++;
+    m_stats.bytes += size;
+    return p;
+}
+
+/**
+ * Lets standard containers allocate from an invocation_arena, e.g.
+ *   arena_vector<int> v{arena_allocator<int>(*request.arena)};
+ */
+template <typename T>
+class arena_allocator {
+public:
+    using value_type = T;
+
+    explicit arena_allocator(invocation_arena& arena) noexcept : m_arena(&arena) {}
+
+    template <typename U>
+    arena_allocator(arena_allocator<U> const& other) noexcept : m_arena(other.get_arena())
+    {
+    }
+
+    T* allocate(size_t n)
+    {
+        // an overflowing size is passed on as too large for any block, making the arena abort
+        size_t const size = n > static_cast<size_t>(-1) / sizeof(T) ? static_cast<size_t>(-1) : n * sizeof(T);
+        return static_cast<T*>(m_arena->allocate(size, alignof(T)));
+    }
+
+    void deallocate(T*, size_t) noexcept {}
+
+    invocation_arena* get_arena() const noexcept { return m_arena; }
+
+private:
+    invocation_arena* m_arena;
+};
+
+template <typename T, typename U>
+bool operator==(arena_allocator<T> const& a, arena_allocator<U> const& b) noexcept
+{
+    return a.get_arena() == b.get_arena();
+}
+
+template <typename T, typename U>
+bool operator!=(arena_allocator<T> const& a, arena_allocator<U> const& b) noexcept
+{
+    return !(a == b);
+}
+
+template <typename T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
+
+using arena_string = std::basic_string<char, std::char_traits<char>, arena_allocator<char>>;
+
+} // namespace lambda_runtime
+} // namespace aws
@@ -15,6 +15,8 @@
  */
 
 #include <cassert>
+#include <new>
+#include <utility>
 
 namespace aws {
 namespace lambda_runtime {
@@ -24,15 +26,18 @@ class outcome {
 public:
     outcome(TResult const& s) : s(s), success(true) {}
 
+    outcome(TResult&& s) : s(std::move(s)), success(true) {}
+
     outcome(TFailure const& f) : f(f), success(false) {}
 
     outcome(outcome&& other) : success(other.success)
     {
+        // the union members are uninitialized storage at this point, so they're constructed rather than assigned
         if (success) {
-            s = std::move(other.s);
+            new (&s) TResult(std::move(other.s));
         }
         else {
-            f = std::move(other.f);
+            new (&f) TFailure(std::move(other.f));
         }
     }
 
@@ -46,12 +51,21 @@ public:
         }
     }
 
-    TResult const& get_result() const
+    TResult const& get_result() const&
     {
         assert(success);
         return s;
     }
 
+    /**
+     * Move the result out of an expiring outcome.
+     */
+    TResult&& get_result() &&
+    {
+        assert(success);
+        return std::move(s);
+    }
+
     TFailure const& get_failure() const
     {
         assert(!success);
@@ -14,16 +14,128 @@
  * permissions and limitations under the License.
  */
 
+#include "aws/lambda-runtime/arena.h"
+
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <functional>
+#include <utility>
+#include <vector>
 
 namespace aws {
 namespace lambda_runtime {
 
+/**
+ * Where the time of one invocation went, as measured by the runtime on a monotonic clock.
+ */
+struct invocation_metrics {
+    /**
+     * From requesting the invocation until its first byte arrived, which is mostly waiting for an event.
+     */
+    std::chrono::microseconds next_wait{0};
+
+    /**
+     * From the first to the last byte of the invocation.
+     */
+    std::chrono::microseconds body_receipt{0};
+
+    /**
+     * Time spent in the handler. Zero while the handler is still running.
+     */
+    std::chrono::microseconds handler{0};
+
+    /**
+     * Time spent posting the result. Zero while the handler is still running.
+     */
+    std::chrono::microseconds post{0};
+
+    /**
+     * Size of the payload received.
+     */
+    size_t bytes_in = 0;
+
+    /**
+     * Size of the result posted. Zero while the handler is still running.
+     */
+    size_t bytes_out = 0;
+
+    /**
+     * Bytes and allocations taken from the invocation's arena. Zero while the handler is still running.
+     */
+    size_t arena_bytes = 0;
+    size_t arena_allocations = 0;
+};
+
+/**
+ * A read-only view of a sequence of bytes of any value, zeros included. It doesn't own the bytes, which have to outlive
+ * the view.
+ */
+class byte_view {
+public:
+    byte_view() = default;
+    byte_view(uint8_t const* data, size_t size) : m_data(data), m_size(size) {}
+    byte_view(std::vector<uint8_t> const& bytes) : m_data(bytes.data()), m_size(bytes.size()) {}
+    byte_view(std::string const& bytes)
+        : m_data(reinterpret_cast<uint8_t const*>(bytes.data())), m_size(bytes.size())
+    {
+    }
+
+    uint8_t const* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    uint8_t const* begin() const { return m_data; }
+    uint8_t const* end() const { return m_data + m_size; }
+    uint8_t operator[](size_t i) const { return m_data[i]; }
+
+    /**
+     * Copy the bytes into a vector of their own.
+     */
+    std::vector<uint8_t> to_vector() const { return std::vector<uint8_t>(begin(), end()); }
+
+private:
+    uint8_t const* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+/**
+ * Tells a long running handler when to stop computing and answer with what it has, before lambda terminates the
+ * invocation and the work done so far is lost. Checking it reads a monotonic clock, so a loop can poll it on every
+ * iteration of its outer loop.
+ */
+class cancellation_token {
+public:
+    using clock = std::chrono::steady_clock;
+
+    /**
+     * Create a token that is never cancelled.
+     */
+    cancellation_token() = default;
+
+    /**
+     * Create a token that is cancelled from 'expiry' on.
+     */
+    explicit cancellation_token(clock::time_point expiry) : m_expiry(expiry) {}
+
+    /**
+     * Returns true once the handler should stop and report its progress.
+     */
+    bool is_cancelled() const { return clock::now() >= m_expiry; }
+
+    /**
+     * The time left before the token is cancelled, or milliseconds::max() for a token that is never cancelled.
+     */
+    inline std::chrono::milliseconds get_time_remaining() const;
+
+private:
+    clock::time_point m_expiry = clock::time_point::max();
+};
+
 struct invocation_request {
     /**
-     * The user's payload represented as a UTF-8 string.
+     * The user's payload exactly as it was received. It is usually UTF-8 encoded JSON, but can hold any bytes, see
+     * get_payload_bytes().
      */
     std::string payload;
 
@@ -57,12 +169,51 @@ struct invocation_request {
      */
     std::chrono::time_point<std::chrono::system_clock> deadline;
 
+    /**
+     * How long it took to receive this invocation. The remaining phases are reported through
+     * runtime_options::on_metrics once the result has been posted.
+     */
+    invocation_metrics metrics;
+
+    /**
+     * Memory for the handler's temporaries, see arena_allocator. Everything allocated from it is released at once when
+     * the result has been posted, so it may back a streamed response but nothing that outlives the invocation. Set by
+     * the runtime for every invocation.
+     */
+    invocation_arena* arena = nullptr;
+
+    /**
+     * The worker handling the invocation, below runtime_options::workers. Scratch state kept per worker, e.g. in a
+     * vector indexed by it, needs no locking.
+     */
+    size_t worker = 0;
+
+    /**
+     * The payload as bytes, for binary payloads that don't fit the notion of a string.
+     */
+    byte_view get_payload_bytes() const { return payload; }
+
     /**
      * The number of milliseconds left before lambda terminates the current execution.
      */
     inline std::chrono::milliseconds get_time_remaining() const;
+
+    /**
+     * A token that is cancelled 'safety_margin' before the deadline, leaving the handler that much time to encode and
+     * return a partial result. The token is never cancelled if the invocation carries no deadline.
+     */
+    inline cancellation_token get_cancellation_token(
+        std::chrono::milliseconds safety_margin = std::chrono::milliseconds(500)) const;
 };
 
+/**
+ * Produces a streamed response piece by piece. It's called with a buffer of 'size' bytes, writes the next part of the
+ * response into it and returns how many bytes it wrote. Returning 0 ends the response; returning
+ * invocation_response::abort_stream abandons it, in which case the invocation is reported as failed instead.
+ * The producer runs on the runtime's thread while the response is being sent and must not throw.
+ */
+using response_producer = std::function<size_t(char* buffer, size_t size)>;
+
 class invocation_response {
 private:
     /**
@@ -70,12 +221,22 @@ private:
      */
     std::string m_payload;
 
+    /**
+     * The output of the function if it was handed over as a byte vector, in which case m_payload is empty.
+     */
+    std::vector<uint8_t> m_bytes;
+
     /**
      * The MIME type of the payload.
      * This is always set to 'application/json' in unsuccessful invocations.
      */
     std::string m_content_type;
 
+    /**
+     * Set for streamed responses, in which case the payload is empty.
+     */
+    response_producer m_producer;
+
     /**
      * Flag to distinguish if the contents are for successful or unsuccessful invocations.
      */
@@ -88,11 +249,38 @@ private:
     invocation_response() = default;
 
 public:
+    /**
+     * Returned by a response_producer to abandon a streamed response.
+     */
+    static constexpr size_t abort_stream = static_cast<size_t>(-1);
+
     /**
      * Create a successful invocation response with the given payload and content-type.
      */
     static invocation_response success(std::string const& payload, std::string const& content_type);
 
+    /**
+     * Create a successful invocation response that takes ownership of the given payload instead of copying it.
+     */
+    static invocation_response success(std::string&& payload, std::string const& content_type);
+
+    /**
+     * Create a successful invocation response with a copy of the given bytes, which are posted unchanged.
+     */
+    static invocation_response success(byte_view payload, std::string const& content_type);
+
+    /**
+     * Create a successful invocation response that takes ownership of the given bytes, which are posted unchanged.
+     */
+    static invocation_response success(std::vector<uint8_t>&& payload, std::string const& content_type);
+
+    /**
+     * Create a successful invocation response whose payload is pulled from 'producer' while it is being sent, using
+     * chunked transfer-encoding. The full payload is never held in memory and its first bytes leave before the
+     * producer has computed the rest.
+     */
+    static invocation_response stream(response_producer producer, std::string const& content_type);
+
     /**
      * Create a failure response with the given error message and error type.
      * The content-type is always set to application/json in this case.
@@ -105,10 +293,26 @@ public:
     std::string const& get_content_type() const { return m_content_type; }
 
     /**
-     * Get the payload string. The string is assumed to be UTF-8 encoded.
+     * Get the payload of a response created from a string, or of a failure. Empty for a response that was created from
+     * a byte vector; get_payload_bytes() returns the payload of any response that isn't streamed.
      */
     std::string const& get_payload() const { return m_payload; }
 
+    /**
+     * Get the payload as bytes, however the response was created.
+     */
+    byte_view get_payload_bytes() const { return m_bytes.empty() ? byte_view(m_payload) : byte_view(m_bytes); }
+
+    /**
+     * Returns true if the payload is produced by a response_producer rather than held in the response.
+     */
+    bool is_streaming() const { return static_cast<bool>(m_producer); }
+
+    /**
+     * Get the producer of a streamed response.
+     */
+    response_producer const& get_producer() const { return m_producer; }
+
     /**
      * Returns true if the payload and content-type are set. Returns false if the error message and error types are set.
      */
@@ -121,8 +325,221 @@ inline std::chrono::milliseconds invocation_request::get_time_remaining() const
     return duration_cast<milliseconds>(deadline - system_clock::now());
 }
 
+inline cancellation_token invocation_request::get_cancellation_token(std::chrono::milliseconds safety_margin) const
+{
+    if (deadline.time_since_epoch().count() == 0) {
+        return cancellation_token();
+    }
+    // convert once, so that adjustments of the wall clock while the handler runs don't move the expiry
+    return cancellation_token(cancellation_token::clock::now() + (get_time_remaining() - safety_margin));
+}
+
+inline std::chrono::milliseconds cancellation_token::get_time_remaining() const
+{
+    using namespace std::chrono;
+    if (m_expiry == clock::time_point::max()) {
+        return milliseconds::max();
+    }
+    return duration_cast<milliseconds>(m_expiry - clock::now());
+}
+
+/**
+ * Receives the payload of every invocation straight from the socket, piece by piece, instead of the runtime collecting
+ * it into invocation_request::payload, which is then left empty. A handler can decode the payload while it arrives or
+ * have it written into memory of its own, e.g. an mmap-backed buffer, without an intermediate copy, and then finds it
+ * wherever its sink put it. The runtime calls the sink on the thread that requests invocations, always before the
+ * handler runs for the payload.
+ */
+class payload_sink {
+public:
+    /**
+     * Passed to begin() if the runtime API didn't announce the size of the payload.
+     */
+    static constexpr size_t unknown_length = static_cast<size_t>(-1);
+
+    virtual ~payload_sink() = default;
+
+    /**
+     * Start receiving a new payload, dropping whatever is left of the previous one, including a payload that was cut
+     * off because its invocation failed to arrive. 'content_length' is the size of the payload or unknown_length.
+     */
+    virtual void begin(size_t content_length) = 0;
+
+    /**
+     * Receive the next piece of the payload.
+     */
+    virtual void write(char const* data, size_t size) = 0;
+};
+
+/**
+ * How the runtime retries requests to the runtime API that failed for a transient reason: the request didn't reach the
+ * endpoint, or the endpoint answered 408, 429, 502, 503 or 504. Any other error is not retried. A 500 means the
+ * sandbox is in a non-recoverable state and stops the runtime; a post rejected with a 4xx only drops that invocation's
+ * result.
+ * Before the n-th retry the runtime sleeps for a random time between zero and min(max_backoff, initial_backoff * 2^n)
+ * ("full jitter"), so runtimes that lost their connection at the same time don't reconnect at the same time.
+ */
+struct retry_policy {
+    /**
+     * Attempts of a single request, the first one included.
+     */
+    size_t max_attempts = 5;
+
+    std::chrono::milliseconds initial_backoff{10};
+
+    std::chrono::milliseconds max_backoff{1000};
+};
+
+class state_snapshot;
+
+struct runtime_options {
+    /**
+     * Post each result from a second connection on a background thread while the next invocation is already being
+     * requested, instead of waiting for the post to complete first. Results are still posted one at a time and in
+     * order; the producer of a streamed response runs on that background thread.
+     * If a post fails fatally (see retry_policy), the runtime stops as it does without pipelining, but the invocation
+     * that was fetched in the meantime is left unanswered.
+     */
+    bool pipeline_posts = false;
+
+    /**
+     * Called with the complete metrics of every invocation once its result has been posted, on the thread that posted
+     * it.
+     */
+    std::function<void(std::string const& request_id, invocation_metrics const& metrics)> on_metrics;
+
+    /**
+     * Print the metrics of every invocation to stdout as a CloudWatch embedded metric format (EMF) record, so they
+     * become CloudWatch metrics without any further setup.
+     */
+    bool log_metrics = false;
+
+    /**
+     * Called with the duration of the init callback once it has returned, see the run_handler overloads that take one.
+     * With log_metrics set, the duration is also printed as an embedded metric format record.
+     */
+    std::function<void(std::chrono::microseconds init_duration)> on_init_metrics;
+
+    /**
+     * Applies to requesting invocations and to posting results. A result is posted again as is, without running the
+     * handler again; a streamed result is only posted again if its producer hasn't been called yet.
+     */
+    retry_policy retries;
+
+    /**
+     * Stream the payload of every invocation into this sink instead of invocation_request::payload. Not owned by the
+     * runtime, it has to outlive run_handler.
+     */
+    payload_sink* sink = nullptr;
+
+    /**
+     * Size of the first block of the arena every invocation is handed; it grows as the handlers need more.
+     */
+    size_t arena_block_size = invocation_arena::default_block_size;
+
+    /**
+     * Restore warm state from this snapshot before the init callback runs and save it once the callback has succeeded,
+     * see state_snapshot. Not owned by the runtime, it has to outlive run_handler.
+     */
+    state_snapshot* snapshot = nullptr;
+
+    /**
+     * Number of workers: threads that each request and handle invocations on their own connection to the endpoint, so
+     * that a dispatcher which hands out several invocations at once gets them handled concurrently. Lambda itself
+     * sends one invocation at a time per sandbox, so this only pays off behind an emulator of the runtime API.
+     * With more than one worker, the handler, on_metrics and the producers of streamed responses are called from
+     * several threads at once and have to be thread-safe. The init callback still runs once before any worker starts;
+     * what it sets up is shared by all of them and should only be read by the handler, or guarded by it. Per-worker
+     * state can be indexed by invocation_request::worker. A sink can't be shared, so setting one forces one worker.
+     * Once a worker stops, e.g. because the endpoint failed, the others stop too: a worker waiting for its next
+     * invocation gives up right away, one running the handler posts its result and takes on no further invocation.
+     */
+    size_t workers = 1;
+};
+
+/**
+ * Runs once in the init phase, before the first invocation is requested, so expensive setup (parameters, clients,
+ * caches) doesn't land on the first invocation. Return invocation_response::failure to report that the function
+ * failed to initialize: the failure is posted to the runtime API's init error endpoint and the runtime returns without
+ * requesting any invocation. The payload of a successful response is ignored.
+ */
+using init_handler = std::function<invocation_response()>;
+
+/**
+ * Dispatches invocations to handlers registered by operation name, so that one function, and the warm state it has
+ * built up, serves several operations. The operation is the string member "op" of the "custom" object in the client
+ * context, or else the top-level string member "op" of a JSON payload. Finding it doesn't parse the payload: the
+ * members ahead of "op" are skipped over and the rest isn't looked at, so payloads that name their operation first
+ * cost next to nothing to route, and the handler parses the payload as it would without the router.
+ * A router is a handler itself and can be passed to run_handler.
+ */
+class invocation_router {
+public:
+    using handler = std::function<invocation_response(invocation_request const&)>;
+
+    /**
+     * Send invocations of operation 'op' to 'h'. Registering an operation again replaces its handler.
+     */
+    invocation_router& route(std::string op, handler h);
+
+    /**
+     * Send invocations that name no operation, or one that isn't registered, to 'h'. Without a fallback they fail
+     * with "MissingOperation" or "UnknownOperation".
+     */
+    invocation_router& fallback(handler h);
+
+    invocation_response operator()(invocation_request const& request) const;
+
+    /**
+     * Find the operation 'request' names, as the router would. Returns false if it names none; 'op' and 'length' then
+     * stay untouched. The operation is a view into the request and valid for as long as the request is.
+     */
+    static bool find_operation(invocation_request const& request, char const*& op, size_t& length);
+
+private:
+    std::vector<std::pair<std::string, handler>> m_routes;
+    handler m_fallback;
+};
+
 // Entry method
 void run_handler(std::function<invocation_response(invocation_request const&)> const& handler);
 
+void run_handler(
+    std::function<invocation_response(invocation_request const&)> const& handler,
+    runtime_options const& options);
+
+/**
+ * Same as run_handler, but 'init' runs first, in the init phase.
+ */
+void run_handler(
+    init_handler const& init,
+    std::function<invocation_response(invocation_request const&)> const& handler);
+
+void run_handler(
+    init_handler const& init,
+    std::function<invocation_response(invocation_request const&)> const& handler,
+    runtime_options const& options);
+
+/**
+ * Same as run_handler, but the handler receives the request as an rvalue and may take ownership of it, e.g. move the
+ * payload into its own decoder. The payload is never copied between the socket and the handler.
+ * This is a separate entry point because a handler taking 'invocation_request const&' would be ambiguous between the
+ * two overloads.
+ */
+void run_consuming_handler(std::function<invocation_response(invocation_request&&)> const& handler);
+
+void run_consuming_handler(
+    std::function<invocation_response(invocation_request&&)> const& handler,
+    runtime_options const& options);
+
+void run_consuming_handler(
+    init_handler const& init,
+    std::function<invocation_response(invocation_request&&)> const& handler);
+
+void run_consuming_handler(
+    init_handler const& init,
+    std::function<invocation_response(invocation_request&&)> const& handler,
+    runtime_options const& options);
+
 } // namespace lambda_runtime
 } // namespace aws
@@ -0,0 +1,157 @@
+#pragma once
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "aws/lambda-runtime/runtime.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace aws {
+namespace lambda_runtime {
+
+/**
+ * What the last load() and save() of a state_snapshot did.
+ */
+struct snapshot_stats {
+    /**
+     * Whether a valid snapshot file was found and mapped.
+     */
+    bool loaded = false;
+
+    /**
+     * Size of the snapshot file that was mapped, or written by the last save().
+     */
+    size_t bytes = 0;
+
+    /**
+     * Components handed their state from the snapshot.
+     */
+    size_t restored = 0;
+
+    /**
+     * Mapping and validating the file and restoring the components from it.
+     */
+    std::chrono::microseconds load_duration{0};
+
+    /**
+     * Serializing the components and writing the file.
+     */
+    std::chrono::microseconds save_duration{0};
+};
+
+/**
+ * Keeps expensive warm state (parameters, precomputed tables, decoded data) in a file, so a runtime that starts again
+ * restores it instead of computing it anew. The sandbox's /tmp outlives a runtime restarted after a crash or a
+ * timeout; a directory shared between sandboxes, e.g. an EFS mount, outlives the sandbox too.
+ *
+ * Every component registers a name, a version, and functions to save and to restore its state. The file is memory
+ * mapped and validated as a whole; a component is only restored from a section with its name and version whose
+ * checksum matches, otherwise it is left for the init callback to compute. Bump the version whenever the format of a
+ * component's state changes. Snapshots are tied to the function and its version, so a new deployment never reads the
+ * state of an old one.
+ *
+ * Pass a snapshot to the runtime through runtime_options::snapshot: it is loaded before the init callback runs and
+ * saved once it has returned successfully, unless every component was restored. A component registered after the
+ * snapshot was loaded, e.g. from the init callback, is restored as it is registered. A snapshot is not thread-safe.
+ */
+class state_snapshot {
+public:
+    /**
+     * Append the component's state to 'out'. Return false to leave the component out of the snapshot.
+     */
+    using save_function = std::function<bool(std::string& out)>;
+
+    /**
+     * Restore the component from its state, which is 8-byte aligned and stays mapped for as long as the snapshot
+     * lives. Return false if it can't be used; the component then counts as not restored.
+     */
+    using restore_function = std::function<bool(byte_view state)>;
+
+    /**
+     * The snapshot of this function in 'directory'. The default directory is $AWS_LAMBDA_SNAPSHOT_DIR, or /tmp.
+     */
+    explicit state_snapshot(std::string directory = default_directory());
+    ~state_snapshot();
+
+    state_snapshot(state_snapshot const&) = delete;
+    state_snapshot& operator=(state_snapshot const&) = delete;
+
+    /**
+     * Register a component; registering a name again replaces it.
+     */
+    void add(std::string name, uint32_t version, save_function save, restore_function restore);
+
+    /**
+     * Map and validate the snapshot file and restore the registered components from it. Returns whether a valid
+     * snapshot was found. A missing or invalid file is not an error, the components are then computed as usual.
+     */
+    bool load();
+
+    /**
+     * Write the state of every registered component to the snapshot file, replacing it atomically. Returns false if
+     * the file can't be written.
+     */
+    bool save();
+
+    /**
+     * Whether the component 'name' was restored from the snapshot.
+     */
+    bool restored(std::string const& name) const;
+
+    /**
+     * Whether every registered component was restored, i.e. saving again would write nothing new.
+     */
+    bool complete() const;
+
+    std::string const& path() const { return m_path; }
+
+    snapshot_stats const& stats() const { return m_stats; }
+
+    static std::string default_directory();
+
+private:
+    struct component {
+        std::string name;
+        uint32_t version;
+        save_function save;
+        restore_function restore;
+        bool restored;
+    };
+
+    // a validated section of the mapped file
+    struct section {
+        std::string name;
+        uint32_t version;
+        uint8_t const* data;
+        size_t size;
+    };
+
+    bool restore(component& c);
+    void unmap();
+
+    std::string m_path;
+    std::vector<component> m_components;
+    std::vector<section> m_sections;
+    void* m_mapping;
+    size_t m_mapping_size;
+    snapshot_stats m_stats;
+};
+
+} // namespace lambda_runtime
+} // namespace aws
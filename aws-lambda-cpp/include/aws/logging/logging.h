@@ -14,7 +14,10 @@
  * permissions and limitations under the License.
  */
 
+#include <atomic>
+#include <chrono>
 #include <cstdarg>
+#include <cstddef>
 
 namespace aws {
 namespace logging {
@@ -25,10 +28,68 @@ enum class verbosity {
     debug,
 };
 
+/**
+ * The most verbose level logged at runtime, below the compile-time ceiling set by AWS_LAMBDA_LOG. It is read from
+ * AWS_LAMBDA_LOG_LEVEL (TRACE, DEBUG, INFO, WARN, ERROR or FATAL, as in the function's logging configuration) at
+ * startup and defaults to everything the ceiling allows.
+ */
+extern std::atomic<int> runtime_level;
+
+inline bool is_enabled(verbosity v)
+{
+    return static_cast<int>(v) <= runtime_level.load(std::memory_order_relaxed);
+}
+
+void set_level(verbosity v);
+
+enum class record_format {
+    text,
+    json,
+};
+
+/**
+ * Text records by default, JSON records if AWS_LAMBDA_LOG_FORMAT is JSON. A JSON record carries the level, tag and
+ * message plus the request id, the phase and the time spent in that phase, see set_context.
+ */
+void set_format(record_format f);
+
+/**
+ * Attach an invocation and the phase of it that the current thread is in to the JSON records the thread logs from
+ * now on. The elapsed time of a record is measured from this call. Either can be nullptr.
+ */
+void set_context(char const* request_id, char const* phase);
+
+/**
+ * Log records are queued and written to stdout by a background thread, whole however long they are; see flush.
+ */
 void log(verbosity v, char const* tag, char const* msg, va_list args);
 
+/**
+ * Queue a line that is already formatted, e.g. a structured record, to be written as is, however long. A newline is
+ * appended.
+ */
+void write(char const* line, size_t length);
+
+/**
+ * Wait until everything logged before the call has been written to stdout, or until 'timeout' has passed.
+ * Returns false on timeout. The runtime flushes at the end of every invocation, so no record is lost when the
+ * sandbox is frozen.
+ */
+bool flush(std::chrono::milliseconds timeout);
+
+/**
+ * Write the records still queued straight to stdout with write(2), for a crash handler: the process is about to die,
+ * so neither the background thread nor the atexit flush will write them. It neither locks nor allocates. A record
+ * that is being logged concurrently is skipped, and one the background thread is writing at the same time may show up
+ * twice. Does nothing if nothing was logged yet. The runtime's crash handler calls it before it logs the stack-trace.
+ */
+void flush_on_crash();
+
 [[gnu::format(printf, 2, 3)]] static inline void log_error(char const* tag, char const* msg, ...)
 {
+    if (!is_enabled(verbosity::error)) {
+        return;
+    }
     va_list args;
     va_start(args, msg);
     log(verbosity::error, tag, msg, args);
@@ -40,6 +101,9 @@ void log(verbosity v, char const* tag, char const* msg, va_list args);
 [[gnu::format(printf, 2, 3)]] static inline void log_info(char const* tag, char const* msg, ...)
 {
 #if AWS_LAMBDA_LOG >= 1
+    if (!is_enabled(verbosity::info)) {
+        return;
+    }
     va_list args;
     va_start(args, msg);
     log(verbosity::info, tag, msg, args);
@@ -53,6 +117,9 @@ void log(verbosity v, char const* tag, char const* msg, va_list args);
 [[gnu::format(printf, 2, 3)]] static inline void log_debug(char const* tag, char const* msg, ...)
 {
 #if AWS_LAMBDA_LOG >= 2
+    if (!is_enabled(verbosity::debug)) {
+        return;
+    }
     va_list args;
     va_start(args, msg);
     log(verbosity::debug, tag, msg, args);
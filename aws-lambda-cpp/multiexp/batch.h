@@ -0,0 +1,175 @@
+#pragma once
+// batch.h
+//
+// Batch envelope: one invocation carrying several independent multiexp jobs, so a warm container can absorb many
+// small chunks per round trip instead of paying get_next/post/JSON for each of them.
+//
+//   request:  {"jobs": [<job>, <job>, ...]}
+//             where <job> has the same shape as the body of a single multiexp request (see codec.h)
+//   response: {"results": [<result>, <result>, ...]}
+//             one entry per job, in request order, either {"result": "<encoded answer>"},
+//             {"partial": <progress>} if the job ran out of time, or {"errorMessage": "...", "errorType": "..."} if
+//             that particular job failed. The answers are compressed affine points and the progress is resumable,
+//             see result_codec.h.
+//
+// A failing job never fails the whole envelope; the invocation itself only fails if the envelope is malformed.
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+#include <aws/core/utils/json/JsonSerializer.h>
+
+static char const MULTIEXP_JOBS_KEY[] = "jobs";
+static char const MULTIEXP_RESULTS_KEY[] = "results";
+static char const MULTIEXP_RESULT_KEY[] = "result";
+static char const MULTIEXP_PARTIAL_KEY[] = "partial";
+static char const MULTIEXP_ERROR_MESSAGE_KEY[] = "errorMessage";
+static char const MULTIEXP_ERROR_TYPE_KEY[] = "errorType";
+
+struct job_outcome {
+    bool success = false;
+
+    /**
+     * Set if the job was interrupted by its deadline before it completed. It then counts as successful and 'payload'
+     * holds its progress in compact JSON.
+     */
+    bool interrupted = false;
+
+    /**
+     * The encoded answer of a successful job, the error message otherwise.
+     */
+    std::string payload;
+
+    /**
+     * Empty for successful jobs.
+     */
+    std::string error_type;
+
+    static job_outcome ok(std::string payload)
+    {
+        job_outcome o;
+        o.success = true;
+        o.payload = std::move(payload);
+        return o;
+    }
+
+    static job_outcome partial(std::string progress)
+    {
+        job_outcome o = ok(std::move(progress));
+        o.interrupted = true;
+        return o;
+    }
+
+    static job_outcome failed(std::string message, std::string type)
+    {
+        job_outcome o;
+        o.payload = std::move(message);
+        o.error_type = std::move(type);
+        return o;
+    }
+};
+
+inline size_t defaultBatchParallelism()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Run 'fn' (job_outcome(Aws::Utils::Json::JsonView const& job, size_t index)) over every job on up to 'max_threads'
+// threads, the calling thread included. Outcomes are returned in job order. An exception escaping 'fn' is reported as
+// that job's failure.
+//
+template<typename JobFn>
+std::vector<job_outcome> runBatch(
+    Aws::Utils::Array<Aws::Utils::Json::JsonView> const& jobs,
+    JobFn const& fn,
+    size_t max_threads = defaultBatchParallelism())
+{
+    std::vector<job_outcome> outcomes(jobs.GetLength());
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next++; i < outcomes.size(); i = next++) {
+            try {
+                outcomes[i] = fn(jobs[i], i);
+            }
+            catch (std::exception const& e) {
+                outcomes[i] = job_outcome::failed(e.what(), "JobFailed");
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    size_t const thread_count = std::min(std::max<size_t>(max_threads, 1), outcomes.size());
+    for (size_t i = 1; i < thread_count; i++) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : threads) {
+        t.join();
+    }
+    return outcomes;
+}
+
+// Build the envelope of a batch invocation out of single job bodies (e.g. from encodeMultiExpRequest).
+//
+inline Aws::Utils::Json::JsonValue encodeMultiExpBatch(std::vector<Aws::Utils::Json::JsonValue> const& jobs)
+{
+    Aws::Utils::Array<Aws::Utils::Json::JsonValue> array(jobs.size());
+    for (size_t i = 0; i < jobs.size(); i++) {
+        array[i] = jobs[i];
+    }
+    Aws::Utils::Json::JsonValue json;
+    json.WithArray(MULTIEXP_JOBS_KEY, std::move(array));
+    return json;
+}
+
+inline Aws::Utils::Json::JsonValue encodeMultiExpBatchResponse(std::vector<job_outcome> const& outcomes)
+{
+    Aws::Utils::Array<Aws::Utils::Json::JsonValue> array(outcomes.size());
+    for (size_t i = 0; i < outcomes.size(); i++) {
+        if (outcomes[i].interrupted) {
+            array[i].WithObject(MULTIEXP_PARTIAL_KEY, Aws::Utils::Json::JsonValue(outcomes[i].payload.c_str()));
+        }
+        else if (outcomes[i].success) {
+            array[i].WithString(MULTIEXP_RESULT_KEY, outcomes[i].payload.c_str());
+        }
+        else {
+            array[i].WithString(MULTIEXP_ERROR_MESSAGE_KEY, outcomes[i].payload.c_str());
+            array[i].WithString(MULTIEXP_ERROR_TYPE_KEY, outcomes[i].error_type.c_str());
+        }
+    }
+    Aws::Utils::Json::JsonValue json;
+    json.WithArray(MULTIEXP_RESULTS_KEY, std::move(array));
+    return json;
+}
+
+// Parse the response of a batch invocation back into per-job outcomes. Returns false if the envelope is malformed.
+//
+inline bool decodeMultiExpBatchResponse(Aws::Utils::Json::JsonView const& v, std::vector<job_outcome>& outcomes)
+{
+    if (!v.ValueExists(MULTIEXP_RESULTS_KEY) || !v.GetObject(MULTIEXP_RESULTS_KEY).IsListType()) {
+        return false;
+    }
+
+    auto const results = v.GetArray(MULTIEXP_RESULTS_KEY);
+    outcomes.clear();
+    outcomes.reserve(results.GetLength());
+    for (size_t i = 0; i < results.GetLength(); i++) {
+        auto const& r = results[i];
+        if (r.ValueExists(MULTIEXP_PARTIAL_KEY)) {
+            outcomes.push_back(job_outcome::partial(r.GetObject(MULTIEXP_PARTIAL_KEY).WriteCompact().c_str()));
+        }
+        else if (r.ValueExists(MULTIEXP_RESULT_KEY)) {
+            outcomes.push_back(job_outcome::ok(r.GetString(MULTIEXP_RESULT_KEY).c_str()));
+        }
+        else if (r.ValueExists(MULTIEXP_ERROR_MESSAGE_KEY)) {
+            outcomes.push_back(job_outcome::failed(
+                r.GetString(MULTIEXP_ERROR_MESSAGE_KEY).c_str(), r.GetString(MULTIEXP_ERROR_TYPE_KEY).c_str()));
+        }
+        else {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,145 @@
+// blob_store.cpp
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <aws/core/Aws.h>
+#include <aws/core/platform/Environment.h>
+#include <aws/core/client/ClientConfiguration.h>
+#include <aws/s3/S3Client.h>
+#include <aws/s3/model/GetObjectRequest.h>
+#include "blob_store.h"
+
+static bool is_hex_name(std::string const& name)
+{
+    return !name.empty() && std::all_of(name.begin(), name.end(), [](char c) { return std::isxdigit(c) != 0; });
+}
+
+bool decodeBlobRef(Aws::Utils::Json::JsonView const& v, uint64_t max_length, blob_ref& ref, std::string& error)
+{
+    if (!v.ValueExists("blob") || !v.GetObject("blob").IsString() || !v.ValueExists("offset") ||
+        !v.GetObject("offset").IsIntegerType() || !v.ValueExists("length") ||
+        !v.GetObject("length").IsIntegerType()) {
+        error = "Reference must have a blob name, an offset and a length";
+        return false;
+    }
+
+    ref.blob = v.GetString("blob").c_str();
+    long long const offset = v.GetInt64("offset");
+    long long const length = v.GetInt64("length");
+    // the name ends up in paths and object keys, only accept what a hash can look like
+    if (!is_hex_name(ref.blob)) {
+        error = "Blob name must be a hex digest";
+        return false;
+    }
+    if (offset < 0 || length <= 0) {
+        error = "Reference range must be non-empty";
+        return false;
+    }
+    if (static_cast<uint64_t>(length) > max_length) {
+        error = "Reference range is longer than " + std::to_string(max_length) + " bytes";
+        return false;
+    }
+    ref.offset = static_cast<uint64_t>(offset);
+    ref.length = static_cast<uint64_t>(length);
+    return true;
+}
+
+bool blob_store::within_max_length(blob_ref const& ref, std::string& error) const
+{
+    if (ref.length > m_max_length) {
+        error = "Range of " + ref.segment_name() + " is longer than " + std::to_string(m_max_length) + " bytes";
+        return false;
+    }
+    return true;
+}
+
+bool local_blob_store::read(blob_ref const& ref, std::string& out, std::string& error)
+{
+    if (!within_max_length(ref, error)) {
+        return false;
+    }
+    std::ifstream in(m_directory + "/" + ref.blob, std::ios_base::in | std::ios_base::binary);
+    if (!in) {
+        error = "Blob " + ref.blob + " not found";
+        return false;
+    }
+
+    // don't allocate for a range the blob can't hold
+    in.seekg(0, std::ios_base::end);
+    auto const size = static_cast<uint64_t>(in.tellg());
+    if (ref.offset > size || ref.length > size - ref.offset) {
+        error = "Range of " + ref.segment_name() + " is out of bounds";
+        return false;
+    }
+
+    out.resize(ref.length);
+    in.seekg(static_cast<std::streamoff>(ref.offset));
+    in.read(&out[0], static_cast<std::streamsize>(ref.length));
+    if (static_cast<uint64_t>(in.gcount()) != ref.length) {
+        error = "Range of " + ref.segment_name() + " is out of bounds";
+        return false;
+    }
+    return true;
+}
+
+s3_blob_store::s3_blob_store(
+    std::shared_ptr<Aws::S3::S3Client> client,
+    std::string bucket,
+    std::string prefix,
+    uint64_t max_length)
+    : blob_store(max_length), m_client(std::move(client)), m_bucket(std::move(bucket)), m_prefix(std::move(prefix))
+{
+}
+
+bool s3_blob_store::read(blob_ref const& ref, std::string& out, std::string& error)
+{
+    if (!within_max_length(ref, error)) {
+        return false;
+    }
+    Aws::S3::Model::GetObjectRequest request;
+    request.SetBucket(m_bucket.c_str());
+    request.SetKey((m_prefix + ref.blob).c_str());
+    std::string const range =
+        "bytes=" + std::to_string(ref.offset) + "-" + std::to_string(ref.offset + ref.length - 1);
+    request.SetRange(range.c_str());
+
+    auto outcome = m_client->GetObject(request);
+    if (!outcome.IsSuccess()) {
+        error = outcome.GetError().GetMessage().c_str();
+        return false;
+    }
+
+    // read no more than was asked for, whatever the response carries
+    auto& body = outcome.GetResult().GetBody();
+    out.resize(ref.length);
+    body.read(&out[0], static_cast<std::streamsize>(ref.length));
+    if (static_cast<uint64_t>(body.gcount()) != ref.length) {
+        error = "Range of " + ref.segment_name() + " is out of bounds";
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<blob_store> make_blob_store(std::string const& location, uint64_t max_length)
+{
+    static std::string const file_scheme = "file://";
+    static std::string const s3_scheme = "s3://";
+
+    if (location.compare(0, file_scheme.size(), file_scheme) == 0) {
+        return std::unique_ptr<blob_store>(new local_blob_store(location.substr(file_scheme.size()), max_length));
+    }
+
+    if (location.compare(0, s3_scheme.size(), s3_scheme) == 0) {
+        std::string const path = location.substr(s3_scheme.size());
+        auto const slash = path.find('/');
+        std::string const bucket = path.substr(0, slash);
+        std::string const prefix = slash == std::string::npos ? "" : path.substr(slash + 1);
+
+        Aws::Client::ClientConfiguration config;
+        config.region = Aws::Environment::GetEnv("AWS_REGION");
+        config.caFile = "/etc/pki/tls/certs/ca-bundle.crt";
+        auto client = Aws::MakeShared<Aws::S3::S3Client>("multiexp", config);
+        return std::unique_ptr<blob_store>(new s3_blob_store(client, bucket, prefix, max_length));
+    }
+    return nullptr;
+}
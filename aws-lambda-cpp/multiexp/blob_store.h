@@ -0,0 +1,123 @@
+#pragma once
+// blob_store.h
+//
+// Content-addressed blob storage used to pass bases by reference instead of inlining them in every request.
+//
+// A blob is named by the hex SHA-256 of its contents and holds one or more segments, each one a vector encoded with
+// serializeVec (see codec.h). A request references a segment by blob name and byte range:
+//
+//   "basesref": {"blob": "<hex sha256>", "offset": <byte offset>, "length": <byte length>}
+//
+// so the worker only transfers the bytes it needs. Blob names are trusted as content addresses; the bytes of a range
+// are not re-hashed on every read. The length comes from the request and is bounded (see decodeBlobRef) before anything
+// is allocated or fetched for it.
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <aws/core/utils/json/JsonSerializer.h>
+
+namespace Aws {
+namespace S3 {
+class S3Client;
+} // namespace S3
+} // namespace Aws
+
+static char const MULTIEXP_BASES_REF_KEY[] = "basesref";
+
+// Longest range a reference may ask for unless configured otherwise, well above what a cache full of encoded bases
+// takes up.
+static uint64_t const MULTIEXP_DEFAULT_MAX_SEGMENT_LENGTH = uint64_t(512) << 20;
+
+struct blob_ref {
+    std::string blob;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+
+    /**
+     * Unique name of the referenced segment, usable as a cache key or file name.
+     */
+    std::string segment_name() const
+    {
+        return blob + "-" + std::to_string(offset) + "-" + std::to_string(length);
+    }
+};
+
+class blob_store {
+public:
+    virtual ~blob_store() = default;
+
+    /**
+     * Read 'ref.length' bytes at 'ref.offset' of blob 'ref.blob' into 'out'.
+     * Returns false and sets 'error' if the range could not be read in full or is longer than max_length().
+     */
+    virtual bool read(blob_ref const& ref, std::string& out, std::string& error) = 0;
+
+    uint64_t max_length() const { return m_max_length; }
+
+protected:
+    explicit blob_store(uint64_t max_length) : m_max_length(max_length) {}
+
+    /**
+     * Checked by read() before it allocates or fetches anything.
+     */
+    bool within_max_length(blob_ref const& ref, std::string& error) const;
+
+private:
+    uint64_t m_max_length;
+};
+
+/**
+ * Blobs stored as files named after their hash in a local directory. Stand-in for S3 in tests and local runs.
+ */
+class local_blob_store : public blob_store {
+public:
+    explicit local_blob_store(std::string directory, uint64_t max_length = MULTIEXP_DEFAULT_MAX_SEGMENT_LENGTH)
+        : blob_store(max_length), m_directory(std::move(directory))
+    {
+    }
+    bool read(blob_ref const& ref, std::string& out, std::string& error) override;
+
+private:
+    std::string m_directory;
+};
+
+/**
+ * Blobs stored as objects named '<prefix><hash>' in an S3 bucket, read with ranged GETs.
+ */
+class s3_blob_store : public blob_store {
+public:
+    s3_blob_store(
+        std::shared_ptr<Aws::S3::S3Client> client,
+        std::string bucket,
+        std::string prefix,
+        uint64_t max_length = MULTIEXP_DEFAULT_MAX_SEGMENT_LENGTH);
+    bool read(blob_ref const& ref, std::string& out, std::string& error) override;
+
+private:
+    std::shared_ptr<Aws::S3::S3Client> m_client;
+    std::string m_bucket;
+    std::string m_prefix;
+};
+
+/**
+ * Create a store from a location of the form 's3://bucket/prefix' or 'file:///some/directory', reading ranges of up
+ * to 'max_length' bytes. Returns nullptr for an unsupported location.
+ */
+std::unique_ptr<blob_store> make_blob_store(
+    std::string const& location,
+    uint64_t max_length = MULTIEXP_DEFAULT_MAX_SEGMENT_LENGTH);
+
+inline Aws::Utils::Json::JsonValue encodeBlobRef(blob_ref const& ref)
+{
+    Aws::Utils::Json::JsonValue json;
+    json.WithString("blob", ref.blob.c_str());
+    json.WithInt64("offset", static_cast<long long>(ref.offset));
+    json.WithInt64("length", static_cast<long long>(ref.length));
+    return json;
+}
+
+/**
+ * Parse a reference written by encodeBlobRef. A range longer than 'max_length' bytes is rejected, so a request can't
+ * make the worker allocate or fetch more than it was configured for.
+ */
+bool decodeBlobRef(Aws::Utils::Json::JsonView const& v, uint64_t max_length, blob_ref& ref, std::string& error);
@@ -0,0 +1,185 @@
+#pragma once
+// codec.h
+//
+// Wire format shared by the multiexp worker (main.cpp) and the client that fans work out to it
+// (test_lambda_cpp/test_lambda.cpp). Both sides must include this header instead of rolling their own helpers,
+// otherwise the two drift apart and the worker ends up computing over whatever its decoder made of the input.
+//
+// A vector is encoded as its element count followed by the elements, each one written with libff's stream
+// operators and prefixed with its length in bytes. libff's readers don't skip separators (bn128_G1 reads its zero flag
+// and, under BINARY_OUTPUT, Fp_model its raw limbs with istream::read), so each element is read back from exactly the
+// bytes it was written as. Bases and scalars use the same encoding; the count prefix lets the decoder reject truncated
+// or foreign input instead of silently returning a shorter vector.
+//
+// The encoded vectors are base64'd into the JSON body. Depending on how libff was configured (BINARY_OUTPUT) the
+// elements are raw bytes which may contain NULs, so URL-encoding through a char* is not an option. Both targets must
+// be compiled with the same libff configuration macros (BINARY_OUTPUT, MONTGOMERY_OUTPUT, ...) since those select the
+// element format.
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <aws/core/utils/HashingUtils.h>
+#include <aws/core/utils/json/JsonSerializer.h>
+
+static char const MULTIEXP_BASES_KEY[] = "groupelements";
+static char const MULTIEXP_SCALARS_KEY[] = "scalars";
+
+// The operation a request asks for, routed on by the worker (see invocation_router). Requests without one are taken
+// as a batch if they carry "jobs" and as a single G1 multiexp otherwise.
+static char const MULTIEXP_OP_KEY[] = "op";
+static char const MULTIEXP_OP_MSM_G1[] = "msm_g1";
+static char const MULTIEXP_OP_MSM_G2[] = "msm_g2";
+static char const MULTIEXP_OP_BATCH[] = "batch";
+static char const MULTIEXP_OP_PING[] = "ping";
+static char const MULTIEXP_OP_WARMUP[] = "warmup";
+
+// Serialize a single element into a string
+//
+template<typename T>
+std::string serialize(T const& elem)
+{
+    std::ostringstream oss;
+    oss << elem;
+    return oss.str();
+}
+
+// Deserialize a string into a single element. Returns false if the string does not hold one.
+//
+template<typename T>
+bool deserialize(std::string const& s_elem, T& out)
+{
+    std::istringstream is(s_elem);
+    is >> out;
+    return !is.fail();
+}
+
+// Serialize a vector into a string: "<count>\n" followed by "<length>\n<bytes>" for each element
+//
+template<typename T>
+std::string serializeVec(std::vector<T> const& vec)
+{
+    std::ostringstream oss;
+    oss << vec.size() << '\n';
+    std::ostringstream elem_os;
+    for (auto const& elem : vec) {
+        elem_os.str(std::string());
+        elem_os << elem;
+        std::string const s_elem = elem_os.str();
+        oss << s_elem.size() << '\n';
+        oss.write(s_elem.data(), static_cast<std::streamsize>(s_elem.size()));
+    }
+    return oss.str();
+}
+
+// Deserialize a string produced by serializeVec. Returns false on a malformed count or length, or if fewer elements
+// than announced could be read.
+//
+template<typename T>
+bool deserializeToVec(std::string const& s_vec, std::vector<T>& out)
+{
+    std::istringstream is(s_vec);
+    size_t count = 0;
+    if (!(is >> count) || is.get() != '\n') {
+        return false;
+    }
+
+    out.clear();
+    // every element takes at least one byte, don't let a bogus count reserve more than that
+    out.reserve(std::min(count, s_vec.size()));
+    std::string s_elem;
+    for (size_t i = 0; i < count; i++) {
+        size_t length = 0;
+        if (!(is >> length) || is.get() != '\n' || length > s_vec.size()) {
+            return false;
+        }
+        s_elem.resize(length);
+        if (!is.read(&s_elem[0], static_cast<std::streamsize>(length))) {
+            return false;
+        }
+        T elem;
+        if (!deserialize(s_elem, elem)) {
+            return false;
+        }
+        out.push_back(elem);
+    }
+    return true;
+}
+
+inline Aws::String toBase64(std::string const& raw)
+{
+    Aws::Utils::ByteBuffer buf(reinterpret_cast<unsigned char const*>(raw.data()), raw.size());
+    return Aws::Utils::HashingUtils::Base64Encode(buf);
+}
+
+inline std::string fromBase64(Aws::String const& encoded)
+{
+    Aws::Utils::ByteBuffer buf = Aws::Utils::HashingUtils::Base64Decode(encoded);
+    return std::string(reinterpret_cast<char const*>(buf.GetUnderlyingData()), buf.GetLength());
+}
+
+// Build the JSON body of a single multiexp invocation. A given 'op' is written first: the worker's router stops
+// scanning at the member it looks for, and would otherwise skip over the whole of the bases and scalars.
+//
+template<typename GroupT, typename FieldT>
+Aws::Utils::Json::JsonValue encodeMultiExpRequest(
+    std::vector<GroupT> const& bases,
+    std::vector<FieldT> const& scalars,
+    char const* op = nullptr)
+{
+    Aws::Utils::Json::JsonValue json;
+    if (op) {
+        json.WithString(MULTIEXP_OP_KEY, op);
+    }
+    json.WithString(MULTIEXP_BASES_KEY, toBase64(serializeVec<GroupT>(bases)));
+    json.WithString(MULTIEXP_SCALARS_KEY, toBase64(serializeVec<FieldT>(scalars)));
+    return json;
+}
+
+// Parse the scalars of a multiexp request. Used on its own when the bases are passed by reference (see blob_store.h).
+//
+template<typename FieldT>
+bool decodeMultiExpScalars(Aws::Utils::Json::JsonView const& v, std::vector<FieldT>& scalars, std::string& error)
+{
+    if (!v.ValueExists(MULTIEXP_SCALARS_KEY) || !v.GetObject(MULTIEXP_SCALARS_KEY).IsString()) {
+        error = "Missing input value scalars";
+        return false;
+    }
+
+    if (!deserializeToVec<FieldT>(fromBase64(v.GetString(MULTIEXP_SCALARS_KEY)), scalars)) {
+        error = "Failed to decode scalars";
+        return false;
+    }
+    return true;
+}
+
+// Parse the JSON body built by encodeMultiExpRequest. On failure 'error' is set to a message suitable for an
+// invocation_response::failure and false is returned.
+//
+template<typename GroupT, typename FieldT>
+bool decodeMultiExpRequest(
+    Aws::Utils::Json::JsonView const& v,
+    std::vector<GroupT>& bases,
+    std::vector<FieldT>& scalars,
+    std::string& error)
+{
+    if (!v.ValueExists(MULTIEXP_BASES_KEY) || !v.GetObject(MULTIEXP_BASES_KEY).IsString()) {
+        error = "Missing input value groupelements";
+        return false;
+    }
+
+    if (!deserializeToVec<GroupT>(fromBase64(v.GetString(MULTIEXP_BASES_KEY)), bases)) {
+        error = "Failed to decode groupelements";
+        return false;
+    }
+
+    if (!decodeMultiExpScalars(v, scalars, error)) {
+        return false;
+    }
+
+    if (bases.size() != scalars.size()) {
+        error = "Mismatched number of groupelements and scalars";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,232 @@
+#pragma once
+// kernel.h
+//
+// The BDLO12 (Pippenger) multiexp kernel. The scalars are cut into windows of c bits; every window sorts the bases
+// into 2^c buckets by their digit, folds the buckets into a running sum and adds that to the result, which has been
+// doubled c times for the previous window.
+//
+// The kernel can be interrupted between bases. Everything it has computed so far then sits in a multiexp_progress:
+// the windows already folded into the result and the buckets of the window in progress. Passing that progress back,
+// together with the same bases and scalars, resumes the computation where it stopped, in this process or in another
+// one (see encodeMultiExpProgress in result_codec.h).
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+#include <libff/algebra/fields/bigint.hpp>
+#include <libff/algebra/scalar_multiplication/multiexp.hpp>
+#include <libff/common/utils.hpp>
+
+namespace libff {
+
+template<typename T>
+struct multiexp_progress {
+    /**
+     * The window size c, zero until the kernel first ran.
+     */
+    size_t window_bits = 0;
+
+    /**
+     * Number of windows, i.e. the bit length of the largest scalar divided by c, rounded up.
+     */
+    size_t windows = 0;
+
+    /**
+     * Windows not yet folded into 'result'. The window in progress is windows_left - 1.
+     */
+    size_t windows_left = 0;
+
+    /**
+     * Bases of the window in progress already sorted into 'buckets'.
+     */
+    size_t next_base = 0;
+
+    /**
+     * Sum over the completed windows, already doubled for the window in progress if next_base > 0.
+     */
+    T result = T::zero();
+
+    /**
+     * The 2^c buckets of the window in progress, empty if next_base is 0. An empty bucket is zero.
+     */
+    std::vector<T> buckets;
+
+    bool started() const { return window_bits != 0; }
+    bool done() const { return started() && windows_left == 0; }
+};
+
+enum class multiexp_status {
+    done,
+    interrupted,
+    /**
+     * The progress doesn't belong to these bases and scalars.
+     */
+    mismatched,
+};
+
+// Compute (or continue computing) the multiexp of bases and exponents into 'progress'. 'should_stop' (bool()) is
+// polled before every window and every few hundred bases; once it returns true the kernel returns
+// multiexp_status::interrupted and 'progress' holds what it has computed.
+//
+template<typename T, typename FieldT, typename StopFn>
+multiexp_status multi_exp_resumable(
+    typename std::vector<T>::const_iterator bases,
+    typename std::vector<T>::const_iterator bases_end,
+    typename std::vector<FieldT>::const_iterator exponents,
+    typename std::vector<FieldT>::const_iterator exponents_end,
+    multiexp_progress<T>& progress,
+    StopFn const& should_stop)
+{
+    UNUSED(exponents_end);
+    size_t const length = bases_end - bases;
+    size_t const poll_interval = 256;
+
+    // empirically, this seems to be a decent estimate of the optimal value of c
+    size_t log2_length = log2(length);
+    size_t c = log2_length - (log2_length / 3 - 2);
+
+    const mp_size_t exp_num_limbs = std::remove_reference<decltype(*exponents)>::type::num_limbs;
+    std::vector<bigint<exp_num_limbs> > bn_exponents(length);
+    size_t num_bits = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        bn_exponents[i] = exponents[i].as_bigint();
+        num_bits = std::max(num_bits, bn_exponents[i].num_bits());
+    }
+
+    size_t num_groups = (num_bits + c - 1) / c;
+
+    if (!progress.started()) {
+        progress.window_bits = c;
+        progress.windows = num_groups;
+        progress.windows_left = num_groups;
+        progress.next_base = 0;
+        progress.result = T::zero();
+        progress.buckets.clear();
+    }
+    else if (progress.window_bits != c || progress.windows != num_groups || progress.windows_left > num_groups ||
+             progress.next_base > length || (progress.next_base > 0 && progress.buckets.size() != (1u << c))) {
+        return multiexp_status::mismatched;
+    }
+
+    T result = progress.result;
+    bool result_nonzero = !result.is_zero();
+
+    for (; progress.windows_left > 0; progress.windows_left--) {
+        size_t const k = progress.windows_left - 1;
+        size_t first_base = progress.next_base;
+
+        std::vector<T> buckets;
+        std::vector<bool> bucket_nonzero(1 << c);
+        if (first_base > 0) {
+            // resuming in the middle of this window, the result has already been doubled for it
+            buckets = std::move(progress.buckets);
+            for (size_t id = 0; id < buckets.size(); id++) {
+                bucket_nonzero[id] = !buckets[id].is_zero();
+            }
+        }
+        else {
+            if (should_stop()) {
+                progress.result = result;
+                return multiexp_status::interrupted;
+            }
+            buckets.resize(1 << c);
+            if (result_nonzero) {
+                for (size_t i = 0; i < c; i++) {
+                    result = result.dbl();
+                }
+            }
+        }
+        progress.buckets.clear();
+        progress.next_base = 0;
+
+        for (size_t i = first_base; i < length; i++) {
+            if (i != first_base && i % poll_interval == 0 && should_stop()) {
+                for (size_t id = 0; id < buckets.size(); id++) {
+                    if (!bucket_nonzero[id]) {
+                        buckets[id] = T::zero();
+                    }
+                }
+                progress.buckets = std::move(buckets);
+                progress.next_base = i;
+                progress.result = result;
+                return multiexp_status::interrupted;
+            }
+
+            size_t id = 0;
+            for (size_t j = 0; j < c; j++) {
+                if (bn_exponents[i].test_bit(k * c + j)) {
+                    id |= 1 << j;
+                }
+            }
+
+            if (id == 0) {
+                continue;
+            }
+
+            if (bucket_nonzero[id]) {
+#ifdef USE_MIXED_ADDITION
+                buckets[id] = buckets[id].mixed_add(bases[i]);
+#else
+                buckets[id] = buckets[id] + bases[i];
+#endif
+            }
+            else {
+                buckets[id] = bases[i];
+                bucket_nonzero[id] = true;
+            }
+        }
+
+#ifdef USE_MIXED_ADDITION
+        batch_to_special(buckets);
+#endif
+
+        T running_sum;
+        bool running_sum_nonzero = false;
+
+        for (size_t i = (1u << c) - 1; i > 0; i--) {
+            if (bucket_nonzero[i]) {
+                if (running_sum_nonzero) {
+#ifdef USE_MIXED_ADDITION
+                    running_sum = running_sum.mixed_add(buckets[i]);
+#else
+                    running_sum = running_sum + buckets[i];
+#endif
+                }
+                else {
+                    running_sum = buckets[i];
+                    running_sum_nonzero = true;
+                }
+            }
+
+            if (running_sum_nonzero) {
+                if (result_nonzero) {
+                    result = result + running_sum;
+                }
+                else {
+                    result = running_sum;
+                    result_nonzero = true;
+                }
+            }
+        }
+    }
+
+    progress.result = result;
+    return multiexp_status::done;
+}
+
+// Compute the multiexp of bases and exponents in one go.
+//
+template<typename T, typename FieldT, multi_exp_method Method,
+    typename std::enable_if<(Method == multi_exp_method_BDLO12), int>::type = 0>
+T multi_exp_inner1(
+    typename std::vector<T>::const_iterator bases,
+    typename std::vector<T>::const_iterator bases_end,
+    typename std::vector<FieldT>::const_iterator exponents,
+    typename std::vector<FieldT>::const_iterator exponents_end)
+{
+    multiexp_progress<T> progress;
+    multi_exp_resumable<T, FieldT>(bases, bases_end, exponents, exponents_end, progress, [] { return false; });
+    return progress.result;
+}
+
+} // namespace libff
@@ -5,6 +5,8 @@
 #include <sstream>
 #include <iterator>
 #include <iostream>
+#include <cstdlib>
+#include <mutex>
 #include <aws/core/Aws.h>
 #include <aws/core/utils/StringUtils.h>
 #include <aws/core/utils/logging/LogLevel.h>
@@ -27,133 +29,20 @@
 #include <libff/common/utils.hpp>
 #include <libff/common/rng.hpp>
 #include <aws/lambda-runtime/runtime.h>
+#include <aws/lambda-runtime/snapshot.h>
+#include <aws/logging/logging.h>
+#include "codec.h"
+#include "batch.h"
+#include "blob_store.h"
+#include "kernel.h"
+#include "result_codec.h"
+#include "segment_cache.h"
 
 using namespace libff;
 using namespace aws::lambda_runtime;
 using namespace Aws::Utils;
 
 namespace libff {
-template<typename T, typename FieldT, multi_exp_method Method,
-    typename std::enable_if<(Method == multi_exp_method_BDLO12), int>::type = 0>
-T multi_exp_inner1(
-    typename std::vector<T>::const_iterator bases,
-    typename std::vector<T>::const_iterator bases_end,
-    typename std::vector<FieldT>::const_iterator exponents,
-    typename std::vector<FieldT>::const_iterator exponents_end)
-    {
-    	UNUSED(exponents_end);
-    	size_t length = bases_end - bases;
-
-    	// empirically, this seems to be a decent estimate of the optimal value of c
-    	size_t log2_length = log2(length);
-    	size_t c = log2_length - (log2_length / 3 - 2);
-
-    	const mp_size_t exp_num_limbs =
-        	std::remove_reference<decltype(*exponents)>::type::num_limbs;
-    	std::vector<bigint<exp_num_limbs> > bn_exponents(length);
-    	size_t num_bits = 0;
-
-    	for (size_t i = 0; i < length; i++)
-    	{
-        	bn_exponents[i] = exponents[i].as_bigint();
-        	num_bits = std::max(num_bits, bn_exponents[i].num_bits());
-    	}
-
-    	size_t num_groups = (num_bits + c - 1) / c;
-
-    	T result;
-    	bool result_nonzero = false;
-
-    	for (size_t k = num_groups - 1; k <= num_groups; k--)
-    	{
-        	if (result_nonzero)
-        	{
-            		for (size_t i = 0; i < c; i++)
-            		{
-                		result = result.dbl();
-            		}
-        	}
-
-        	std::vector<T> buckets(1 << c);
-        	std::vector<bool> bucket_nonzero(1 << c);
-
-        	for (size_t i = 0; i < length; i++)
-        	{
-            		size_t id = 0;
-            		for (size_t j = 0; j < c; j++)
-           	 	{
-                		if (bn_exponents[i].test_bit(k*c + j))
-                		{
-                    			id |= 1 << j;
-                		}
-            		}
-
-            		if (id == 0)
-            		{
-                		continue;
-            		}
-
-            		if (bucket_nonzero[id])
-            		{
-#ifdef USE_MIXED_ADDITION
-                		buckets[id] = buckets[id].mixed_add(bases[i]);
-#else
-                		buckets[id] = buckets[id] + bases[i];
-#endif
-            		}
-           		else
-            		{
-                		buckets[id] = bases[i];
-                		bucket_nonzero[id] = true;
-            		}
-        	}
-
-#ifdef USE_MIXED_ADDITION
-        	batch_to_special(buckets);
-#endif
-
-        	T running_sum;
-        	bool running_sum_nonzero = false;
-
-        	for (size_t i = (1u << c) - 1; i > 0; i--)
-        	{
-            		if (bucket_nonzero[i])
-            		{
-                		if (running_sum_nonzero)
-                		{
-#ifdef USE_MIXED_ADDITION
-                    			running_sum = running_sum.mixed_add(buckets[i]);
-#else
-                    			running_sum = running_sum + buckets[i];
-#endif
-                		}
-                		else
-                		{
-                    			running_sum = buckets[i];
-                    			running_sum_nonzero = true;
-                		}	
-            		}
-
-            		if (running_sum_nonzero)
-            		{
-                		if (result_nonzero)
-                		{
-                    			result = result + running_sum;
-                		}
-                		else
-                		{
-                    			result = running_sum;
-                    			result_nonzero = true;
-                		}
-            		}
-        	}
-    	}
-
-	return result;
-    	//return invocation_response::success(result, "application/json");
-    }
-
-
 template <typename GroupT>
 using run_result_t = std::pair<long long, std::vector<GroupT> >;
 
@@ -242,95 +131,20 @@ int multi_exp_run()
    return answers.size();
 }
 
-// Deserialize a string into a vector
-//
-template<typename T>
-std::vector<T> deserializeToVec(std::string s_vec) {
-	std::istringstream is(s_vec.c_str());
-        return std::vector<T>{ std::istream_iterator<T>( is ), 
-                        std::istream_iterator<T>() };
-}
-
-// Deserialize a string into a single element
-//
-template<typename T>
-T deserialize(std::string s_elem) {
-	T ret;
-	std::istringstream is(s_elem.c_str());
-    is >> ret;
-	return ret;
-}
-
-// Serialize a vector into a string
-//
-template<typename T> 
-std::string serializeVec(std::vector<T> vec) {
-	std::ostringstream oss;
-	std::string str = "";
-	std::copy(vec.begin(), vec.end()-1,
-                std::ostream_iterator<T>(oss, " "));
-
-        // Now add the last element with no delimiter
-        oss << vec.back();
-	return oss.str();
-}
-
-// Serialize a single element into a string
-//
-template<typename T> 
-std::string serialize(T elem) {
-	std::ostringstream oss;
-	std::string str = "";
-    oss << elem;
-	return oss.str();
-}
-
-template<typename T>
-std::string serializeFieldVec(std::vector<T> vec) {
-    std::ostringstream oss;
-    libff::bit_vector bv = libff::convert_field_element_vector_to_bit_vector<T>(vec);
-	libff::serialize_bit_vector(oss, bv);
-    return oss.str();
-}
-
-template<typename T>
-std::string serializeField(T field) {
-    std::ostringstream oss;
-    libff::bit_vector bv = libff::convert_field_element_to_bit_vector<T>(field);
-	libff::serialize_bit_vector(oss, bv);
-    return oss.str();
-}
-
-template<typename T>
-std::vector<T> deserializeFieldVec(std::string s_vec) {
-    std::istringstream is(s_vec.c_str());
-    bit_vector bv;
-    libff::deserialize_bit_vector(is, bv);
-    return libff::convert_bit_vector_to_field_element_vector<T>(bv);
-}
-
-template<typename T>
-T deserializeField(std::string s_field) {
-    std::istringstream is(s_field.c_str());
-    bit_vector bv;
-    libff::deserialize_bit_vector(is, bv);
-    return libff::convert_bit_vector_to_field_element<T>((const bit_vector)bv);
-}
-
-std::string invoke_multiexp_inner(
-	std::vector<G1<bn128_pp>> groupElement,
-	std::vector<Fr<bn128_pp>> scalar)
+multiexp_status invoke_multiexp_inner(
+	std::vector<G1<bn128_pp>> const& groupElement,
+	std::vector<Fr<bn128_pp>> const& scalar,
+	multiexp_progress<G1<bn128_pp>>& progress,
+	cancellation_token const& token)
 {
-	G1<bn128_pp> answer = 
-	multi_exp_inner1<G1<bn128_pp>,
-					 Fr<bn128_pp>,
-					 multi_exp_method_BDLO12,
-					 1>
+	return
+	multi_exp_resumable<G1<bn128_pp>, Fr<bn128_pp>>
 					 (groupElement.cbegin(),
 					 groupElement.cend(),
 					 scalar.cbegin(),
-					 scalar.cend());
-	return serialize<G1<bn128_pp>>(answer);
+					 scalar.cend(),
+					 progress,
+					 [&token] { return token.is_cancelled(); });
 }
 
 
@@ -370,54 +184,323 @@ invocation_response my_handler(invocation_request const& request)
 }
 */
 
-invocation_response multiexp_inner_handler(invocation_request const& request)
+static char const LOG_TAG[] = "MULTIEXP";
+
+// Bases passed by reference are resolved through these; both stay null unless MULTIEXP_BLOB_STORE is set.
+static std::unique_ptr<blob_store> bases_store;
+static std::unique_ptr<segment_cache<G1<bn128_pp>>> bases_cache;
+
+// Longest range of bases a reference may ask for, MULTIEXP_MAX_SEGMENT_BYTES overrides it.
+static uint64_t max_segment_length = MULTIEXP_DEFAULT_MAX_SEGMENT_LENGTH;
+
+// Decoded bases outlive a restart of the worker through this, see multiexp_init and warmup_handler. Unlike the
+// cache, the snapshot isn't thread-safe, so concurrent warmups save it one at a time.
+static std::unique_ptr<state_snapshot> warm_state;
+static std::mutex warm_state_mutex;
+static uint32_t const BASES_SNAPSHOT_VERSION = 1;
+
+// Time left to encode and post the progress of a job once the deadline approaches. MULTIEXP_DEADLINE_MARGIN_MS
+// overrides it; it has to grow with the number of buckets a window has to ship.
+static std::chrono::milliseconds deadline_margin(500);
+
+// Runs the kernel over one job, continuing from the job's "resume" progress if it has one.
+//
+static job_outcome run_kernel(
+    Aws::Utils::Json::JsonView const& job,
+    std::vector<G1<bn128_pp>> const& bases,
+    std::vector<Fr<bn128_pp>> const& scalars,
+    cancellation_token const& token,
+    G1<bn128_pp>& answer)
 {
-   using namespace Aws::Utils::Json;
-    JsonValue json((const Aws::String&)request.payload);
+    multiexp_progress<G1<bn128_pp>> progress;
+    std::string error;
+    if (job.ValueExists(MULTIEXP_RESUME_KEY) &&
+        !decodeMultiExpProgress(job.GetObject(MULTIEXP_RESUME_KEY), progress, error)) {
+        return job_outcome::failed(error, "InvalidInput");
+    }
+
+    switch (invoke_multiexp_inner(bases, scalars, progress, token)) {
+    case multiexp_status::done:
+        answer = progress.result;
+        return job_outcome::ok("");
+    case multiexp_status::interrupted:
+        return job_outcome::partial(encodeMultiExpProgress(progress).View().WriteCompact().c_str());
+    case multiexp_status::mismatched:
+        break;
+    }
+    return job_outcome::failed("The progress to resume from doesn't belong to this job", "InvalidInput");
+}
+
+// Computes one job into 'answer'. The outcome of a successful job carries no payload, the caller encodes 'answer'.
+// A job interrupted by 'token' carries its progress instead.
+//
+static job_outcome multiexp_job(
+    Aws::Utils::Json::JsonView const& job,
+    cancellation_token const& token,
+    cache_stats& stats,
+    G1<bn128_pp>& answer)
+{
+    std::vector<Fr<bn128_pp>> scalars;
+    std::string error;
+
+    if (job.ValueExists(MULTIEXP_BASES_REF_KEY)) {
+        blob_ref ref;
+        if (!decodeBlobRef(job.GetObject(MULTIEXP_BASES_REF_KEY), max_segment_length, ref, error) ||
+            !decodeMultiExpScalars(job, scalars, error)) {
+            return job_outcome::failed(error, "InvalidInput");
+        }
+        if (!bases_cache) {
+            return job_outcome::failed("No blob store configured for referenced bases", "NoBlobStore");
+        }
+
+        auto bases = bases_cache->resolve(ref, stats, error);
+        if (!bases) {
+            return job_outcome::failed(error, "BlobUnavailable");
+        }
+        if (bases->size() != scalars.size()) {
+            return job_outcome::failed("Mismatched number of referenced bases and scalars", "InvalidInput");
+        }
+        return run_kernel(job, *bases, scalars, token, answer);
+    }
+
+    std::vector<G1<bn128_pp>> groupelements;
+    if (!decodeMultiExpRequest(job, groupelements, scalars, error)) {
+        return job_outcome::failed(error, "InvalidInput");
+    }
+
+    return run_kernel(job, groupelements, scalars, token, answer);
+}
+
+static Aws::Utils::Json::JsonValue report_cache_stats(cache_stats const& stats)
+{
+    aws::logging::log_info(
+        LOG_TAG,
+        "bases cache: memory hits %zu, disk hits %zu, misses %zu",
+        stats.memory_hits.load(),
+        stats.disk_hits.load(),
+        stats.misses.load());
+
+    Aws::Utils::Json::JsonValue json;
+    json.WithInt64("memoryHits", static_cast<long long>(stats.memory_hits.load()));
+    json.WithInt64("diskHits", static_cast<long long>(stats.disk_hits.load()));
+    json.WithInt64("misses", static_cast<long long>(stats.misses.load()));
+    return json;
+}
+
+// Parses the payload of 'request' and hands it to 'run'; the router left it untouched.
+//
+template<typename Run>
+static invocation_response with_json(invocation_request const& request, Run const& run)
+{
+    Aws::Utils::Json::JsonValue json((const Aws::String&)request.payload);
     if (!json.WasParseSuccessful()) {
-        return invocation_response::failure("1Failed to parse input JSON", "InvalidJSON");
+        return invocation_response::failure("Failed to parse input JSON", "InvalidJSON");
     }
+    return run(json.View());
+}
 
-    auto v = json.View();
+static invocation_response run_batch(Aws::Utils::Json::JsonView const& v, cancellation_token const& token)
+{
+    using namespace Aws::Utils::Json;
+    cache_stats stats;
+    if (!v.ValueExists(MULTIEXP_JOBS_KEY) || !v.GetObject(MULTIEXP_JOBS_KEY).IsListType()) {
+        return invocation_response::failure("Input value jobs must be a list", "InvalidInput");
+    }
+    auto const jobs = v.GetArray(MULTIEXP_JOBS_KEY);
+    std::vector<G1<bn128_pp>> answers(jobs.GetLength(), G1<bn128_pp>::zero());
+    auto outcomes = runBatch(jobs, [&token, &stats, &answers](JsonView const& job, size_t i) {
+        return multiexp_job(job, token, stats, answers[i]);
+    });
+
+    // normalize every answer with one batch inversion, then ship them compressed
+    auto const encoded = encodeCompressedG1(answers);
+    for (size_t i = 0; i < outcomes.size(); i++) {
+        if (outcomes[i].success && !outcomes[i].interrupted) {
+            outcomes[i].payload = toBase64(encoded[i]).c_str();
+        }
+    }
 
-    if (!v.ValueExists("groupelements")) {
-        return invocation_response::failure("2Failed to parse input JSON", "InvalidJSON");
+    auto response = encodeMultiExpBatchResponse(outcomes);
+    response.WithString(MULTIEXP_RESULT_ENCODING_KEY, MULTIEXP_COMPRESSED_G1_ENCODING);
+    response.WithObject("cache", report_cache_stats(stats));
+    return invocation_response::success(response.View().WriteCompact().c_str(), "application/json");
+}
+
+static invocation_response run_single(Aws::Utils::Json::JsonView const& v, cancellation_token const& token)
+{
+    using namespace Aws::Utils::Json;
+    cache_stats stats;
+    G1<bn128_pp> answer;
+    job_outcome outcome = multiexp_job(v, token, stats, answer);
+    report_cache_stats(stats);
+    if (!outcome.success) {
+        return invocation_response::failure(outcome.payload, outcome.error_type);
     }
+    if (outcome.interrupted) {
+        JsonValue response;
+        response.WithObject(MULTIEXP_PARTIAL_KEY, JsonValue(outcome.payload.c_str()));
+        return invocation_response::success(response.View().WriteCompact().c_str(), "application/json");
+    }
+    return invocation_response::success(serialize(answer), "application/json");
+}
+
+static invocation_response msm_g1_handler(invocation_request const& request)
+{
+    return with_json(request, [&request](Aws::Utils::Json::JsonView const& v) -> invocation_response {
+        return run_single(v, request.get_cancellation_token(deadline_margin));
+    });
+}
+
+static invocation_response batch_handler(invocation_request const& request)
+{
+    return with_json(request, [&request](Aws::Utils::Json::JsonView const& v) -> invocation_response {
+        return run_batch(v, request.get_cancellation_token(deadline_margin));
+    });
+}
+
+// A G2 multiexp over inline bases. Its progress has no wire format, so it runs to completion or fails at the deadline.
+//
+static invocation_response msm_g2_handler(invocation_request const& request)
+{
+    return with_json(request, [&request](Aws::Utils::Json::JsonView const& v) -> invocation_response {
+        std::vector<G2<bn128_pp>> bases;
+        std::vector<Fr<bn128_pp>> scalars;
+        std::string error;
+        if (!decodeMultiExpRequest(v, bases, scalars, error)) {
+            return invocation_response::failure(error, "InvalidInput");
+        }
+
+        auto const token = request.get_cancellation_token(deadline_margin);
+        multiexp_progress<G2<bn128_pp>> progress;
+        auto const status = multi_exp_resumable<G2<bn128_pp>, Fr<bn128_pp>>(
+            bases.cbegin(), bases.cend(), scalars.cbegin(), scalars.cend(), progress, [&token] {
+                return token.is_cancelled();
+            });
+        if (status != multiexp_status::done) {
+            return invocation_response::failure("The G2 multiexp didn't complete before the deadline", "Timeout");
+        }
+        return invocation_response::success(serialize(progress.result), "application/json");
+    });
+}
+
+static invocation_response ping_handler(invocation_request const&)
+{
+    return invocation_response::success(R"({"pong":true})", "application/json");
+}
+
+// Keeps the sandbox warm and, given a "basesref", loads those bases into the cache ahead of the jobs that use them.
+//
+static invocation_response warmup_handler(invocation_request const& request)
+{
+    return with_json(request, [](Aws::Utils::Json::JsonView const& v) -> invocation_response {
+        cache_stats stats;
+        if (v.ValueExists(MULTIEXP_BASES_REF_KEY)) {
+            blob_ref ref;
+            std::string error;
+            if (!decodeBlobRef(v.GetObject(MULTIEXP_BASES_REF_KEY), max_segment_length, ref, error)) {
+                return invocation_response::failure(error, "InvalidInput");
+            }
+            if (!bases_cache) {
+                return invocation_response::failure("No blob store configured for referenced bases", "NoBlobStore");
+            }
+            if (!bases_cache->resolve(ref, stats, error)) {
+                return invocation_response::failure(error, "BlobUnavailable");
+            }
+            if (warm_state) {
+                std::lock_guard<std::mutex> lock(warm_state_mutex);
+                warm_state->save();
+            }
+        }
+        Aws::Utils::Json::JsonValue response;
+        response.WithObject("cache", report_cache_stats(stats));
+        return invocation_response::success(response.View().WriteCompact().c_str(), "application/json");
+    });
+}
+
+// Requests that name no operation: a batch if they carry jobs, a single G1 multiexp otherwise.
+//
+invocation_response multiexp_inner_handler(invocation_request const& request)
+{
+    return with_json(request, [&request](Aws::Utils::Json::JsonView const& v) -> invocation_response {
+        auto const token = request.get_cancellation_token(deadline_margin);
+        return v.ValueExists(MULTIEXP_JOBS_KEY) ? run_batch(v, token) : run_single(v, token);
+    });
+}
 
-    auto groupElements_str = v.GetString("groupelements");
+// Everything that doesn't depend on the invocation, set up in the init phase instead of on the first invocation.
+//
+static invocation_response multiexp_init()
+{
+    // the codec and the kernel both rely on the curve parameters
+    libff::bn128_pp::init_public_params();
 
-	if (!v.ValueExists("scalars")) {
-        return invocation_response::failure("3Failed to parse input JSON", "InvalidJSON");
+    if (auto margin = std::getenv("MULTIEXP_DEADLINE_MARGIN_MS")) {
+        deadline_margin = std::chrono::milliseconds(std::strtoul(margin, nullptr, 10));
     }
 
-    auto scalars_str = v.GetString("scalars");
+    if (auto max_length = std::getenv("MULTIEXP_MAX_SEGMENT_BYTES")) {
+        max_segment_length = std::strtoull(max_length, nullptr, 10);
+    }
 
-    Aws::String ge_d_str = 
-		Aws::Utils::StringUtils::URLDecode(groupElements_str.c_str()); 
-	Aws::String sc_d_str = 
-		Aws::Utils::StringUtils::URLDecode(scalars_str.c_str()); 
-   
-    std::vector<G1<bn128_pp>> groupelements = 
-		deserializeToVec<G1<bn128_pp>>(ge_d_str.c_str());
-	std::vector<Fr<bn128_pp>> scalars = 
-		deserializeToVec<Fr<bn128_pp>>(sc_d_str.c_str());
-	std::string answer = 
-		invoke_multiexp_inner(groupelements, scalars);
-	//deserialize<Fr<bn128_pp>>("56");
-	//serialize<Fr<bn128_pp>>(scalars.at(0));
-	//std::ostringstream oss;
-	//std::string str = "";
-	//libff::serialize_bit_vector(oss, libff::convert_field_element_to_bit_vector(scalars.at(0)));
-    //std::cout << libff::bn128_Fr(scalars.at(0));
-    return invocation_response::success(answer.c_str(), "application/json");
+    // s3://bucket/prefix or file:///directory
+    if (auto location = std::getenv("MULTIEXP_BLOB_STORE")) {
+        bases_store = make_blob_store(location, max_segment_length);
+        if (!bases_store) {
+            return invocation_response::failure(
+                std::string("Unsupported MULTIEXP_BLOB_STORE ") + location, "InvalidConfiguration");
+        }
+        auto const dir = std::getenv("MULTIEXP_CACHE_DIR");
+        bases_cache.reset(new segment_cache<G1<bn128_pp>>(
+            *bases_store, dir ? dir : "/tmp/multiexp-cache", 1 << 20 /* decoded bases kept in memory */));
+
+        // registered after the runtime loaded the snapshot, so the bases are restored right here
+        if (warm_state) {
+            warm_state->add(
+                "bases",
+                BASES_SNAPSHOT_VERSION,
+                [](std::string& out) {
+                    bases_cache->save(out);
+                    return true;
+                },
+                [](byte_view state) {
+                    return bases_cache->restore(reinterpret_cast<char const*>(state.data()), state.size());
+                });
+        }
+    }
+    return invocation_response::success("", "application/json");
 }
 
 int main()
 {
-   run_handler(multiexp_inner_handler);
+   Aws::SDKOptions options;
+   Aws::InitAPI(options);
+   {
+      // $AWS_LAMBDA_SNAPSHOT_DIR, /tmp by default
+      warm_state.reset(new state_snapshot());
+      runtime_options run_options;
+      run_options.snapshot = warm_state.get();
+      // behind a dispatcher that hands out several invocations at once; everything the handlers share after init is
+      // either read-only (curve parameters, deadline margin) or locks itself (bases cache)
+      if (auto workers = std::getenv("MULTIEXP_WORKERS")) {
+          run_options.workers = std::strtoul(workers, nullptr, 10);
+      }
+
+      // one deployment serves every operation and they all share the warm state built in multiexp_init
+      invocation_router router;
+      router.route(MULTIEXP_OP_MSM_G1, msm_g1_handler)
+          .route(MULTIEXP_OP_MSM_G2, msm_g2_handler)
+          .route(MULTIEXP_OP_BATCH, batch_handler)
+          .route(MULTIEXP_OP_PING, ping_handler)
+          .route(MULTIEXP_OP_WARMUP, warmup_handler)
+          .fallback(multiexp_inner_handler);
+      run_handler(multiexp_init, router, run_options);
+
+      warm_state.reset();
+      bases_cache.reset();
+      bases_store.reset();
+   }
+   Aws::ShutdownAPI(options);
    //multi_exp_run();
     
    return 0;
 }
-
-
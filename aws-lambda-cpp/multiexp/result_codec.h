@@ -0,0 +1,171 @@
+#pragma once
+// result_codec.h
+//
+// Compact binary encoding of bn128 G1 results, used for batched responses where hundreds of partial results travel
+// back to the client at once.
+//
+// A point is first normalized to affine coordinates, after which Y is determined by X up to its sign. The compressed
+// form is therefore one flag byte followed by the raw X coordinate:
+//
+//   flags: bit 0 - point at infinity (X is then all zeros and ignored)
+//          bit 1 - least significant bit of Y's raw representation, selects the square root when decompressing
+//
+// X and Y are the field elements' in-memory representation, exactly what libff writes with BINARY_OUTPUT, so the
+// encoding is only meant for peers running the same libff build on the same architecture.
+//
+// Normalizing all results of a response goes through libff's batch_to_special, i.e. a single batch inversion instead
+// of one field inversion per point.
+//
+// The progress of an interrupted kernel (see kernel.h) travels in the same encoding, under "partial" (see batch.h):
+//
+//   {"windowBits": c, "windows": n, "windowsLeft": m, "nextBase": i,
+//    "result": "<base64 point>", "buckets": "<base64 points, concatenated>"}
+//
+// "buckets" is only present while a window is in progress. The client resumes by sending the same job again with the
+// partial object under "resume".
+#include <cstring>
+#include <string>
+#include <vector>
+#include <aws/core/utils/json/JsonSerializer.h>
+#include <libff/algebra/curves/bn128/bn128_g1.hpp>
+#include <libff/algebra/curves/bn128/bn128_init.hpp>
+#include <libff/algebra/scalar_multiplication/multiexp.hpp>
+#include "codec.h"
+#include "kernel.h"
+
+static char const MULTIEXP_RESULT_ENCODING_KEY[] = "resultEncoding";
+static char const MULTIEXP_COMPRESSED_G1_ENCODING[] = "g1-compressed";
+static char const MULTIEXP_RESUME_KEY[] = "resume";
+
+constexpr size_t compressed_g1_size = 1 + sizeof(bn::Fp);
+
+enum compressed_g1_flags : unsigned char {
+    compressed_g1_infinity = 1 << 0,
+    compressed_g1_y_odd = 1 << 1,
+};
+
+inline unsigned char raw_lsb(bn::Fp const& e)
+{
+    return reinterpret_cast<unsigned char const*>(&e)[0] & 1;
+}
+
+// Compress 'points' in order. The points are normalized in place with a single batch inversion.
+//
+inline std::vector<std::string> encodeCompressedG1(std::vector<libff::bn128_G1>& points)
+{
+    libff::batch_to_special(points);
+
+    std::vector<std::string> out;
+    out.reserve(points.size());
+    for (auto const& p : points) {
+        std::string bytes(compressed_g1_size, '\0');
+        if (p.is_zero()) {
+            bytes[0] = static_cast<char>(compressed_g1_infinity);
+        }
+        else {
+            bytes[0] = static_cast<char>(raw_lsb(p.Y) ? compressed_g1_y_odd : 0);
+            std::memcpy(&bytes[1], &p.X, sizeof(bn::Fp));
+        }
+        out.push_back(std::move(bytes));
+    }
+    return out;
+}
+
+// Decompress a point produced by encodeCompressedG1. Returns false if the bytes don't describe a point on the curve.
+//
+inline bool decodeCompressedG1(std::string const& bytes, libff::bn128_G1& out)
+{
+    if (bytes.size() != compressed_g1_size) {
+        return false;
+    }
+
+    auto const flags = static_cast<unsigned char>(bytes[0]);
+    if (flags & compressed_g1_infinity) {
+        out = libff::bn128_G1::zero();
+        return true;
+    }
+
+    // y = +/- sqrt(x^3 + b), same recovery as libff's compressed stream format
+    bn::Fp x, x2, y;
+    std::memcpy(&x, &bytes[1], sizeof(bn::Fp));
+    bn::Fp::square(x2, x);
+    bn::Fp::mul(y, x2, x);
+    bn::Fp::add(y, y, libff::bn128_coeff_b);
+    if (!bn::Fp::squareRoot(y, y)) {
+        return false;
+    }
+    if (raw_lsb(y) != ((flags & compressed_g1_y_odd) ? 1 : 0)) {
+        bn::Fp::neg(y, y);
+    }
+
+    out.X = x;
+    out.Y = y;
+    out.Z = 1;
+    return true;
+}
+
+// Encode the progress of an interrupted kernel. The buckets are normalized in place.
+//
+inline Aws::Utils::Json::JsonValue encodeMultiExpProgress(libff::multiexp_progress<libff::bn128_G1>& progress)
+{
+    Aws::Utils::Json::JsonValue json;
+    json.WithInt64("windowBits", static_cast<long long>(progress.window_bits));
+    json.WithInt64("windows", static_cast<long long>(progress.windows));
+    json.WithInt64("windowsLeft", static_cast<long long>(progress.windows_left));
+    json.WithInt64("nextBase", static_cast<long long>(progress.next_base));
+
+    std::vector<libff::bn128_G1> result{progress.result};
+    json.WithString("result", toBase64(encodeCompressedG1(result)[0]));
+
+    if (!progress.buckets.empty()) {
+        std::string buckets;
+        buckets.reserve(progress.buckets.size() * compressed_g1_size);
+        for (auto const& bytes : encodeCompressedG1(progress.buckets)) {
+            buckets += bytes;
+        }
+        json.WithString("buckets", toBase64(buckets));
+    }
+    return json;
+}
+
+// Parse the progress built by encodeMultiExpProgress. Whether it belongs to the job it came with is only known once
+// the kernel has seen the scalars, see multiexp_status::mismatched.
+//
+inline bool decodeMultiExpProgress(
+    Aws::Utils::Json::JsonView const& v,
+    libff::multiexp_progress<libff::bn128_G1>& progress,
+    std::string& error)
+{
+    for (char const* key : {"windowBits", "windows", "windowsLeft", "nextBase"}) {
+        if (!v.ValueExists(key) || !v.GetObject(key).IsIntegerType() || v.GetInt64(key) < 0) {
+            error = std::string("Missing or invalid progress value ") + key;
+            return false;
+        }
+    }
+    progress.window_bits = static_cast<size_t>(v.GetInt64("windowBits"));
+    progress.windows = static_cast<size_t>(v.GetInt64("windows"));
+    progress.windows_left = static_cast<size_t>(v.GetInt64("windowsLeft"));
+    progress.next_base = static_cast<size_t>(v.GetInt64("nextBase"));
+
+    if (!v.ValueExists("result") || !decodeCompressedG1(fromBase64(v.GetString("result")), progress.result)) {
+        error = "Failed to decode the partial result";
+        return false;
+    }
+
+    progress.buckets.clear();
+    if (progress.next_base > 0) {
+        std::string const buckets = v.ValueExists("buckets") ? fromBase64(v.GetString("buckets")) : std::string{};
+        if (buckets.empty() || buckets.size() % compressed_g1_size != 0) {
+            error = "Failed to decode the buckets of the window in progress";
+            return false;
+        }
+        progress.buckets.resize(buckets.size() / compressed_g1_size);
+        for (size_t i = 0; i < progress.buckets.size(); i++) {
+            if (!decodeCompressedG1(buckets.substr(i * compressed_g1_size, compressed_g1_size), progress.buckets[i])) {
+                error = "Failed to decode the buckets of the window in progress";
+                return false;
+            }
+        }
+    }
+    return true;
+}
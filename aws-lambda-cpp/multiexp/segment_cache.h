@@ -0,0 +1,224 @@
+#pragma once
+// segment_cache.h
+//
+// Two-level cache in front of a blob_store for referenced base segments. It lives for the lifetime of the container,
+// so warm invocations that reference the same segment again skip both the transfer and the decode.
+//
+//   memory: decoded segments, bounded by the number of decoded elements, least recently used evicted first.
+//   disk:   raw segment bytes under a local directory (/tmp by default), which survives for as long as the sandbox
+//           does, so a re-referenced segment that fell out of memory only has to be decoded again.
+//
+// The cache is safe to use from the parallel jobs of a batch. Two jobs missing on the same segment at the same time
+// both fetch it; the second insert is simply dropped.
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include "blob_store.h"
+#include "codec.h"
+
+/**
+ * Per-invocation tallies, passed in by the caller so concurrent invocations don't mix their counts.
+ */
+struct cache_stats {
+    std::atomic<size_t> memory_hits{0};
+    std::atomic<size_t> disk_hits{0};
+    std::atomic<size_t> misses{0};
+};
+
+template<typename T>
+class segment_cache {
+public:
+    using segment = std::shared_ptr<std::vector<T> const>;
+
+    segment_cache(blob_store& store, std::string directory, size_t max_elements)
+        : m_store(store), m_directory(std::move(directory)), m_max_elements(max_elements)
+    {
+        ::mkdir(m_directory.c_str(), 0700); // may already exist from a previous run in this sandbox
+    }
+
+    /**
+     * Resolve a reference to its decoded segment. Returns nullptr and sets 'error' on failure.
+     */
+    segment resolve(blob_ref const& ref, cache_stats& stats, std::string& error)
+    {
+        std::string const name = ref.segment_name();
+        if (auto hit = lookup(name)) {
+            stats.memory_hits++;
+            return hit;
+        }
+
+        std::string raw;
+        std::string const path = m_directory + "/" + name;
+        if (read_file(path, raw) && raw.size() == ref.length) {
+            stats.disk_hits++;
+        }
+        else {
+            stats.misses++;
+            if (!m_store.read(ref, raw, error)) {
+                return nullptr;
+            }
+            write_file(path, raw);
+        }
+
+        auto decoded = std::make_shared<std::vector<T>>();
+        if (!deserializeToVec<T>(raw, *decoded)) {
+            error = "Failed to decode segment " + name;
+            return nullptr;
+        }
+
+        segment result = decoded;
+        insert(name, result);
+        return result;
+    }
+
+    /**
+     * Append the decoded segments held in memory to 'out' as their raw elements, for a state_snapshot. Restoring them
+     * skips the decode, which is what a disk hit still pays for.
+     */
+    void save(std::string& out)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "segments are saved as the bytes of their elements");
+        std::lock_guard<std::mutex> lock(m_mutex);
+        append_word(out, sizeof(T));
+        // least recently used first, so restoring them in order rebuilds the same LRU order
+        for (auto it = m_lru.rbegin(); it != m_lru.rend(); ++it) {
+            append_word(out, it->first.size());
+            append_word(out, it->second->size());
+            out.append(it->first);
+            out.append(padding(it->first.size()), '\0');
+            out.append(reinterpret_cast<char const*>(it->second->data()), it->second->size() * sizeof(T));
+            out.append(padding(it->second->size() * sizeof(T)), '\0');
+        }
+    }
+
+    /**
+     * Insert the segments written by save(). Returns false if 'state' isn't what save() wrote, in which case it may
+     * have inserted some of them.
+     */
+    bool restore(char const* state, size_t size)
+    {
+        size_t offset = 0;
+        uint64_t element_size;
+        if (!read_word(state, size, offset, element_size) || element_size != sizeof(T)) {
+            return false;
+        }
+        while (offset < size) {
+            uint64_t name_length, elements;
+            if (!read_word(state, size, offset, name_length) || !read_word(state, size, offset, elements) ||
+                name_length > size - offset || padding(name_length) > size - offset - name_length) {
+                return false;
+            }
+            std::string name(state + offset, name_length);
+            offset += name_length + padding(name_length);
+            if (elements > (size - offset) / sizeof(T)) {
+                return false;
+            }
+            auto decoded = std::make_shared<std::vector<T>>(elements);
+            std::memcpy(static_cast<void*>(decoded->data()), state + offset, elements * sizeof(T));
+            offset += elements * sizeof(T) + padding(elements * sizeof(T));
+            insert(name, decoded);
+        }
+        return offset == size;
+    }
+
+private:
+    // save() keeps every field 8-byte aligned
+    static size_t padding(size_t size) { return (8 - size % 8) % 8; }
+
+    static void append_word(std::string& out, uint64_t word)
+    {
+        out.append(reinterpret_cast<char const*>(&word), sizeof(word));
+    }
+
+    static bool read_word(char const* state, size_t size, size_t& offset, uint64_t& word)
+    {
+        if (size - offset < sizeof(word)) {
+            return false;
+        }
+        std::memcpy(&word, state + offset, sizeof(word));
+        offset += sizeof(word);
+        return true;
+    }
+
+    segment lookup(std::string const& name)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(name);
+        if (it == m_index.end()) {
+            return nullptr;
+        }
+        m_lru.splice(m_lru.begin(), m_lru, it->second);
+        return it->second->second;
+    }
+
+    void insert(std::string const& name, segment const& s)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_index.count(name) || s->size() > m_max_elements) {
+            return;
+        }
+
+        m_lru.emplace_front(name, s);
+        m_index.emplace(name, m_lru.begin());
+        m_elements += s->size();
+        while (m_elements > m_max_elements) {
+            auto& victim = m_lru.back();
+            m_elements -= victim.second->size();
+            m_index.erase(victim.first);
+            m_lru.pop_back();
+        }
+    }
+
+    static bool read_file(std::string const& path, std::string& out)
+    {
+        std::ifstream in(path, std::ios_base::in | std::ios_base::binary);
+        if (!in) {
+            return false;
+        }
+        out.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    // Write through a temporary file so a concurrent reader or a frozen sandbox never sees a partial segment.
+    static void write_file(std::string const& path, std::string const& data)
+    {
+        auto const writer = std::hash<std::thread::id>()(std::this_thread::get_id());
+        std::string const tmp = path + ".tmp" + std::to_string(writer);
+        {
+            std::ofstream out(tmp, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+            out.write(data.data(), static_cast<std::streamsize>(data.size()));
+            if (!out.flush()) {
+                out.close();
+                std::remove(tmp.c_str());
+                return;
+            }
+        }
+        if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+            std::remove(tmp.c_str());
+        }
+    }
+
+    using entry = std::pair<std::string, segment>;
+
+    blob_store& m_store;
+    std::string const m_directory;
+    size_t const m_max_elements;
+    std::mutex m_mutex;
+    std::list<entry> m_lru;
+    std::unordered_map<std::string, typename std::list<entry>::iterator> m_index;
+    size_t m_elements = 0;
+};
@@ -0,0 +1,102 @@
+#include <stdexcept>
+#include "batch.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using namespace Aws::Utils::Json;
+
+Aws::Utils::Array<JsonView> parse_jobs(JsonValue const& envelope, JsonValue& storage)
+{
+    storage = JsonValue(envelope.View().WriteCompact());
+    return storage.View().GetArray(MULTIEXP_JOBS_KEY);
+}
+
+std::vector<JsonValue> make_jobs(size_t n)
+{
+    std::vector<JsonValue> jobs(n);
+    for (size_t i = 0; i < n; i++) {
+        jobs[i].WithInteger("id", static_cast<int>(i));
+    }
+    return jobs;
+}
+
+TEST(BatchTests, outcomes_keep_job_order)
+{
+    JsonValue storage;
+    auto const jobs = parse_jobs(encodeMultiExpBatch(make_jobs(64)), storage);
+    auto const outcomes = runBatch(
+        jobs, [](JsonView const& job, size_t) { return job_outcome::ok(std::to_string(job.GetInteger("id"))); }, 8);
+
+    ASSERT_EQ(64u, outcomes.size());
+    for (size_t i = 0; i < outcomes.size(); i++) {
+        ASSERT_TRUE(outcomes[i].success);
+        ASSERT_EQ(std::to_string(i), outcomes[i].payload);
+    }
+}
+
+TEST(BatchTests, index_matches_job)
+{
+    JsonValue storage;
+    auto const jobs = parse_jobs(encodeMultiExpBatch(make_jobs(32)), storage);
+    std::vector<size_t> seen(32, 0);
+    auto const outcomes = runBatch(jobs, [&seen](JsonView const& job, size_t i) {
+        seen[i]++;
+        return static_cast<size_t>(job.GetInteger("id")) == i ? job_outcome::ok("") : job_outcome::failed("", "");
+    });
+
+    for (size_t i = 0; i < outcomes.size(); i++) {
+        ASSERT_TRUE(outcomes[i].success);
+        ASSERT_EQ(1u, seen[i]);
+    }
+}
+
+TEST(BatchTests, failures_are_reported_per_job)
+{
+    JsonValue storage;
+    auto const jobs = parse_jobs(encodeMultiExpBatch(make_jobs(6)), storage);
+    auto const outcomes = runBatch(jobs, [](JsonView const& job, size_t) -> job_outcome {
+        int const id = job.GetInteger("id");
+        if (id == 2) {
+            return job_outcome::failed("bad job", "InvalidInput");
+        }
+        if (id == 4) {
+            throw std::runtime_error("boom");
+        }
+        return job_outcome::ok("fine");
+    });
+
+    ASSERT_EQ(6u, outcomes.size());
+    ASSERT_FALSE(outcomes[2].success);
+    ASSERT_EQ("InvalidInput", outcomes[2].error_type);
+    ASSERT_FALSE(outcomes[4].success);
+    ASSERT_EQ("boom", outcomes[4].payload);
+    ASSERT_TRUE(outcomes[0].success);
+    ASSERT_TRUE(outcomes[5].success);
+}
+
+TEST(BatchTests, empty_envelope)
+{
+    JsonValue storage;
+    auto const jobs = parse_jobs(encodeMultiExpBatch({}), storage);
+    auto const outcomes = runBatch(jobs, [](JsonView const&, size_t) { return job_outcome::ok(""); });
+    ASSERT_TRUE(outcomes.empty());
+}
+
+TEST(BatchTests, response_round_trip)
+{
+    std::vector<job_outcome> outcomes{job_outcome::ok("answer"), job_outcome::failed("bad job", "InvalidInput")};
+    JsonValue response(encodeMultiExpBatchResponse(outcomes).View().WriteCompact());
+    ASSERT_TRUE(response.WasParseSuccessful());
+
+    std::vector<job_outcome> decoded;
+    ASSERT_TRUE(decodeMultiExpBatchResponse(response.View(), decoded));
+    ASSERT_EQ(2u, decoded.size());
+    ASSERT_TRUE(decoded[0].success);
+    ASSERT_EQ("answer", decoded[0].payload);
+    ASSERT_FALSE(decoded[1].success);
+    ASSERT_EQ("bad job", decoded[1].payload);
+    ASSERT_EQ("InvalidInput", decoded[1].error_type);
+}
+
+} // namespace
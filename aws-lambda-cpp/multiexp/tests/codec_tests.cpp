@@ -0,0 +1,198 @@
+#include <libff/algebra/curves/bn128/bn128_pp.hpp>
+#include <libff/algebra/fields/field_utils.hpp>
+#include <libff/common/rng.hpp>
+#include <libff/common/serialization.hpp>
+#include "codec.h"
+#include "result_codec.h"
+#include "gtest/gtest.h"
+
+using namespace libff;
+
+namespace {
+
+using G1T = G1<bn128_pp>;
+using FrT = Fr<bn128_pp>;
+
+std::vector<G1T> make_bases(size_t n)
+{
+    std::vector<G1T> bases;
+    for (size_t i = 0; i < n; i++) {
+        G1T x = G1T::random_element();
+        x.to_special();
+        bases.push_back(x);
+    }
+    return bases;
+}
+
+std::vector<FrT> make_scalars(size_t n)
+{
+    std::vector<FrT> scalars;
+    for (size_t i = 0; i < n; i++) {
+        scalars.push_back(SHA512_rng<FrT>(i));
+    }
+    return scalars;
+}
+
+// What the client puts on the wire (see InvokeFunction in test_lambda_cpp) and what the worker parses back.
+std::string client_payload(Aws::Utils::Json::JsonValue const& json)
+{
+    return json.View().WriteReadable().c_str();
+}
+
+TEST(CodecTests, scalars_round_trip)
+{
+    auto const scalars = make_scalars(16);
+    std::vector<FrT> decoded;
+    ASSERT_TRUE(deserializeToVec(serializeVec(scalars), decoded));
+    ASSERT_EQ(scalars.size(), decoded.size());
+    for (size_t i = 0; i < scalars.size(); i++) {
+        ASSERT_EQ(scalars[i], decoded[i]);
+    }
+}
+
+TEST(CodecTests, bases_round_trip)
+{
+    auto const bases = make_bases(8);
+    std::vector<G1T> decoded;
+    ASSERT_TRUE(deserializeToVec(serializeVec(bases), decoded));
+    ASSERT_EQ(bases.size(), decoded.size());
+    for (size_t i = 0; i < bases.size(); i++) {
+        ASSERT_EQ(bases[i], decoded[i]);
+    }
+}
+
+// libff reads the zero flag of a point, and raw limbs under BINARY_OUTPUT, without skipping separators, so a decoder
+// that lost a byte between elements would misread every element after the first.
+TEST(CodecTests, every_element_is_read_from_its_own_bytes)
+{
+    auto bases = make_bases(64);
+    bases[0] = G1T::zero();
+    bases[31] = G1T::zero();
+    bases[63] = G1T::zero();
+    std::vector<G1T> decoded;
+    ASSERT_TRUE(deserializeToVec(serializeVec(bases), decoded));
+    ASSERT_EQ(bases, decoded);
+
+    auto const scalars = make_scalars(64);
+    std::vector<FrT> decoded_scalars;
+    ASSERT_TRUE(deserializeToVec(serializeVec(scalars), decoded_scalars));
+    ASSERT_EQ(scalars, decoded_scalars);
+}
+
+TEST(CodecTests, empty_vector_round_trip)
+{
+    std::vector<FrT> decoded{FrT::one()};
+    ASSERT_TRUE(deserializeToVec(serializeVec(std::vector<FrT>{}), decoded));
+    ASSERT_TRUE(decoded.empty());
+}
+
+TEST(CodecTests, truncated_vector_is_rejected)
+{
+    auto const encoded = serializeVec(make_scalars(4));
+    std::vector<FrT> decoded;
+    ASSERT_FALSE(deserializeToVec(encoded.substr(0, encoded.size() / 2), decoded));
+    ASSERT_FALSE(deserializeToVec(std::string{}, decoded));
+}
+
+TEST(CodecTests, result_round_trip)
+{
+    auto const answer = G1T::random_element();
+    G1T decoded;
+    ASSERT_TRUE(deserialize(serialize(answer), decoded));
+    ASSERT_EQ(answer, decoded);
+}
+
+TEST(CodecTests, client_request_decodes_on_worker)
+{
+    auto const bases = make_bases(4);
+    auto const scalars = make_scalars(4);
+    auto const payload = client_payload(encodeMultiExpRequest(bases, scalars));
+
+    Aws::Utils::Json::JsonValue json(payload.c_str());
+    ASSERT_TRUE(json.WasParseSuccessful());
+
+    std::vector<G1T> decoded_bases;
+    std::vector<FrT> decoded_scalars;
+    std::string error;
+    ASSERT_TRUE(decodeMultiExpRequest(json.View(), decoded_bases, decoded_scalars, error)) << error;
+    ASSERT_EQ(bases, decoded_bases);
+    ASSERT_EQ(scalars, decoded_scalars);
+}
+
+// The worker's router stops at "op", so it has to come before the bases and scalars rather than after them.
+TEST(CodecTests, operation_is_written_first)
+{
+    auto json = encodeMultiExpRequest(make_bases(4), make_scalars(4), MULTIEXP_OP_MSM_G1);
+    json.WithObject(MULTIEXP_RESUME_KEY, Aws::Utils::Json::JsonValue().WithInteger("next", 1));
+    auto const payload = client_payload(json);
+    std::string const key = '"' + std::string(MULTIEXP_OP_KEY) + '"';
+    auto const op = payload.find(key);
+    ASSERT_NE(std::string::npos, op);
+    ASSERT_LT(op, payload.find(MULTIEXP_BASES_KEY));
+    ASSERT_LT(op, payload.find(MULTIEXP_SCALARS_KEY));
+    ASSERT_EQ(MULTIEXP_OP_MSM_G1, Aws::Utils::Json::JsonValue(payload.c_str()).View().GetString(MULTIEXP_OP_KEY));
+
+    auto const without_op = client_payload(encodeMultiExpRequest(make_bases(1), make_scalars(1)));
+    ASSERT_EQ(std::string::npos, without_op.find(key));
+}
+
+TEST(CodecTests, mismatched_lengths_are_rejected)
+{
+    auto const payload = client_payload(encodeMultiExpRequest(make_bases(4), make_scalars(3)));
+    Aws::Utils::Json::JsonValue json(payload.c_str());
+
+    std::vector<G1T> bases;
+    std::vector<FrT> scalars;
+    std::string error;
+    ASSERT_FALSE(decodeMultiExpRequest(json.View(), bases, scalars, error));
+    ASSERT_FALSE(error.empty());
+}
+
+// The client used to send scalars as a libff bit-vector; the worker must refuse that instead of computing over it.
+TEST(CodecTests, legacy_bit_vector_scalars_are_rejected)
+{
+    std::ostringstream oss;
+    serialize_bit_vector(oss, convert_field_element_vector_to_bit_vector<FrT>(make_scalars(4)));
+
+    auto json = encodeMultiExpRequest(make_bases(4), make_scalars(4));
+    json.WithString(MULTIEXP_SCALARS_KEY, toBase64(oss.str()));
+    Aws::Utils::Json::JsonValue parsed(client_payload(json).c_str());
+
+    std::vector<G1T> bases;
+    std::vector<FrT> scalars;
+    std::string error;
+    ASSERT_FALSE(decodeMultiExpRequest(parsed.View(), bases, scalars, error));
+}
+
+TEST(CodecTests, compressed_results_round_trip)
+{
+    // a mix of projective points, their negations (other Y parity) and the point at infinity
+    std::vector<G1T> points;
+    for (size_t i = 0; i < 8; i++) {
+        auto const p = G1T::random_element() + G1T::random_element();
+        points.push_back(p);
+        points.push_back(-p);
+    }
+    points.push_back(G1T::zero());
+    auto const expected = points;
+
+    auto const encoded = encodeCompressedG1(points);
+    ASSERT_EQ(expected.size(), encoded.size());
+    for (size_t i = 0; i < encoded.size(); i++) {
+        ASSERT_EQ(compressed_g1_size, encoded[i].size());
+        G1T decoded;
+        ASSERT_TRUE(decodeCompressedG1(encoded[i], decoded));
+        ASSERT_EQ(expected[i], decoded);
+    }
+}
+
+TEST(CodecTests, compressed_result_of_wrong_size_is_rejected)
+{
+    std::vector<G1T> points{G1T::random_element()};
+    auto encoded = encodeCompressedG1(points);
+    G1T decoded;
+    ASSERT_FALSE(decodeCompressedG1(encoded[0].substr(1), decoded));
+    ASSERT_FALSE(decodeCompressedG1(std::string{}, decoded));
+}
+
+} // namespace
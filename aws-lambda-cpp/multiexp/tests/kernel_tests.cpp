@@ -0,0 +1,119 @@
+#include <functional>
+#include <libff/algebra/curves/bn128/bn128_pp.hpp>
+#include <libff/common/rng.hpp>
+#include "kernel.h"
+#include "result_codec.h"
+#include "gtest/gtest.h"
+
+using namespace libff;
+
+namespace {
+
+using G1T = G1<bn128_pp>;
+using FrT = Fr<bn128_pp>;
+
+struct instance {
+    std::vector<G1T> bases;
+    std::vector<FrT> scalars;
+};
+
+instance make_instance(size_t n)
+{
+    instance inst;
+    for (size_t i = 0; i < n; i++) {
+        G1T x = G1T::random_element();
+        x.to_special();
+        inst.bases.push_back(x);
+        inst.scalars.push_back(SHA512_rng<FrT>(i));
+    }
+    return inst;
+}
+
+multiexp_status run(instance const& inst, multiexp_progress<G1T>& progress, std::function<bool()> const& should_stop)
+{
+    return multi_exp_resumable<G1T, FrT>(
+        inst.bases.cbegin(), inst.bases.cend(), inst.scalars.cbegin(), inst.scalars.cend(), progress, should_stop);
+}
+
+// What the worker returns and the client sends back when resuming.
+multiexp_progress<G1T> round_trip(multiexp_progress<G1T>& progress)
+{
+    Aws::Utils::Json::JsonValue parsed(encodeMultiExpProgress(progress).View().WriteCompact());
+    multiexp_progress<G1T> decoded;
+    std::string error;
+    EXPECT_TRUE(decodeMultiExpProgress(parsed.View(), decoded, error)) << error;
+    return decoded;
+}
+
+TEST(KernelTests, matches_libff)
+{
+    auto const inst = make_instance(300);
+    auto const expected = multi_exp<G1T, FrT, multi_exp_method_bos_coster>(
+        inst.bases.cbegin(), inst.bases.cend(), inst.scalars.cbegin(), inst.scalars.cend(), 1);
+
+    auto const answer = multi_exp_inner1<G1T, FrT, multi_exp_method_BDLO12>(
+        inst.bases.cbegin(), inst.bases.cend(), inst.scalars.cbegin(), inst.scalars.cend());
+    ASSERT_EQ(expected, answer);
+}
+
+TEST(KernelTests, resumed_in_every_window_matches_uninterrupted)
+{
+    auto const inst = make_instance(1000);
+    multiexp_progress<G1T> uninterrupted;
+    ASSERT_EQ(multiexp_status::done, run(inst, uninterrupted, [] { return false; }));
+
+    // stop at every other poll, i.e. at window boundaries as well as between bases, and resume from the wire format
+    multiexp_progress<G1T> progress;
+    size_t polls = 0, interruptions = 0;
+    bool saw_buckets = false;
+    multiexp_status status;
+    while ((status = run(inst, progress, [&polls] { return polls++ % 2 == 1; })) == multiexp_status::interrupted) {
+        saw_buckets = saw_buckets || !progress.buckets.empty();
+        progress = round_trip(progress);
+        interruptions++;
+        ASSERT_LT(interruptions, 1000u);
+    }
+
+    ASSERT_EQ(multiexp_status::done, status);
+    ASSERT_TRUE(saw_buckets);
+    ASSERT_GT(interruptions, uninterrupted.windows);
+    ASSERT_EQ(uninterrupted.result, progress.result);
+}
+
+TEST(KernelTests, stopped_before_any_work)
+{
+    auto const inst = make_instance(64);
+    multiexp_progress<G1T> progress;
+    ASSERT_EQ(multiexp_status::interrupted, run(inst, progress, [] { return true; }));
+    ASSERT_TRUE(progress.started());
+    ASSERT_EQ(progress.windows, progress.windows_left);
+    ASSERT_TRUE(progress.result.is_zero());
+
+    auto resumed = round_trip(progress);
+    ASSERT_EQ(multiexp_status::done, run(inst, resumed, [] { return false; }));
+    ASSERT_EQ((multi_exp_inner1<G1T, FrT, multi_exp_method_BDLO12>(
+                  inst.bases.cbegin(), inst.bases.cend(), inst.scalars.cbegin(), inst.scalars.cend())),
+              resumed.result);
+}
+
+TEST(KernelTests, progress_of_another_job_is_rejected)
+{
+    multiexp_progress<G1T> progress;
+    ASSERT_EQ(multiexp_status::interrupted, run(make_instance(1000), progress, [] { return true; }));
+    ASSERT_EQ(multiexp_status::mismatched, run(make_instance(16), progress, [] { return false; }));
+}
+
+TEST(KernelTests, progress_without_buckets_is_rejected)
+{
+    Aws::Utils::Json::JsonValue json;
+    json.WithInt64("windowBits", 9).WithInt64("windows", 29).WithInt64("windowsLeft", 3).WithInt64("nextBase", 512);
+    std::vector<G1T> zero{G1T::zero()};
+    json.WithString("result", toBase64(encodeCompressedG1(zero)[0]));
+
+    multiexp_progress<G1T> progress;
+    std::string error;
+    ASSERT_FALSE(decodeMultiExpProgress(json.View(), progress, error));
+    ASSERT_FALSE(error.empty());
+}
+
+} // namespace
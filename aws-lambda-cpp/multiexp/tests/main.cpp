@@ -0,0 +1,14 @@
+#include <aws/core/Aws.h>
+#include <libff/algebra/curves/bn128/bn128_pp.hpp>
+#include "gtest/gtest.h"
+
+int main(int argc, char** argv)
+{
+    Aws::SDKOptions options;
+    Aws::InitAPI(options);
+    libff::bn128_pp::init_public_params();
+    ::testing::InitGoogleTest(&argc, argv);
+    int exitCode = RUN_ALL_TESTS();
+    Aws::ShutdownAPI(options);
+    return exitCode;
+}
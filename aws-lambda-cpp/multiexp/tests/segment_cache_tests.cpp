@@ -0,0 +1,134 @@
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <unistd.h>
+#include "segment_cache.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+struct SegmentCacheTest : public ::testing::Test {
+    std::string m_root;
+    std::string m_blob_name = "0123456789abcdef";
+    blob_ref m_first;
+    blob_ref m_second;
+
+    SegmentCacheTest()
+    {
+        char root[] = "/tmp/segment-cache-tests-XXXXXX";
+        m_root = mkdtemp(root);
+        ::mkdir((m_root + "/blobs").c_str(), 0700);
+
+        // one blob holding two segments back to back
+        std::string const first = serializeVec(std::vector<int>{1, 2, 3});
+        std::string const second = serializeVec(std::vector<int>{4, 5});
+        std::ofstream(m_root + "/blobs/" + m_blob_name) << first << second;
+
+        m_first.blob = m_second.blob = m_blob_name;
+        m_first.offset = 0;
+        m_first.length = first.size();
+        m_second.offset = first.size();
+        m_second.length = second.size();
+    }
+
+    ~SegmentCacheTest() override { std::system(("rm -rf " + m_root).c_str()); }
+};
+
+TEST_F(SegmentCacheTest, repeated_reference_hits_memory)
+{
+    local_blob_store store(m_root + "/blobs");
+    segment_cache<int> cache(store, m_root + "/cache", 100);
+    cache_stats stats;
+    std::string error;
+
+    auto first = cache.resolve(m_first, stats, error);
+    ASSERT_NE(nullptr, first) << error;
+    ASSERT_EQ((std::vector<int>{1, 2, 3}), *first);
+    auto second = cache.resolve(m_second, stats, error);
+    ASSERT_NE(nullptr, second) << error;
+    ASSERT_EQ((std::vector<int>{4, 5}), *second);
+    ASSERT_EQ(first, cache.resolve(m_first, stats, error));
+
+    ASSERT_EQ(2u, stats.misses.load());
+    ASSERT_EQ(1u, stats.memory_hits.load());
+    ASSERT_EQ(0u, stats.disk_hits.load());
+}
+
+TEST_F(SegmentCacheTest, evicted_segment_hits_disk)
+{
+    local_blob_store store(m_root + "/blobs");
+    segment_cache<int> cache(store, m_root + "/cache", 3); // room for a single segment
+    cache_stats stats;
+    std::string error;
+
+    ASSERT_NE(nullptr, cache.resolve(m_first, stats, error));
+    ASSERT_NE(nullptr, cache.resolve(m_second, stats, error));
+    ASSERT_NE(nullptr, cache.resolve(m_first, stats, error));
+
+    ASSERT_EQ(2u, stats.misses.load());
+    ASSERT_EQ(1u, stats.disk_hits.load());
+}
+
+TEST_F(SegmentCacheTest, disk_survives_a_new_cache)
+{
+    local_blob_store store(m_root + "/blobs");
+    std::string error;
+    {
+        segment_cache<int> cold(store, m_root + "/cache", 100);
+        cache_stats stats;
+        ASSERT_NE(nullptr, cold.resolve(m_first, stats, error));
+    }
+
+    segment_cache<int> warm(store, m_root + "/cache", 100);
+    cache_stats stats;
+    ASSERT_NE(nullptr, warm.resolve(m_first, stats, error));
+    ASSERT_EQ(1u, stats.disk_hits.load());
+    ASSERT_EQ(0u, stats.misses.load());
+}
+
+TEST_F(SegmentCacheTest, out_of_range_reference_fails)
+{
+    local_blob_store store(m_root + "/blobs");
+    segment_cache<int> cache(store, m_root + "/cache", 100);
+    cache_stats stats;
+    std::string error;
+
+    blob_ref ref = m_second;
+    ref.length += 10;
+    ASSERT_EQ(nullptr, cache.resolve(ref, stats, error));
+    ASSERT_FALSE(error.empty());
+}
+
+TEST_F(SegmentCacheTest, reference_longer_than_the_maximum_fails_before_reading)
+{
+    ASSERT_GT(m_first.length, m_second.length);
+    local_blob_store store(m_root + "/blobs", m_second.length);
+    segment_cache<int> cache(store, m_root + "/cache", 100);
+    cache_stats stats;
+    std::string error;
+
+    ASSERT_NE(nullptr, cache.resolve(m_second, stats, error)) << error;
+    ASSERT_EQ(nullptr, cache.resolve(m_first, stats, error));
+    ASSERT_NE(std::string::npos, error.find("longer than"));
+
+    // a length no blob could hold, which must not get as far as an allocation
+    blob_ref huge = m_first;
+    huge.length = std::numeric_limits<uint64_t>::max() / 2;
+    local_blob_store unbounded(m_root + "/blobs", std::numeric_limits<uint64_t>::max());
+    std::string raw;
+    ASSERT_FALSE(unbounded.read(huge, raw, error));
+    ASSERT_TRUE(raw.empty());
+}
+
+TEST_F(SegmentCacheTest, decoded_reference_is_bounded)
+{
+    auto const json = encodeBlobRef(m_second);
+    blob_ref ref;
+    std::string error;
+    ASSERT_TRUE(decodeBlobRef(json.View(), m_second.length, ref, error)) << error;
+    ASSERT_EQ(m_second.segment_name(), ref.segment_name());
+    ASSERT_FALSE(decodeBlobRef(json.View(), m_second.length - 1, ref, error));
+    ASSERT_FALSE(error.empty());
+}
+
+} // namespace
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "aws/lambda-runtime/arena.h"
+#include "aws/logging/logging.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+#define AWS_LAMBDA_RUNTIME_API __attribute__((visibility("default")))
+
+namespace aws {
+namespace lambda_runtime {
+
+static char const LOG_TAG[] = "LAMBDA_RUNTIME";
+
+// A block's memory follows its header, aligned for any type.
+struct alignas(std::max_align_t) invocation_arena::block {
+    block* next;
+    size_t capacity;
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+AWS_LAMBDA_RUNTIME_API
+invocation_arena::invocation_arena(size_t block_size)
+    : m_blocks(nullptr),
+      m_cursor(nullptr),
+      m_limit(nullptr),
+      m_block_size(std::max<size_t>(block_size, 64)),
+      m_next_block_size(m_block_size)
+{
+}
+
+AWS_LAMBDA_RUNTIME_API
+invocation_arena::~invocation_arena()
+{
+    free_blocks();
+}
+
+void invocation_arena::free_blocks()
+{
+    while (m_blocks) {
+        block* const next = m_blocks->next;
+        std::free(m_blocks);
+        m_blocks = next;
+    }
+    m_cursor = m_limit = nullptr;
+    m_stats.reserved = 0;
+}
+
+void invocation_arena::add_block(size_t capacity)
+{
+    void* const memory =
+        capacity > static_cast<size_t>(-1) - sizeof(block) ? nullptr : std::malloc(sizeof(block) + capacity);
+    if (!memory) {
+        logging::log_error(LOG_TAG, "Failed to allocate a block of %zu bytes for the invocation arena.", capacity);
+        std::abort();
+    }
+    m_blocks = new (memory) block{m_blocks, capacity};
+    m_cursor = m_blocks->data();
+    m_limit = m_cursor + capacity;
+    m_next_block_size = std::max(m_next_block_size, capacity) * 2;
+    m_stats.reserved += capacity;
+}
+
+AWS_LAMBDA_RUNTIME_API
+void* invocation_arena::allocate_block(size_t size, size_t alignment)
+{
+    size_t const needed = size + alignment < size ? static_cast<size_t>(-1) : size + alignment;
+    add_block(std::max(m_next_block_size, needed));
+    return allocate(size, alignment);
+}
+
+AWS_LAMBDA_RUNTIME_API
+void invocation_arena::reset()
+{
+    m_stats.high_water = std::max(m_stats.high_water, m_stats.bytes);
+    m_stats.allocations = 0;
+    m_stats.bytes = 0;
+    if (!m_blocks) {
+        return;
+    }
+    size_t const max_retained =
+        m_block_size > static_cast<size_t>(-1) / max_retained_blocks ? m_block_size : m_block_size * max_retained_blocks;
+    size_t const retained = std::min(m_stats.reserved, max_retained);
+    if (m_blocks->next || m_blocks->capacity > retained) {
+        free_blocks();
+        m_next_block_size = m_block_size;
+        add_block(retained);
+    }
+    m_cursor = m_blocks->data();
+    m_limit = m_cursor + m_blocks->capacity;
+}
+
+AWS_LAMBDA_RUNTIME_API
+arena_stats invocation_arena::stats() const
+{
+    arena_stats stats = m_stats;
+    stats.high_water = std::max(stats.high_water, stats.bytes);
+    return stats;
+}
+
+} // namespace lambda_runtime
+} // namespace aws
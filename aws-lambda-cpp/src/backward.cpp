@@ -23,10 +23,337 @@
 // - g++/clang++ -lbfd ...
 // #define BACKWARD_HAS_BFD 1
 
+// Or symbolize nothing here at all: with AWS_LAMBDA_DEFERRED_SYMBOLIZATION (cmake -DENABLE_DEFERRED_SYMBOLIZATION=ON)
+// a crash logs the raw return addresses as offsets into their modules along with the modules' build-ids, and
+// packaging/symbolize turns them into functions and lines offline, from the unstripped binaries. The function then
+// links neither libdw nor libbfd and loads no debug information, not even on a crash.
+
+#if defined(AWS_LAMBDA_DEFERRED_SYMBOLIZATION)
+
+#include <algorithm>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <elf.h>
+#include <link.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <unwind.h>
+
+namespace {
+
+constexpr size_t MAX_MODULES = 64;
+constexpr size_t MAX_FRAMES = 64;
+constexpr size_t MAX_BUILD_ID = 20;
+
+// Everything the signal handler needs is collected when the library is loaded, so the handler itself only unwinds
+// and write(2)s. Modules loaded later with dlopen are logged as bare addresses.
+struct module {
+    uintptr_t bias;
+    uintptr_t begin;
+    uintptr_t end;
+    char path[256];
+    char build_id[2 * MAX_BUILD_ID + 1];
+};
+
+module modules[MAX_MODULES];
+size_t module_count = 0;
+char alternate_stack[64 * 1024];
+
+int const crash_signals[] = {SIGABRT, SIGBUS, SIGFPE, SIGILL, SIGQUIT, SIGSEGV, SIGSYS, SIGTRAP, SIGXCPU, SIGXFSZ};
+
+void read_build_id(module& m, uintptr_t notes, size_t size)
+{
+    auto const align = [](uintptr_t n) { return (n + 3) & ~uintptr_t(3); };
+    uintptr_t const end = notes + size;
+    for (uintptr_t p = notes; p + sizeof(ElfW(Nhdr)) <= end;) {
+        auto const note = reinterpret_cast<ElfW(Nhdr) const*>(p);
+        uintptr_t const name = p + sizeof(ElfW(Nhdr));
+        uintptr_t const desc = name + align(note->n_namesz);
+        if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+            std::memcmp(reinterpret_cast<char const*>(name), "GNU", 4) == 0 && desc + note->n_descsz <= end) {
+            static char const digits[] = "0123456789abcdef";
+            auto const id = reinterpret_cast<unsigned char const*>(desc);
+            size_t const length = std::min<size_t>(note->n_descsz, MAX_BUILD_ID);
+            for (size_t i = 0; i < length; i++) {
+                m.build_id[2 * i] = digits[id[i] >> 4];
+                m.build_id[2 * i + 1] = digits[id[i] & 0xf];
+            }
+            m.build_id[2 * length] = '\0';
+            return;
+        }
+        p = desc + align(note->n_descsz);
+    }
+}
+
+int add_module(dl_phdr_info* info, size_t, void*)
+{
+    if (module_count == MAX_MODULES) {
+        return 1;
+    }
+    module& m = modules[module_count];
+    m.bias = info->dlpi_addr;
+    m.begin = UINTPTR_MAX;
+    m.end = 0;
+    m.build_id[0] = '\0';
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++) {
+        ElfW(Phdr) const& header = info->dlpi_phdr[i];
+        if (header.p_type == PT_LOAD) {
+            m.begin = std::min<uintptr_t>(m.begin, m.bias + header.p_vaddr);
+            m.end = std::max<uintptr_t>(m.end, m.bias + header.p_vaddr + header.p_memsz);
+        }
+        else if (header.p_type == PT_NOTE) {
+            read_build_id(m, m.bias + header.p_vaddr, header.p_memsz);
+        }
+    }
+
+    // the main executable comes without a name
+    m.path[0] = '\0';
+    if (info->dlpi_name && *info->dlpi_name) {
+        std::strncat(m.path, info->dlpi_name, sizeof(m.path) - 1);
+    }
+    else {
+        ssize_t const length = ::readlink("/proc/self/exe", m.path, sizeof(m.path) - 1);
+        m.path[length > 0 ? length : 0] = '\0';
+    }
+    if (m.begin < m.end) {
+        module_count++;
+    }
+    return 0;
+}
+
+void write_text(char const* text)
+{
+    ssize_t const written = ::write(STDERR_FILENO, text, std::strlen(text));
+    (void)written;
+}
+
+void write_number(uintptr_t value, unsigned base)
+{
+    char digits[2 + 2 * sizeof(value) * 4];
+    char* p = digits + sizeof(digits);
+    *--p = '\0';
+    do {
+        *--p = "0123456789abcdef"[value % base];
+        value /= base;
+    } while (value);
+    if (base == 16) {
+        *--p = 'x';
+        *--p = '0';
+    }
+    write_text(p);
+}
+
+struct unwind_state {
+    uintptr_t* frames;
+    size_t count;
+};
+
+_Unwind_Reason_Code collect_frame(_Unwind_Context* context, void* arg)
+{
+    auto& state = *static_cast<unwind_state*>(arg);
+    if (state.count == MAX_FRAMES) {
+        return _URC_END_OF_STACK;
+    }
+    int before_instruction = 0;
+    if (uintptr_t const ip = _Unwind_GetIPInfo(context, &before_instruction)) {
+        state.frames[state.count++] = ip;
+    }
+    return _URC_NO_REASON;
+}
+
+uintptr_t faulting_address(void* context)
+{
+    auto const uc = static_cast<ucontext_t const*>(context);
+#if defined(__x86_64__)
+    return static_cast<uintptr_t>(uc->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__aarch64__)
+    return static_cast<uintptr_t>(uc->uc_mcontext.pc);
+#else
+    (void)uc;
+    return 0;
+#endif
+}
+
+// Logs, one line each, the frames as "#<n> <address> <module path>+<offset>" and then every module they are in as
+// "module <path> build-id <hex>"; packaging/symbolize reads exactly that. Offsets are relative to the module's load
+// bias, i.e. what addr2line expects. Every frame but the first holds a return address.
+void log_raw_trace(int signal, void* context)
+{
+    uintptr_t frames[MAX_FRAMES];
+    unwind_state state{frames, 0};
+    _Unwind_Backtrace(collect_frame, &state);
+
+    // start at the faulting frame, skipping this handler and the signal trampoline
+    size_t first = 0;
+    uintptr_t const pc = faulting_address(context);
+    while (first < state.count && frames[first] != pc) {
+        first++;
+    }
+    if (first == state.count) {
+        first = 0;
+    }
+
+    write_text("Caught signal ");
+    write_number(static_cast<uintptr_t>(signal), 10);
+    write_text(", stack trace for offline symbolization:\n");
+    bool used[MAX_MODULES] = {};
+    for (size_t i = first; i < state.count; i++) {
+        write_text("#");
+        write_number(i - first, 10);
+        write_text(" ");
+        write_number(frames[i], 16);
+        for (size_t m = 0; m < module_count; m++) {
+            if (frames[i] >= modules[m].begin && frames[i] < modules[m].end) {
+                used[m] = true;
+                write_text(" ");
+                write_text(modules[m].path);
+                write_text("+");
+                write_number(frames[i] - modules[m].bias, 16);
+                break;
+            }
+        }
+        write_text("\n");
+    }
+    for (size_t m = 0; m < module_count; m++) {
+        if (used[m]) {
+            write_text("module ");
+            write_text(modules[m].path);
+            write_text(" build-id ");
+            write_text(modules[m].build_id);
+            write_text("\n");
+        }
+    }
+}
+
+} // namespace
+
+#else
+
 #include "backward.h"
 
-namespace backward {
+#endif
+
+#include <csignal>
+#include <memory>
+#include <new>
+#include "crash_handler.h"
+#include "aws/logging/logging.h"
+
+namespace {
+
+#if defined(AWS_LAMBDA_DEFERRED_SYMBOLIZATION)
+constexpr size_t crash_stack_size = sizeof(alternate_stack);
+#else
+constexpr size_t crash_stack_size = 8 * 1024 * 1024; // as much as backward::SignalHandling gives the first thread
+#endif
+
+// The alternate stack of a thread other than the one that installed the handlers, released when the thread exits.
+struct thread_crash_stack {
+    std::unique_ptr<char[]> memory;
+
+    thread_crash_stack()
+    {
+        stack_t current;
+        if (::sigaltstack(nullptr, &current) == 0 && (current.ss_flags & SS_DISABLE) == 0) {
+            return; // the thread that installed the handlers, or one that set up its own
+        }
+        memory.reset(new (std::nothrow) char[crash_stack_size]);
+        if (!memory) {
+            return;
+        }
+        stack_t stack;
+        stack.ss_sp = memory.get();
+        stack.ss_size = crash_stack_size;
+        stack.ss_flags = 0;
+        if (::sigaltstack(&stack, nullptr) != 0) {
+            memory.reset();
+        }
+    }
+
+    ~thread_crash_stack()
+    {
+        if (memory) {
+            stack_t stack;
+            std::memset(&stack, 0, sizeof(stack));
+            stack.ss_flags = SS_DISABLE;
+            ::sigaltstack(&stack, nullptr);
+        }
+    }
+};
+
+[[noreturn]] void handle_crash(int signal, siginfo_t* info, void* context)
+{
+    // the last records before a crash are the ones most needed, and nothing else would write them now
+    aws::logging::flush_on_crash();
+#if defined(AWS_LAMBDA_DEFERRED_SYMBOLIZATION)
+    (void)info;
+    log_raw_trace(signal, context);
+#else
+    backward::SignalHandling::handleSignal(signal, info, context);
+#endif
+    // the handler was reset, so this takes the default action
+    ::raise(signal);
+    ::_exit(EXIT_FAILURE);
+}
+
+void handle_crashes(int signal)
+{
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_flags = static_cast<int>(SA_SIGINFO | SA_ONSTACK | SA_NODEFER | SA_RESETHAND);
+    sigfillset(&action.sa_mask);
+    sigdelset(&action.sa_mask, signal);
+    action.sa_sigaction = &handle_crash;
+    ::sigaction(signal, &action, nullptr);
+}
+
+struct crash_handling {
+#if defined(AWS_LAMBDA_DEFERRED_SYMBOLIZATION)
+    crash_handling()
+    {
+        dl_iterate_phdr(add_module, nullptr);
+
+        stack_t stack;
+        stack.ss_sp = alternate_stack;
+        stack.ss_size = sizeof(alternate_stack);
+        stack.ss_flags = 0;
+        ::sigaltstack(&stack, nullptr);
+
+        for (int signal : crash_signals) {
+            handle_crashes(signal);
+        }
+    }
+#else
+    // sets up the alternate stack; its handlers are replaced by handle_crash, which calls into it
+    backward::SignalHandling backward_handling;
+
+    crash_handling()
+    {
+        for (int signal : backward::SignalHandling::make_default_signals()) {
+            handle_crashes(signal);
+        }
+    }
+#endif
+};
+
+} // namespace
+
+namespace aws {
+namespace lambda_runtime {
+
+// Called by the runtime as it starts, which also makes a static link pull in this file.
+void install_crash_handler()
+{
+    static crash_handling const handling;
+    (void)handling;
+}
 
-backward::SignalHandling sh;
+void install_crash_stack()
+{
+    static thread_local thread_crash_stack const stack;
+    (void)stack;
+}
 
-} // namespace backward
+} // namespace lambda_runtime
+} // namespace aws
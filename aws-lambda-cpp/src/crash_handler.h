@@ -0,0 +1,33 @@
+#pragma once
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+namespace aws {
+namespace lambda_runtime {
+
+/**
+ * Installs the signal handler that logs a stack-trace on a crash, see backward.cpp. Safe to call more than once.
+ */
+void install_crash_handler();
+
+/**
+ * Gives the calling thread an alternate signal stack of its own. The one set up by install_crash_handler only serves
+ * the thread that called it, and without one a stack overflow on any other thread kills the process before the
+ * handler can log anything. The runtime calls it first thing on each worker thread. Safe to call more than once.
+ */
+void install_crash_stack();
+
+} // namespace lambda_runtime
+} // namespace aws
@@ -13,8 +13,20 @@
  * permissions and limitations under the License.
  */
 #include "aws/logging/logging.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdio>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <chrono>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <strings.h> // strcasecmp
+#include <thread>
+#include <unistd.h>
 
 #define LAMBDA_RUNTIME_API __attribute__((visibility("default")))
 
@@ -35,34 +47,586 @@ static inline char const* get_prefix(verbosity v)
     }
 }
 
-LAMBDA_RUNTIME_API
-void log(verbosity v, char const* tag, char const* msg, va_list args)
+static inline char const* get_level_name(verbosity v)
+{
+    switch (v) {
+        case verbosity::error:
+            return "ERROR";
+        case verbosity::info:
+            return "INFO";
+        case verbosity::debug:
+            return "DEBUG";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+static long long now_ms()
+{
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::high_resolution_clock::now().time_since_epoch());
+    return static_cast<long long>(ms.count());
+}
+
+namespace {
+
+/**
+ * Log records are copied into the slots of a bounded multi-producer single-consumer ring (Vyukov's bounded queue) and
+ * written to stdout by a background thread, so logging never blocks on stdout. A record longer than a slot takes up
+ * as many consecutive slots as it needs; one longer than max_queued_record is written to stdout by the thread that
+ * logs it. Records are never cut. When the ring is full records are dropped and the number of dropped records is
+ * reported with the next batch.
+ */
+class async_log {
+public:
+    static constexpr size_t slot_size = 512;
+    static constexpr size_t capacity = 1024; // must be a power of two
+    static constexpr size_t max_queued_record = capacity / 4 * slot_size;
+
+    static async_log& instance();
+
+    /**
+     * Queue a complete record, newline included. Returns false if the ring had no room for it.
+     */
+    bool enqueue(char const* record, size_t length);
+
+    bool flush(std::chrono::milliseconds timeout);
+
+    /**
+     * Write what hasn't reached stdout yet with write(2), without the consumer thread, see flush_on_crash.
+     */
+    void write_pending();
+
+    void dropped() { m_dropped.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+    async_log();
+    void drain_loop();
+    bool drain(std::string& batch);
+
+    /**
+     * Claim 'count' consecutive slots. Returns false if the ring is too full.
+     */
+    bool claim(size_t count, size_t& position);
+
+    static size_t slots_for(size_t length) { return (length + slot_size - 1) / slot_size; }
+
+    // The first slot of a record holds its length, the slots it continues into hold 0.
+    struct slot {
+        std::atomic<size_t> sequence;
+        size_t length;
+        char data[slot_size];
+    };
+
+    slot m_slots[capacity];
+    std::atomic<size_t> m_enqueue_position;
+    size_t m_dequeue_position; // consumer only
+    std::atomic<size_t> m_written;         // everything before this position is on stdout
+    std::atomic<size_t> m_dropped;
+    std::atomic<bool> m_consumer_idle;
+    std::atomic<bool> m_crashed; // the consumer stops, write_pending writes what is left
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_drained;
+    std::mutex m_stdout_mutex; // between the consumer and records written past the ring
+    std::thread m_thread;
+};
+
+constexpr size_t async_log::slot_size;
+constexpr size_t async_log::capacity;
+constexpr size_t async_log::max_queued_record;
+
+// The log once instance() created it, for flush_on_crash: creating it from a signal handler would allocate and start
+// a thread there.
+std::atomic<async_log*> created_log{nullptr};
+
+async_log& async_log::instance()
+{
+    // Never destroyed: records may still be logged from other static destructors. Whatever is pending at exit is
+    // flushed by the atexit handler instead.
+    static async_log* log = [] {
+        auto l = new async_log();
+        created_log.store(l, std::memory_order_release);
+        std::atexit([] { instance().flush(std::chrono::milliseconds(1000)); });
+        return l;
+    }();
+    return *log;
+}
+
+async_log::async_log()
+    : m_enqueue_position(0), m_dequeue_position(0), m_written(0), m_dropped(0), m_consumer_idle(false),
+      m_crashed(false)
+{
+    for (size_t i = 0; i < capacity; i++) {
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    m_thread = std::thread([this] { drain_loop(); });
+    m_thread.detach();
+}
+
+// The consumer releases slots in order, so once the last of the slots is free for this lap all of them are.
+bool async_log::claim(size_t count, size_t& position)
 {
+    size_t pos = m_enqueue_position.load(std::memory_order_relaxed);
+    for (;;) {
+        size_t const last = pos + count - 1;
+        size_t const seq = m_slots[last & (capacity - 1)].sequence.load(std::memory_order_acquire);
+        auto const diff = static_cast<long long>(seq) - static_cast<long long>(last);
+        if (diff == 0) {
+            if (m_enqueue_position.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                position = pos;
+                return true;
+            }
+        }
+        else if (diff < 0) {
+            return false;
+        }
+        else {
+            pos = m_enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool async_log::enqueue(char const* record, size_t length)
+{
+    if (length > max_queued_record) {
+        // it would crowd out everything else; written in one go once what this thread queued before it is out
+        flush(std::chrono::milliseconds(1000));
+        std::lock_guard<std::mutex> lock(m_stdout_mutex);
+        fwrite(record, 1, length, stdout);
+        fflush(stdout);
+        return true;
+    }
+
+    size_t const count = slots_for(length);
+    size_t position;
+    if (!claim(count, position)) {
+        return false;
+    }
+    // the continuation slots first: the consumer takes the record once its first slot is published
+    for (size_t i = count - 1; i > 0; i--) {
+        slot& s = m_slots[(position + i) & (capacity - 1)];
+        size_t const offset = i * slot_size;
+        std::memcpy(s.data, record + offset, std::min(slot_size, length - offset));
+        s.length = 0;
+        s.sequence.store(position + i + 1, std::memory_order_release);
+    }
+    slot& first = m_slots[position & (capacity - 1)];
+    std::memcpy(first.data, record, std::min(slot_size, length));
+    first.length = length;
+    first.sequence.store(position + 1, std::memory_order_release);
+    if (m_consumer_idle.load(std::memory_order_acquire)) {
+        m_wake.notify_one();
+    }
+    return true;
+}
+
+bool async_log::flush(std::chrono::milliseconds timeout)
+{
+    size_t const target = m_enqueue_position.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_wake.notify_one();
+    // and until the records dropped on the way have been reported
+    return m_drained.wait_for(lock, timeout, [&] {
+        return m_written.load(std::memory_order_acquire) >= target && m_dropped.load(std::memory_order_relaxed) == 0;
+    });
+}
+
+static void write_all(char const* data, size_t length)
+{
+    while (length > 0) {
+        ssize_t const n = ::write(STDOUT_FILENO, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+}
+
+// Only the slots and the atomics are read, so this neither locks nor allocates. A slot the consumer has released
+// keeps its record until a producer claims it on the next lap, which covers the records the consumer has taken
+// but not written yet. The consumer stops before it writes its next batch; one it is writing already can show up
+// twice.
+void async_log::write_pending()
+{
+    m_crashed.store(true, std::memory_order_release);
+    // in this order, so that position <= end
+    size_t position = m_written.load(std::memory_order_acquire);
+    size_t const end = m_enqueue_position.load(std::memory_order_acquire);
+    if (end - position > capacity) {
+        position = end - capacity;
+    }
+
+    if (size_t const dropped = m_dropped.load(std::memory_order_relaxed)) {
+        // snprintf isn't async-signal-safe
+        char line[64] = "[ERROR] LOGGING dropped ";
+        size_t length = std::strlen(line);
+        char digits[24];
+        size_t count = 0;
+        for (size_t n = dropped; n > 0; n /= 10) {
+            digits[count++] = static_cast<char>('0' + n % 10);
+        }
+        while (count > 0) {
+            line[length++] = digits[--count];
+        }
+        static char const suffix[] = " log records\n";
+        std::memcpy(line + length, suffix, sizeof(suffix) - 1);
+        write_all(line, length + sizeof(suffix) - 1);
+    }
+
+    while (position != end) {
+        slot& s = m_slots[position & (capacity - 1)];
+        size_t const seq = s.sequence.load(std::memory_order_acquire);
+        // published and not taken yet, or taken by the consumer and not reclaimed; a record still being copied and
+        // the rest of a record whose start was overwritten are skipped
+        size_t const length = s.length;
+        if ((seq != position + 1 && seq != position + capacity) || length == 0) {
+            position++;
+            continue;
+        }
+        size_t const count = slots_for(length);
+        if (count > end - position) {
+            break; // no longer a valid record
+        }
+        for (size_t i = 0; i < count; i++) {
+            size_t const offset = i * slot_size;
+            write_all(m_slots[(position + i) & (capacity - 1)].data, std::min(slot_size, length - offset));
+        }
+        position += count;
+    }
+}
+
+// Move every published record into 'batch', in order. Returns false if there was nothing to move.
+bool async_log::drain(std::string& batch)
+{
+    size_t const first = m_dequeue_position;
+    for (;;) {
+        slot& s = m_slots[m_dequeue_position & (capacity - 1)];
+        if (s.sequence.load(std::memory_order_acquire) != m_dequeue_position + 1) {
+            break;
+        }
+        size_t const length = s.length;
+        for (size_t offset = 0; offset < length; offset += slot_size) {
+            slot& part = m_slots[m_dequeue_position & (capacity - 1)];
+            batch.append(part.data, std::min(slot_size, length - offset));
+            part.sequence.store(m_dequeue_position + capacity, std::memory_order_release);
+            m_dequeue_position++;
+        }
+    }
+    return m_dequeue_position != first;
+}
+
+void async_log::drain_loop()
+{
+    std::string batch;
+    batch.reserve(capacity * slot_size);
+    for (;;) {
+        batch.clear();
+        // only taken off the count once it is written, so that a crash in between still reports it
+        size_t const dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped) {
+            char line[128];
+            int const n = snprintf(
+                line, sizeof(line), "%s [%lld] LOGGING dropped %zu log records\n", get_prefix(verbosity::error),
+                now_ms(), dropped);
+            batch.append(line, static_cast<size_t>(std::max(n, 0)));
+        }
+
+        if (drain(batch) || !batch.empty()) {
+            if (m_crashed.load(std::memory_order_acquire)) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_stdout_mutex);
+                fwrite(batch.data(), 1, batch.size(), stdout);
+                // stdout is not line-buffered when redirected (for example to a file or to another process) so we
+                // must flush it manually.
+                fflush(stdout);
+            }
+            m_dropped.fetch_sub(dropped, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_written.store(m_dequeue_position, std::memory_order_release);
+            m_drained.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_written.store(m_dequeue_position, std::memory_order_release);
+        m_drained.notify_all();
+        m_consumer_idle.store(true, std::memory_order_release);
+        // producers only notify an idle consumer, the timeout covers a record published just before going idle
+        m_wake.wait_for(lock, std::chrono::milliseconds(10));
+        m_consumer_idle.store(false, std::memory_order_release);
+    }
+}
+
+// Formats into a fixed buffer and keeps counting past its end, so a record that doesn't fit can be formatted again into
+// one of the size it needs.
+struct record_writer {
+    char* out;
+    size_t capacity;
+    size_t length;
+
+    bool fits() const { return length <= capacity; }
+
+    void append(char const* data, size_t size)
+    {
+        if (length + size <= capacity) {
+            std::memcpy(out + length, data, size);
+        }
+        length += size;
+    }
+
+    void append(char c) { append(&c, 1); }
+
+    void vappendf(char const* format, va_list args)
+    {
+        size_t const room = length < capacity ? capacity - length : 0;
+        int const n = vsnprintf(room ? out + length : nullptr, room, format, args);
+        if (n > 0) {
+            length += static_cast<size_t>(n);
+        }
+        // vsnprintf leaves room for its NUL: when the text alone fills the rest of the buffer it was cut by a byte
+        if (static_cast<size_t>(std::max(n, 0)) == room && room) {
+            length++;
+        }
+    }
+
+    [[gnu::format(printf, 2, 3)]] void appendf(char const* format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        vappendf(format, args);
+        va_end(args);
+    }
+
+    // Append 'in' as the contents of a JSON string.
+    void append_escaped(char const* in)
+    {
+        for (; *in; in++) {
+            auto const ch = static_cast<unsigned char>(*in);
+            switch (ch) {
+                case '"':
+                    append("\\\"", 2);
+                    break;
+                case '\\':
+                    append("\\\\", 2);
+                    break;
+                case '\n':
+                    append("\\n", 2);
+                    break;
+                case '\t':
+                    append("\\t", 2);
+                    break;
+                default:
+                    if (ch < 0x20) {
+                        char escaped[7];
+                        snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+                        append(escaped, 6);
+                    }
+                    else {
+                        append(static_cast<char>(ch));
+                    }
+            }
+        }
+    }
+};
+
+void format_text(record_writer& record, verbosity v, char const* tag, char const* msg, va_list args)
+{
+    record.appendf("%s [%lld] %s ", get_prefix(v), now_ms(), tag);
+    record.vappendf(msg, args);
+    record.append('\n');
+}
+
+struct invocation_context {
+    std::string request_id;
+    char const* phase = nullptr;
+    std::chrono::steady_clock::time_point phase_start;
+};
+
+thread_local invocation_context current_context;
+
+// Format a record as a single line of JSON.
+void format_json(record_writer& record, verbosity v, char const* tag, char const* msg, va_list args)
+{
+    // the message is escaped, so it is formatted on its own first
+    char short_message[async_log::slot_size];
+    thread_local std::string long_message;
+    char const* message = short_message;
     va_list copy;
     va_copy(copy, args);
-    const int sz = vsnprintf(nullptr, 0, msg, args) + 1;
-    if (sz < 0) {
-        puts("error occurred during log formatting!\n");
-        va_end(copy);
+    int const length = vsnprintf(short_message, sizeof(short_message), msg, args);
+    if (length < 0) {
+        short_message[0] = '\0';
+    }
+    else if (static_cast<size_t>(length) >= sizeof(short_message)) {
+        long_message.resize(static_cast<size_t>(length) + 1);
+        vsnprintf(&long_message[0], long_message.size(), msg, copy);
+        message = long_message.c_str();
+    }
+    va_end(copy);
+
+    auto const now = std::chrono::system_clock::now();
+    auto const ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000;
+    std::time_t const t = std::chrono::system_clock::to_time_t(now);
+    std::tm utc;
+    gmtime_r(&t, &utc);
+    char timestamp[32];
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%S", &utc);
+
+    auto const& ctx = current_context;
+    record.appendf(
+        R"({"timestamp":"%s.%03dZ","level":"%s","tag":")", timestamp, static_cast<int>(ms), get_level_name(v));
+    record.append_escaped(tag);
+    if (!ctx.request_id.empty()) {
+        record.appendf(R"(","requestId":")");
+        record.append_escaped(ctx.request_id.c_str());
+    }
+    if (ctx.phase) {
+        auto const elapsed =
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - ctx.phase_start);
+        record.appendf(
+            R"(","phase":"%s","elapsedUs":%lld,"message":")", ctx.phase, static_cast<long long>(elapsed.count()));
+    }
+    else {
+        record.appendf(R"(","message":")");
+    }
+    record.append_escaped(message);
+    record.append("\"}\n", 3);
+}
+
+std::atomic<bool> json_records{false};
+
+verbosity parse_level(char const* level)
+{
+    if (!strcasecmp(level, "trace") || !strcasecmp(level, "debug")) {
+        return verbosity::debug;
+    }
+    if (!strcasecmp(level, "info")) {
+        return verbosity::info;
+    }
+    return verbosity::error; // warn, error and fatal
+}
+
+// Applies the environment before main, ahead of anything the runtime logs.
+struct environment_settings {
+    environment_settings()
+    {
+        if (auto level = std::getenv("AWS_LAMBDA_LOG_LEVEL")) {
+            set_level(parse_level(level));
+        }
+        if (auto format = std::getenv("AWS_LAMBDA_LOG_FORMAT")) {
+            set_format(strcasecmp(format, "json") == 0 ? record_format::json : record_format::text);
+        }
+    }
+} const apply_environment;
+
+} // namespace
+
+LAMBDA_RUNTIME_API
+std::atomic<int> runtime_level{static_cast<int>(verbosity::debug)};
+
+LAMBDA_RUNTIME_API
+void set_level(verbosity v)
+{
+    runtime_level.store(static_cast<int>(v), std::memory_order_relaxed);
+}
+
+LAMBDA_RUNTIME_API
+void set_format(record_format f)
+{
+    json_records.store(f == record_format::json, std::memory_order_relaxed);
+}
+
+LAMBDA_RUNTIME_API
+void set_context(char const* request_id, char const* phase)
+{
+    auto& ctx = current_context;
+    if (request_id) {
+        ctx.request_id = request_id;
+    }
+    else {
+        ctx.request_id.clear();
+    }
+    ctx.phase = phase;
+    ctx.phase_start = std::chrono::steady_clock::now();
+}
+
+LAMBDA_RUNTIME_API
+void log(verbosity v, char const* tag, char const* msg, va_list args)
+{
+    if (!is_enabled(v)) {
         return;
     }
-    char buf[512];
-    char* out = buf;
-    if (sz >= static_cast<int>(sizeof(buf))) {
-        out = new char[sz];
+
+    bool const json = json_records.load(std::memory_order_relaxed);
+    auto const format = [&](record_writer& record) {
+        va_list copy;
+        va_copy(copy, args);
+        if (json) {
+            format_json(record, v, tag, msg, copy);
+        }
+        else {
+            format_text(record, v, tag, msg, copy);
+        }
+        va_end(copy);
+    };
+
+    // most records fit into a slot; a longer one is formatted again into a buffer of its size, which the thread keeps
+    char buffer[async_log::slot_size];
+    record_writer record{buffer, sizeof(buffer), 0};
+    format(record);
+    if (!record.fits()) {
+        thread_local std::string long_record;
+        do {
+            long_record.resize(record.length); // a timestamp in the second pass can be longer than in the first
+            record = record_writer{&long_record[0], long_record.size(), 0};
+            format(record);
+        } while (!record.fits());
     }
+    auto& out = async_log::instance();
+    if (!out.enqueue(record.out, record.length)) {
+        out.dropped();
+    }
+}
 
-    vsnprintf(out, sz, msg, copy);
-    va_end(copy);
-    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::high_resolution_clock::now().time_since_epoch());
-    printf("%s [%lld] %s %s\n", get_prefix(v), static_cast<long long>(ms.count()), tag, out);
-    // stdout is not line-buffered when redirected (for example to a file or to another process) so we must flush it
-    // manually.
-    fflush(stdout);
-    if (out != buf) {
-        delete[] out;
+LAMBDA_RUNTIME_API
+void write(char const* line, size_t length)
+{
+    char buffer[async_log::slot_size];
+    thread_local std::string long_line;
+    char* record = buffer;
+    if (length >= sizeof(buffer)) {
+        long_line.resize(length + 1);
+        record = &long_line[0];
+    }
+    std::memcpy(record, line, length);
+    record[length] = '\n';
+    auto& out = async_log::instance();
+    if (!out.enqueue(record, length + 1)) {
+        out.dropped();
+    }
+}
+
+LAMBDA_RUNTIME_API
+bool flush(std::chrono::milliseconds timeout)
+{
+    return async_log::instance().flush(timeout);
+}
+
+LAMBDA_RUNTIME_API
+void flush_on_crash()
+{
+    // nothing was ever logged if there is no log yet
+    if (auto log = created_log.load(std::memory_order_acquire)) {
+        log->write_pending();
     }
 }
+
 } // namespace logging
 } // namespace aws
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "aws/lambda-runtime/runtime.h"
+#include "aws/logging/logging.h"
+
+#include <cstring>
+
+#define AWS_LAMBDA_RUNTIME_API __attribute__((visibility("default")))
+
+namespace aws {
+namespace lambda_runtime {
+
+static char const LOG_TAG[] = "LAMBDA_RUNTIME";
+static char const OPERATION_KEY[] = "op";
+static char const CUSTOM_CONTEXT_KEY[] = "custom";
+
+// Just enough of a JSON scanner to find a member of an object without building anything. Every function takes the
+// position to start at and returns the position after what it skipped, or null if the input isn't valid there.
+
+static char const* skip_space(char const* p, char const* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+static char const* skip_string(char const* p, char const* end)
+{
+    if (p == end || *p != '"') {
+        return nullptr;
+    }
+    for (p++; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        }
+        else if (*p == '"') {
+            return p + 1;
+        }
+    }
+    return nullptr;
+}
+
+static char const* skip_value(char const* p, char const* end)
+{
+    if (p == end) {
+        return nullptr;
+    }
+    if (*p == '"') {
+        return skip_string(p, end);
+    }
+    if (*p == '{' || *p == '[') {
+        size_t depth = 0;
+        while (p < end) {
+            if (*p == '"') {
+                p = skip_string(p, end);
+                if (!p) {
+                    return nullptr;
+                }
+                continue;
+            }
+            if (*p == '{' || *p == '[') {
+                depth++;
+            }
+            else if ((*p == '}' || *p == ']') && --depth == 0) {
+                return p + 1;
+            }
+            p++;
+        }
+        return nullptr;
+    }
+    // a number, true, false or null
+    char const* const start = p;
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+        p++;
+    }
+    return p == start ? nullptr : p;
+}
+
+// Returns the start of the value of the member 'key' of the object at 'p', or null if there is none.
+static char const* find_member(char const* p, char const* end, char const* key)
+{
+    size_t const key_length = std::strlen(key);
+    p = skip_space(p, end);
+    if (p == end || *p != '{') {
+        return nullptr;
+    }
+    p = skip_space(p + 1, end);
+    while (p < end && *p == '"') {
+        char const* const name = p + 1;
+        p = skip_string(p, end);
+        if (!p) {
+            return nullptr;
+        }
+        bool const match = static_cast<size_t>(p - 1 - name) == key_length && std::memcmp(name, key, key_length) == 0;
+        p = skip_space(p, end);
+        if (p == end || *p != ':') {
+            return nullptr;
+        }
+        p = skip_space(p + 1, end);
+        if (match) {
+            return p;
+        }
+        p = skip_value(p, end);
+        if (!p) {
+            return nullptr;
+        }
+        p = skip_space(p, end);
+        if (p == end || *p != ',') {
+            return nullptr;
+        }
+        p = skip_space(p + 1, end);
+    }
+    return nullptr;
+}
+
+// The operation is a plain string; one with escapes in it can't match a registered name anyway.
+static bool find_operation_in(char const* p, char const* end, char const*& op, size_t& length)
+{
+    p = find_member(p, end, OPERATION_KEY);
+    char const* const value_end = p ? skip_string(p, end) : nullptr;
+    if (!value_end || std::memchr(p, '\\', static_cast<size_t>(value_end - p)) != nullptr) {
+        return false;
+    }
+    op = p + 1;
+    length = static_cast<size_t>(value_end - 1 - op);
+    return true;
+}
+
+AWS_LAMBDA_RUNTIME_API
+bool invocation_router::find_operation(invocation_request const& request, char const*& op, size_t& length)
+{
+    std::string const& context = request.client_context;
+    char const* const context_end = context.data() + context.length();
+    if (char const* const custom = find_member(context.data(), context_end, CUSTOM_CONTEXT_KEY)) {
+        if (find_operation_in(custom, context_end, op, length)) {
+            return true;
+        }
+    }
+    return find_operation_in(request.payload.data(), request.payload.data() + request.payload.length(), op, length);
+}
+
+AWS_LAMBDA_RUNTIME_API
+invocation_router& invocation_router::route(std::string op, handler h)
+{
+    for (auto& route : m_routes) {
+        if (route.first == op) {
+            route.second = std::move(h);
+            return *this;
+        }
+    }
+    m_routes.emplace_back(std::move(op), std::move(h));
+    return *this;
+}
+
+AWS_LAMBDA_RUNTIME_API
+invocation_router& invocation_router::fallback(handler h)
+{
+    m_fallback = std::move(h);
+    return *this;
+}
+
+AWS_LAMBDA_RUNTIME_API
+invocation_response invocation_router::operator()(invocation_request const& request) const
+{
+    char const* op = nullptr;
+    size_t length = 0;
+    if (!find_operation(request, op, length)) {
+        if (m_fallback) {
+            return m_fallback(request);
+        }
+        return invocation_response::failure("The invocation names no operation", "MissingOperation");
+    }
+
+    for (auto const& route : m_routes) {
+        if (route.first.length() == length && std::memcmp(route.first.data(), op, length) == 0) {
+            logging::log_debug(LOG_TAG, "Routing operation %.*s", static_cast<int>(length), op);
+            return route.second(request);
+        }
+    }
+    if (m_fallback) {
+        return m_fallback(request);
+    }
+    return invocation_response::failure("Unknown operation '" + std::string(op, length) + "'", "UnknownOperation");
+}
+
+} // namespace lambda_runtime
+} // namespace aws
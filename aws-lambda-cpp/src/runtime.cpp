@@ -14,18 +14,42 @@
  */
 
 #include "aws/lambda-runtime/runtime.h"
+#include "aws/lambda-runtime/snapshot.h"
 #include "aws/lambda-runtime/version.h"
 #include "aws/lambda-runtime/outcome.h"
 #include "aws/logging/logging.h"
 #include "aws/http/response.h"
-
+#include "crash_handler.h"
+
+#ifdef AWS_LAMBDA_NATIVE_HTTP
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <strings.h> // for strcasecmp
+#include <sys/uio.h>
+#include <cerrno>
+#else
 #include <curl/curl.h>
 #include <curl/curlver.h>
+#endif
+#include <sys/socket.h>
+#include <unistd.h>
 #include <climits> // for ULONG_MAX
 #include <cassert>
 #include <chrono>
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <condition_variable>
 #include <cstdlib> // for strtoul
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
 
 #define AWS_LAMBDA_RUNTIME_API __attribute__((visibility("default")))
 
@@ -33,12 +57,11 @@ namespace aws {
 namespace lambda_runtime {
 
 static char const LOG_TAG[] = "LAMBDA_RUNTIME";
-static char const REQUEST_ID_HEADER[] = "lambda-runtime-aws-request-id";
-static char const TRACE_ID_HEADER[] = "lambda-runtime-trace-id";
-static char const CLIENT_CONTEXT_HEADER[] = "lambda-runtime-client-context";
-static char const COGNITO_IDENTITY_HEADER[] = "lambda-runtime-cognito-identity";
-static char const DEADLINE_MS_HEADER[] = "lambda-runtime-deadline-ms";
-static char const FUNCTION_ARN_HEADER[] = "lambda-runtime-invoked-function-arn";
+
+static constexpr std::chrono::milliseconds LOG_FLUSH_TIMEOUT{100};
+static constexpr size_t MAX_LOGGED_PAYLOAD = 256;
+static char const PAYLOAD_LOG_SAMPLING_ENV[] = "AWS_LAMBDA_LOG_PAYLOAD_SAMPLING";
+static char const DEFAULT_CONTENT_TYPE[] = "text/html";
 
 enum Endpoints {
     INIT,
@@ -52,37 +75,102 @@ static bool is_success(aws::http::response_code httpcode)
     return code >= 200 && code <= 299;
 }
 
+static bool is_transient(aws::http::response_code httpcode)
+{
+    switch (httpcode) {
+        case aws::http::response_code::REQUEST_NOT_MADE:
+        case aws::http::response_code::REQUEST_TIMEOUT:
+        case aws::http::response_code::TOO_MANY_REQUESTS:
+        case aws::http::response_code::BAD_GATEWAY:
+        case aws::http::response_code::SERVICE_UNAVAILABLE:
+        case aws::http::response_code::GATEWAY_TIMEOUT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Sleep before the given retry (1 for the first), see retry_policy.
+static void back_off(retry_policy const& policy, size_t retry)
+{
+    static thread_local std::minstd_rand rng(std::random_device{}());
+    long long const initial = std::max<long long>(policy.initial_backoff.count(), 0);
+    long long const ceiling = std::min<long long>(
+        std::max<long long>(policy.max_backoff.count(), 0), initial << std::min<size_t>(retry, 20));
+    std::uniform_int_distribution<long long> jitter(0, ceiling);
+    std::this_thread::sleep_for(std::chrono::milliseconds(jitter(rng)));
+}
+
+// Where the body of a response goes: into the response, or into a payload_sink if one is armed and the request
+// succeeded. Which one is decided by the first piece of the body, by then the status line and headers have arrived.
+struct body_target {
+    http::response* response;
+    payload_sink* sink;
+    bool decided;
+    bool to_sink;
+    size_t bytes;
+};
+
 static size_t write_data(char* ptr, size_t size, size_t nmemb, void* userdata)
 {
     if (!ptr) {
         return 0;
     }
 
-    auto const resp = static_cast<http::response*>(userdata);
+    auto const target = static_cast<body_target*>(userdata);
     assert(size == 1);
     (void)size; // avoid warning in release builds
-    assert(resp);
-    resp->append_body(ptr, nmemb);
+    assert(target && target->response);
+    if (!target->decided) {
+        target->decided = true;
+        target->to_sink = target->sink && is_success(target->response->get_response_code());
+        if (target->to_sink) {
+            http::response const& resp = *target->response;
+            target->sink->begin(resp.has_content_length() ? resp.get_content_length() : payload_sink::unknown_length);
+        }
+    }
+    target->bytes += nmemb;
+    if (target->to_sink) {
+        target->sink->write(ptr, nmemb);
+    }
+    else {
+        target->response->append_body(ptr, nmemb);
+    }
     return nmemb;
 }
 
-static inline bool IsSpace(int ch)
-{
-    if (ch < -1 || ch > 255) {
-        return false;
-    }
+struct stream_state {
+    response_producer const* producer;
+    size_t bytes;
+    bool aborted;
+};
 
-    return ::isspace(ch) != 0;
-}
+/**
+ * One request to the runtime API: a GET, or a POST of either a payload or a stream.
+ */
+struct http_request {
+    char const* method;
+    std::string const* url;
+    std::string const* content_type;
+    byte_view const* payload;
+    stream_state* stream;
+};
 
-static inline std::string trim(std::string s)
+#ifndef AWS_LAMBDA_NATIVE_HTTP
+static size_t read_stream(char* buffer, size_t size, size_t nitems, void* userdata)
 {
-    // trim right
-    s.erase(std::find_if(s.rbegin(), s.rend(), [](int ch) { return !IsSpace(ch); }).base(), s.end());
-    // trim left
-    s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](int ch) { return !IsSpace(ch); }));
-    return s;
+    auto const state = static_cast<stream_state*>(userdata);
+    assert(state && state->producer);
+    size_t const capacity = size * nitems;
+    size_t const written = (*state->producer)(buffer, capacity);
+    if (written == invocation_response::abort_stream || written > capacity) {
+        state->aborted = true;
+        return CURL_READFUNC_ABORT;
+    }
+    state->bytes += written;
+    return written;
 }
+#endif
 
 static size_t write_header(char* ptr, size_t size, size_t nmemb, void* userdata)
 {
@@ -90,20 +178,20 @@ static size_t write_header(char* ptr, size_t size, size_t nmemb, void* userdata)
         return 0;
     }
 
-    logging::log_debug(LOG_TAG, "received header: %s", std::string(ptr, nmemb).c_str());
+    logging::log_debug(LOG_TAG, "received header: %.*s", static_cast<int>(nmemb), ptr);
 
     auto const resp = static_cast<http::response*>(userdata);
     assert(resp);
-    for (size_t i = 0; i < nmemb; i++) {
-        if (ptr[i] != ':') {
-            continue;
+    size_t const length = size * nmemb;
+    // the status line, e.g. "HTTP/1.1 200 OK", is the only line without a colon that sets anything
+    if (length > 12 && std::strncmp(ptr, "HTTP/", 5) == 0) {
+        char const* code = static_cast<char const*>(std::memchr(ptr, ' ', length));
+        if (code && code + 4 <= ptr + length) {
+            resp->set_response_code(static_cast<aws::http::response_code>(std::strtol(code + 1, nullptr, 10)));
         }
-        std::string key{ptr, i};
-        std::string value{ptr + i + 1, nmemb - i - 1};
-        resp->add_header(trim(key), trim(value));
-        break;
     }
-    return size * nmemb;
+    resp->add_header(ptr, length);
+    return length;
 }
 
 static std::string const& get_user_agent_header()
@@ -112,28 +200,480 @@ static std::string const& get_user_agent_header()
     return user_agent;
 }
 
-static size_t read_data(char* buffer, size_t size, size_t nitems, void* userdata)
+// Lets another thread cut short a runtime's wait for its next invocation by shutting down the connection the wait is
+// on. The transport attaches every socket it opens and detaches it before closing it, so a shutdown never hits a
+// descriptor that was closed, and possibly reused, in the meantime.
+class connection_interrupter {
+public:
+    /**
+     * Called before waiting for an invocation. Returns false if the runtime was interrupted; it must not wait then.
+     */
+    bool begin_wait()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_waiting = !m_interrupted;
+        return m_waiting;
+    }
+
+    void end_wait()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_waiting = false;
+    }
+
+    /**
+     * Fail the wait in flight, if any, and every later one. A request that isn't a wait, i.e. a post, is left alone.
+     */
+    void interrupt()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_interrupted = true;
+        if (m_waiting && m_fd >= 0) {
+            shutdown(m_fd, SHUT_RDWR);
+        }
+    }
+
+    /**
+     * Register the socket the transport is about to use. Returns false, and doesn't take it, if an interrupted wait
+     * tries to connect again.
+     */
+    bool attach(int fd)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_interrupted && m_waiting) {
+            return false;
+        }
+        m_fd = fd;
+        return true;
+    }
+
+    void detach(int fd)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_fd == fd) {
+            m_fd = -1;
+        }
+    }
+
+private:
+    std::mutex m_mutex;
+    int m_fd = -1;
+    bool m_waiting = false;
+    bool m_interrupted = false;
+};
+
+#ifdef AWS_LAMBDA_NATIVE_HTTP
+static constexpr int CONNECT_TIMEOUT_MS = 1000;
+static constexpr size_t HTTP_BUFFER_SIZE = 64 * 1024;
+
+// A blocking HTTP/1.1 client that speaks just enough HTTP for the runtime API, which is always a plain http endpoint on
+// the loopback interface: no TLS, proxies, redirects or compression. It keeps one connection open for as long as the
+// server does, writes the request head together with the body in a single sendmsg and hands the response to the same
+// callbacks curl would call.
+class http_client {
+public:
+    http_client(std::string const& endpoint, connection_interrupter& interrupter);
+    ~http_client();
+
+    http_client(http_client const&) = delete;
+    http_client& operator=(http_client const&) = delete;
+
+    /**
+     * Send 'request' and read the response, passing header lines to write_header and the body to write_data. Returns
+     * false if no complete response arrived. 'wait' is how long it took for the first byte of the response to arrive.
+     * 'resent' is set if the request went out a second time, see perform's definition.
+     */
+    bool perform(http_request const& request, body_target& body, std::chrono::microseconds& wait, bool& resent);
+
+private:
+    bool connect();
+    void disconnect();
+    bool is_stale() const;
+    bool send(iovec* iov, size_t count);
+    bool send_request(http_request const& request);
+    bool fill();
+    bool read_line(char*& line, size_t& length);
+    bool read_body(body_target& body, size_t length);
+    bool read_chunked_body(body_target& body);
+    bool read_response(body_target& body, bool& keep_alive);
+
+    std::string m_host;
+    std::string m_port;
+    size_t m_origin_length; // of "http://host:port", what precedes the path in a URL
+    std::string m_fixed_headers;
+    std::string m_head;
+
+    /**
+     * Received bytes not yet processed are in [m_begin, m_end). While a request is being sent the buffer holds the
+     * chunks of a streamed body instead.
+     */
+    std::vector<char> m_buffer;
+    size_t m_begin;
+    size_t m_end;
+    bool m_received;
+    std::chrono::steady_clock::time_point m_first_byte;
+    connection_interrupter& m_interrupter;
+    int m_fd;
+};
+
+http_client::http_client(std::string const& endpoint, connection_interrupter& interrupter)
+    : m_origin_length(endpoint.length()),
+      m_buffer(HTTP_BUFFER_SIZE),
+      m_begin(0),
+      m_end(0),
+      m_received(false),
+      m_interrupter(interrupter),
+      m_fd(-1)
 {
-    auto const limit = size * nitems;
-    auto ctx = static_cast<std::pair<std::string const&, size_t>*>(userdata);
-    assert(ctx);
-    auto const unread = ctx->first.length() - ctx->second;
-    if (0 == unread) {
-        return 0;
+    static char const scheme[] = "http://";
+    std::string const authority = endpoint.compare(0, sizeof(scheme) - 1, scheme) == 0
+                                      ? endpoint.substr(sizeof(scheme) - 1)
+                                      : endpoint;
+    auto const colon = authority.rfind(':');
+    m_host = authority.substr(0, colon);
+    m_port = colon == std::string::npos ? "80" : authority.substr(colon + 1);
+    if (m_host.size() > 1 && m_host.front() == '[' && m_host.back() == ']') { // an IPv6 address
+        m_host = m_host.substr(1, m_host.size() - 2);
     }
+    m_fixed_headers = "Host: " + authority + "\r\n" + get_user_agent_header() + "\r\n";
+}
 
-    if (unread <= limit) {
-        std::copy_n(ctx->first.begin() + ctx->second, unread, buffer);
-        ctx->second += unread;
-        return unread;
+http_client::~http_client()
+{
+    disconnect();
+}
+
+bool http_client::connect()
+{
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    int const rc = getaddrinfo(m_host.c_str(), m_port.c_str(), &hints, &addresses);
+    if (rc != 0) {
+        logging::log_error(LOG_TAG, "Failed to resolve %s: %s", m_host.c_str(), gai_strerror(rc));
+        return false;
     }
 
-    std::copy_n(ctx->first.begin() + ctx->second, limit, buffer);
-    ctx->second += limit;
-    return limit;
+    for (addrinfo* a = addresses; a && m_fd < 0; a = a->ai_next) {
+        int const fd = socket(a->ai_family, a->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, a->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (!m_interrupter.attach(fd)) {
+            close(fd);
+            break;
+        }
+        // connect without blocking, to give up after the same time curl would
+        bool connected = ::connect(fd, a->ai_addr, a->ai_addrlen) == 0;
+        if (!connected && errno == EINPROGRESS) {
+            pollfd p{fd, POLLOUT, 0};
+            int error = 0;
+            socklen_t error_length = sizeof(error);
+            connected = poll(&p, 1, CONNECT_TIMEOUT_MS) == 1 &&
+                        getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length) == 0 && error == 0;
+        }
+        if (!connected) {
+            m_interrupter.detach(fd);
+            close(fd);
+            continue;
+        }
+        int const one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        m_fd = fd;
+    }
+    freeaddrinfo(addresses);
+    return m_fd >= 0;
 }
 
-#ifndef NDEBUG
+void http_client::disconnect()
+{
+    if (m_fd >= 0) {
+        m_interrupter.detach(m_fd);
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+// Between requests nothing is expected from the server; a readable connection is one it has closed.
+bool http_client::is_stale() const
+{
+    pollfd p{m_fd, POLLIN, 0};
+    return poll(&p, 1, 0) != 0;
+}
+
+bool http_client::send(iovec* iov, size_t count)
+{
+    msghdr msg{};
+    while (count > 0) {
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t const sent = sendmsg(m_fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        size_t left = static_cast<size_t>(sent);
+        for (; count > 0 && left >= iov->iov_len; iov++, count--) {
+            left -= iov->iov_len;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+bool http_client::send_request(http_request const& request)
+{
+    m_head.assign(request.method)
+        .append(" ")
+        .append(*request.url, m_origin_length, std::string::npos)
+        .append(" HTTP/1.1\r\n")
+        .append(m_fixed_headers);
+    bool const post = request.payload || request.stream;
+    if (post) {
+        m_head.append("content-type: ")
+            .append(request.content_type->empty() ? DEFAULT_CONTENT_TYPE : request.content_type->c_str())
+            .append("\r\n");
+    }
+    if (request.stream) {
+        m_head.append("transfer-encoding: chunked\r\n");
+    }
+    else if (post) {
+        char length[32];
+        snprintf(length, sizeof(length), "content-length: %zu\r\n", request.payload->size());
+        m_head.append(length);
+    }
+    m_head.append("\r\n");
+
+    iovec iov[4];
+    iov[0] = {&m_head[0], m_head.length()};
+    if (!request.stream) {
+        size_t count = 1;
+        if (post && !request.payload->empty()) {
+            iov[count++] = {const_cast<uint8_t*>(request.payload->data()), request.payload->size()};
+        }
+        return send(iov, count);
+    }
+
+    // one chunk per call of the producer, the head goes out with the first one
+    static char crlf[] = "\r\n";
+    static char last_chunk[] = "0\r\n\r\n";
+    char size_line[24];
+    size_t count = 1;
+    stream_state& stream = *request.stream;
+    for (;;) {
+        size_t const capacity = m_buffer.size();
+        size_t const written = (*stream.producer)(m_buffer.data(), capacity);
+        if (written == invocation_response::abort_stream || written > capacity) {
+            stream.aborted = true;
+            return false;
+        }
+        stream.bytes += written;
+        if (written == 0) {
+            iov[count++] = {last_chunk, sizeof(last_chunk) - 1};
+            return send(iov, count);
+        }
+        int const size_length = snprintf(size_line, sizeof(size_line), "%zx\r\n", written);
+        iov[count++] = {size_line, static_cast<size_t>(size_length)};
+        iov[count++] = {m_buffer.data(), written};
+        iov[count++] = {crlf, sizeof(crlf) - 1};
+        if (!send(iov, count)) {
+            return false;
+        }
+        count = 0;
+    }
+}
+
+// Receive more of the response, after what hasn't been processed yet.
+bool http_client::fill()
+{
+    if (m_begin == m_end) {
+        m_begin = m_end = 0;
+    }
+    else if (m_end == m_buffer.size()) {
+        std::memmove(m_buffer.data(), m_buffer.data() + m_begin, m_end - m_begin);
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+    if (m_end == m_buffer.size()) {
+        return false; // a line longer than the buffer
+    }
+
+    for (;;) {
+        ssize_t const received = recv(m_fd, m_buffer.data() + m_end, m_buffer.size() - m_end, 0);
+        if (received > 0) {
+            if (!m_received) {
+                m_received = true;
+                m_first_byte = std::chrono::steady_clock::now();
+            }
+            m_end += static_cast<size_t>(received);
+            return true;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        return false;
+    }
+}
+
+bool http_client::read_line(char*& line, size_t& length)
+{
+    for (size_t scanned = m_begin;;) {
+        if (auto const lf = static_cast<char*>(std::memchr(m_buffer.data() + scanned, '\n', m_end - scanned))) {
+            line = m_buffer.data() + m_begin;
+            length = static_cast<size_t>(lf + 1 - line);
+            m_begin += length;
+            return true;
+        }
+        size_t const unscanned = m_end - m_begin;
+        if (!fill()) {
+            return false;
+        }
+        scanned = m_begin + unscanned;
+    }
+}
+
+bool http_client::read_body(body_target& body, size_t length)
+{
+    while (length > 0) {
+        if (m_begin == m_end && !fill()) {
+            return false;
+        }
+        size_t const available = std::min(length, m_end - m_begin);
+        write_data(m_buffer.data() + m_begin, 1, available, &body);
+        m_begin += available;
+        length -= available;
+    }
+    return true;
+}
+
+bool http_client::read_chunked_body(body_target& body)
+{
+    char* line;
+    size_t length;
+    for (;;) {
+        if (!read_line(line, length)) {
+            return false;
+        }
+        char* end = nullptr;
+        unsigned long long const size = std::strtoull(line, &end, 16); // stops at the CRLF at the latest
+        if (end == line) {
+            return false;
+        }
+        if (size == 0) {
+            break;
+        }
+        if (!read_body(body, static_cast<size_t>(size)) || !read_line(line, length)) {
+            return false;
+        }
+    }
+    // trailers, up to the empty line
+    do {
+        if (!read_line(line, length)) {
+            return false;
+        }
+    } while (length > 2);
+    return true;
+}
+
+static bool header_equals(http::response const& resp, char const* name, char const* value)
+{
+    return resp.has_header(name) && strcasecmp(resp.get_header(name).c_str(), value) == 0;
+}
+
+bool http_client::read_response(body_target& body, bool& keep_alive)
+{
+    http::response& resp = *body.response;
+    char* line;
+    size_t length;
+    int code;
+    do { // skip interim responses such as 100 Continue
+        if (!read_line(line, length)) {
+            return false;
+        }
+        resp.set_response_code(aws::http::response_code::REQUEST_NOT_MADE);
+        write_header(line, 1, length, &resp);
+        code = static_cast<int>(resp.get_response_code());
+        if (code < 100) {
+            logging::log_error(LOG_TAG, "Received a malformed status line: %.*s", static_cast<int>(length), line);
+            return false;
+        }
+        for (;;) {
+            if (!read_line(line, length)) {
+                return false;
+            }
+            if (length <= 2) {
+                break;
+            }
+            write_header(line, 1, length, &resp);
+        }
+    } while (code < 200);
+
+    keep_alive = !header_equals(resp, "connection", "close");
+    if (code == 204 || code == 304) {
+        return true;
+    }
+    if (header_equals(resp, "transfer-encoding", "chunked")) {
+        return read_chunked_body(body);
+    }
+    if (resp.has_content_length()) {
+        return read_body(body, resp.get_content_length());
+    }
+    // the body ends with the connection
+    keep_alive = false;
+    do {
+        write_data(m_buffer.data() + m_begin, 1, m_end - m_begin, &body);
+        m_begin = m_end;
+    } while (fill());
+    return true;
+}
+
+bool http_client::perform(http_request const& request, body_target& body, std::chrono::microseconds& wait, bool& resent)
+{
+    resent = false;
+    if (m_fd >= 0 && is_stale()) {
+        disconnect();
+    }
+    bool reused = m_fd >= 0;
+    for (;;) {
+        if (m_fd < 0 && !connect()) {
+            logging::log_debug(LOG_TAG, "Failed to connect to %s:%s", m_host.c_str(), m_port.c_str());
+            return false;
+        }
+        m_begin = m_end = 0;
+        m_received = false;
+        auto const start = std::chrono::steady_clock::now();
+        bool keep_alive = true;
+        if (send_request(request) && read_response(body, keep_alive)) {
+            wait = std::chrono::duration_cast<std::chrono::microseconds>(m_first_byte - start);
+            if (!keep_alive) {
+                disconnect();
+            }
+            return true;
+        }
+
+        int const error = errno;
+        disconnect();
+        // the server may have closed the connection just as the request went out on it; nothing was answered, so
+        // send the request again on a new connection, unless it was streamed and can't be produced twice
+        if (!reused || m_received || request.stream) {
+            logging::log_debug(LOG_TAG, "Request to %s failed - %s", request.url->c_str(), strerror(error));
+            return false;
+        }
+        reused = false;
+        resent = true;
+    }
+}
+#endif
+
+#if !defined(NDEBUG) && !defined(AWS_LAMBDA_NATIVE_HTTP)
 static int rt_curl_debug_callback(CURL* handle, curl_infotype type, char* data, size_t size, void* userdata)
 {
     (void)handle;
@@ -145,6 +685,30 @@ static int rt_curl_debug_callback(CURL* handle, curl_infotype type, char* data,
 }
 #endif
 
+#ifndef AWS_LAMBDA_NATIVE_HTTP
+// curl opens and closes its sockets through these, so that the connection_interrupter knows the current one.
+static curl_socket_t open_socket(void* userdata, curlsocktype purpose, curl_sockaddr* address)
+{
+    (void)purpose;
+    auto interrupter = static_cast<connection_interrupter*>(userdata);
+    int const fd = socket(address->family, address->socktype | SOCK_CLOEXEC, address->protocol);
+    if (fd < 0) {
+        return CURL_SOCKET_BAD;
+    }
+    if (!interrupter->attach(fd)) {
+        close(fd);
+        return CURL_SOCKET_BAD;
+    }
+    return fd;
+}
+
+static int close_socket(void* userdata, curl_socket_t fd)
+{
+    static_cast<connection_interrupter*>(userdata)->detach(fd);
+    return close(fd);
+}
+#endif
+
 struct no_result {
 };
 
@@ -162,60 +726,161 @@ public:
     next_outcome get_next();
 
     /**
-     * Tells lambda that the function has succeeded.
+     * Tells lambda that the function has succeeded. The time and bytes it took are added to 'metrics'.
+     */
+    post_outcome post_success(
+        std::string const& request_id,
+        invocation_response const& handler_response,
+        invocation_metrics& metrics);
+
+    /**
+     * Tells lambda that the function has failed. The time and bytes it took are added to 'metrics'.
+     */
+    post_outcome post_failure(
+        std::string const& request_id,
+        invocation_response const& handler_response,
+        invocation_metrics& metrics);
+
+    /**
+     * Tells lambda that the function failed to initialize.
+     */
+    post_outcome post_init_error(invocation_response const& init_response);
+
+    /**
+     * Stream the payloads of the following invocations into 'sink' instead of invocation_request::payload, or stop
+     * doing so if it is null.
      */
-    post_outcome post_success(std::string const& request_id, invocation_response const& handler_response);
+    void set_payload_sink(payload_sink* sink) { m_sink = sink; }
 
     /**
-     * Tells lambda that the function has failed.
+     * Whether the last request went out a second time: both transports send a request again on a new connection if
+     * the reused one was closed without an answer, so the runtime API may have received it twice. With curl this is
+     * any request that had to reconnect, including one whose first connection was found closed before it was sent.
      */
-    post_outcome post_failure(std::string const& request_id, invocation_response const& handler_response);
+    bool last_request_resent() const { return m_resent; }
+
+    /**
+     * Make get_next fail right away, the one in flight as well as every later one. A post in flight completes.
+     * Unlike the other members, this may be called from any thread.
+     */
+    void interrupt() { m_interrupter.interrupt(); }
 
 private:
-    void set_curl_next_options();
-    void set_curl_post_result_options();
+    /**
+     * Send 'request' and receive the response into m_response, its body through m_body. Returns false if no response
+     * arrived. 'wait' is how long it took for the first byte of the response to arrive. Sets m_resent.
+     */
+    bool perform(http_request const& request, std::chrono::microseconds& wait);
+#ifndef AWS_LAMBDA_NATIVE_HTTP
+    void set_curl_options();
+    curl_slist* get_post_headers(std::string const& content_type, bool chunked);
+#endif
     post_outcome do_post(
         std::string const& url,
         std::string const& request_id,
-        invocation_response const& handler_response);
+        invocation_response const& handler_response,
+        invocation_metrics& metrics,
+        bool& stream_aborted);
 
 private:
     std::array<std::string const, 3> const m_endpoints;
+    connection_interrupter m_interrupter;
+#ifdef AWS_LAMBDA_NATIVE_HTTP
+    http_client m_client;
+#else
     CURL* const m_curl_handle;
+
+    /**
+     * Header lists are built once and only swapped in per request; the post list is rebuilt only when a handler
+     * changes the content-type of its responses.
+     */
+    curl_slist* m_next_headers;
+    curl_slist* m_post_headers;
+    std::string m_post_content_type;
+    bool m_post_chunked;
+#endif
+
+    /**
+     * Target of curl's write and header callbacks, cleared before every request.
+     */
+    http::response m_response;
+    body_target m_body;
+    payload_sink* m_sink;
+
+    size_t m_invocations;
+    size_t m_payload_log_sampling;
+    bool m_resent;
 };
 
 runtime::runtime(std::string const& endpoint)
     : m_endpoints{{endpoint + "/2018-06-01/runtime/init/error",
                    endpoint + "/2018-06-01/runtime/invocation/next",
                    endpoint + "/2018-06-01/runtime/invocation/"}},
-      m_curl_handle(curl_easy_init())
+#ifdef AWS_LAMBDA_NATIVE_HTTP
+      m_client(endpoint, m_interrupter),
+#else
+      m_curl_handle(curl_easy_init()),
+      m_next_headers(nullptr),
+      m_post_headers(nullptr),
+      m_post_chunked(false),
+#endif
+      m_body{&m_response, nullptr, false, false, 0},
+      m_sink(nullptr),
+      m_invocations(0),
+      m_payload_log_sampling(1),
+      m_resent(false)
 {
+    if (auto sampling = std::getenv(PAYLOAD_LOG_SAMPLING_ENV)) {
+        m_payload_log_sampling = strtoul(sampling, nullptr, 10); // 0 never logs payloads
+    }
+#ifndef AWS_LAMBDA_NATIVE_HTTP
     if (!m_curl_handle) {
         logging::log_error(LOG_TAG, "Failed to acquire curl easy handle for next.");
+        return;
     }
+    m_next_headers = curl_slist_append(m_next_headers, get_user_agent_header().c_str());
+    set_curl_options();
+#endif
 }
 
+#ifdef AWS_LAMBDA_NATIVE_HTTP
+runtime::~runtime() = default;
+
+bool runtime::perform(http_request const& request, std::chrono::microseconds& wait)
+{
+    return m_client.perform(request, m_body, wait, m_resent);
+}
+#else
 runtime::~runtime()
 {
+    curl_slist_free_all(m_next_headers);
+    curl_slist_free_all(m_post_headers);
     curl_easy_cleanup(m_curl_handle);
 }
 
-void runtime::set_curl_next_options()
+// The same easy handle, and with it the same connection to the runtime API, is used for the lifetime of the runtime.
+// Everything that doesn't change between requests is set up here once; requests only set the method, URL, headers and
+// body.
+void runtime::set_curl_options()
 {
     // lambda freezes the container when no further tasks are available. The freezing period could be longer than the
     // request timeout, which causes the following get_next request to fail with a timeout error.
-    curl_easy_reset(m_curl_handle);
     curl_easy_setopt(m_curl_handle, CURLOPT_TIMEOUT, 0L);
     curl_easy_setopt(m_curl_handle, CURLOPT_CONNECTTIMEOUT, 1L);
     curl_easy_setopt(m_curl_handle, CURLOPT_NOSIGNAL, 1L);
     curl_easy_setopt(m_curl_handle, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(m_curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);
     curl_easy_setopt(m_curl_handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
 
-    curl_easy_setopt(m_curl_handle, CURLOPT_HTTPGET, 1L);
-    curl_easy_setopt(m_curl_handle, CURLOPT_URL, m_endpoints[Endpoints::NEXT].c_str());
-
     curl_easy_setopt(m_curl_handle, CURLOPT_WRITEFUNCTION, write_data);
     curl_easy_setopt(m_curl_handle, CURLOPT_HEADERFUNCTION, write_header);
+    curl_easy_setopt(m_curl_handle, CURLOPT_READFUNCTION, read_stream);
+    curl_easy_setopt(m_curl_handle, CURLOPT_WRITEDATA, &m_body);
+    curl_easy_setopt(m_curl_handle, CURLOPT_HEADERDATA, &m_response);
+    curl_easy_setopt(m_curl_handle, CURLOPT_OPENSOCKETFUNCTION, open_socket);
+    curl_easy_setopt(m_curl_handle, CURLOPT_OPENSOCKETDATA, &m_interrupter);
+    curl_easy_setopt(m_curl_handle, CURLOPT_CLOSESOCKETFUNCTION, close_socket);
+    curl_easy_setopt(m_curl_handle, CURLOPT_CLOSESOCKETDATA, &m_interrupter);
 
 #ifndef NDEBUG
     curl_easy_setopt(m_curl_handle, CURLOPT_VERBOSE, 1);
@@ -223,57 +888,98 @@ void runtime::set_curl_next_options()
 #endif
 }
 
-void runtime::set_curl_post_result_options()
+curl_slist* runtime::get_post_headers(std::string const& content_type, bool chunked)
 {
-    curl_easy_reset(m_curl_handle);
-    curl_easy_setopt(m_curl_handle, CURLOPT_TIMEOUT, 0L);
-    curl_easy_setopt(m_curl_handle, CURLOPT_CONNECTTIMEOUT, 1L);
-    curl_easy_setopt(m_curl_handle, CURLOPT_NOSIGNAL, 1L);
-    curl_easy_setopt(m_curl_handle, CURLOPT_TCP_NODELAY, 1L);
-    curl_easy_setopt(m_curl_handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+    static std::string const default_content_type = DEFAULT_CONTENT_TYPE;
+    std::string const& ct = content_type.empty() ? default_content_type : content_type;
+    if (m_post_headers && ct == m_post_content_type && chunked == m_post_chunked) {
+        return m_post_headers;
+    }
 
-    curl_easy_setopt(m_curl_handle, CURLOPT_POST, 1L);
-    curl_easy_setopt(m_curl_handle, CURLOPT_READFUNCTION, read_data);
-    curl_easy_setopt(m_curl_handle, CURLOPT_WRITEFUNCTION, write_data);
-    curl_easy_setopt(m_curl_handle, CURLOPT_HEADERFUNCTION, write_header);
+    curl_slist_free_all(m_post_headers);
+    m_post_headers = nullptr;
+    m_post_headers = curl_slist_append(m_post_headers, ("content-type: " + ct).c_str());
+    m_post_headers = curl_slist_append(m_post_headers, "Expect:");
+    m_post_headers = curl_slist_append(m_post_headers, chunked ? "transfer-encoding: chunked" : "transfer-encoding:");
+    m_post_headers = curl_slist_append(m_post_headers, get_user_agent_header().c_str());
+    m_post_content_type = ct;
+    m_post_chunked = chunked;
+    return m_post_headers;
+}
 
-#ifndef NDEBUG
-    curl_easy_setopt(m_curl_handle, CURLOPT_VERBOSE, 1);
-    curl_easy_setopt(m_curl_handle, CURLOPT_DEBUGFUNCTION, rt_curl_debug_callback);
-#endif
+bool runtime::perform(http_request const& request, std::chrono::microseconds& wait)
+{
+    curl_easy_setopt(m_curl_handle, CURLOPT_URL, request.url->c_str());
+    if (request.stream) {
+        // without post fields curl pulls the body through read_stream, one chunk per call
+        curl_easy_setopt(m_curl_handle, CURLOPT_POST, 1L);
+        curl_easy_setopt(m_curl_handle, CURLOPT_HTTPHEADER, get_post_headers(*request.content_type, true));
+        curl_easy_setopt(m_curl_handle, CURLOPT_POSTFIELDS, nullptr);
+        curl_easy_setopt(m_curl_handle, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(-1));
+        curl_easy_setopt(m_curl_handle, CURLOPT_READDATA, request.stream);
+    }
+    else if (request.payload) {
+        // curl sends straight out of the payload and adds the content-length header itself
+        curl_easy_setopt(m_curl_handle, CURLOPT_POST, 1L);
+        curl_easy_setopt(m_curl_handle, CURLOPT_HTTPHEADER, get_post_headers(*request.content_type, false));
+        curl_easy_setopt(m_curl_handle, CURLOPT_POSTFIELDS, request.payload->data());
+        curl_easy_setopt(m_curl_handle, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(request.payload->size()));
+    }
+    else {
+        curl_easy_setopt(m_curl_handle, CURLOPT_HTTPGET, 1L);
+        curl_easy_setopt(m_curl_handle, CURLOPT_HTTPHEADER, m_next_headers);
+    }
+
+    // curl silently sends a request again if the connection it reused was closed without an answer
+    curl_socket_t reused = CURL_SOCKET_BAD;
+    curl_easy_getinfo(m_curl_handle, CURLINFO_ACTIVESOCKET, &reused);
+    CURLcode curl_code = curl_easy_perform(m_curl_handle);
+    long connects = 0;
+    curl_easy_getinfo(m_curl_handle, CURLINFO_NUM_CONNECTS, &connects);
+    m_resent = reused != CURL_SOCKET_BAD && connects > 0;
+    if (curl_code != CURLE_OK) {
+        logging::log_debug(LOG_TAG, "CURL returned error code %d - %s", curl_code, curl_easy_strerror(curl_code));
+        return false;
+    }
+
+    long resp_code;
+    curl_easy_getinfo(m_curl_handle, CURLINFO_RESPONSE_CODE, &resp_code);
+    m_response.set_response_code(static_cast<aws::http::response_code>(resp_code));
+
+    // curl reports when the first byte arrived, relative to the start of the request
+    double first_byte = 0;
+    curl_easy_getinfo(m_curl_handle, CURLINFO_STARTTRANSFER_TIME, &first_byte);
+    wait = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::duration<double>(first_byte));
+    return true;
 }
+#endif
 
 runtime::next_outcome runtime::get_next()
 {
-    http::response resp;
-    set_curl_next_options();
-    curl_easy_setopt(m_curl_handle, CURLOPT_WRITEDATA, &resp);
-    curl_easy_setopt(m_curl_handle, CURLOPT_HEADERDATA, &resp);
-
-    curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, get_user_agent_header().c_str());
+    http::response& resp = m_response;
+    resp.clear();
+    m_body = body_target{&resp, m_sink, false, false, 0};
 
     logging::log_debug(LOG_TAG, "Making request to %s", m_endpoints[Endpoints::NEXT].c_str());
-    CURLcode curl_code = curl_easy_perform(m_curl_handle);
+    if (!m_interrupter.begin_wait()) {
+        return aws::http::response_code::REQUEST_NOT_MADE;
+    }
+    auto const start = std::chrono::steady_clock::now();
+    std::chrono::microseconds wait{0};
+    bool const received = perform(http_request{"GET", &m_endpoints[Endpoints::NEXT], nullptr, nullptr, nullptr}, wait);
+    m_interrupter.end_wait();
+    auto const elapsed = std::chrono::steady_clock::now() - start;
     logging::log_debug(LOG_TAG, "Completed request to %s", m_endpoints[Endpoints::NEXT].c_str());
-    curl_slist_free_all(headers);
+    body_target const body = m_body;
+    m_body = body_target{&resp, nullptr, false, false, 0};
 
-    if (curl_code != CURLE_OK) {
-        logging::log_debug(LOG_TAG, "CURL returned error code %d - %s", curl_code, curl_easy_strerror(curl_code));
+    if (!received) {
         logging::log_error(LOG_TAG, "Failed to get next invocation. No Response from endpoint");
         return aws::http::response_code::REQUEST_NOT_MADE;
     }
 
-    {
-        long resp_code;
-        curl_easy_getinfo(m_curl_handle, CURLINFO_RESPONSE_CODE, &resp_code);
-        resp.set_response_code(static_cast<aws::http::response_code>(resp_code));
-    }
-
-    {
-        char* content_type = nullptr;
-        curl_easy_getinfo(m_curl_handle, CURLINFO_CONTENT_TYPE, &content_type);
-        resp.set_content_type(content_type);
+    if (resp.has_header("content-type")) {
+        resp.set_content_type(resp.get_header("content-type").c_str());
     }
 
     if (!is_success(resp.get_response_code())) {
@@ -284,103 +990,128 @@ runtime::next_outcome runtime::get_next()
         return resp.get_response_code();
     }
 
-    if (!resp.has_header(REQUEST_ID_HEADER)) {
-        logging::log_error(LOG_TAG, "Failed to find header %s in response", REQUEST_ID_HEADER);
+    if (!resp.has_header(http::lambda_header::request_id)) {
+        logging::log_error(LOG_TAG, "Failed to find header lambda-runtime-aws-request-id in response");
         return aws::http::response_code::REQUEST_NOT_MADE;
     }
+    if (m_sink && !body.decided) {
+        m_sink->begin(0); // an empty payload, the sink has seen no body
+    }
     invocation_request req;
-    req.payload = resp.get_body();
-    req.request_id = resp.get_header(REQUEST_ID_HEADER);
+    req.payload = resp.take_body();
+    {
+        // the rest of the request after the first byte arrived was spent receiving the invocation
+        auto const total = std::chrono::duration_cast<std::chrono::microseconds>(elapsed);
+        req.metrics.next_wait = std::min(wait, total);
+        req.metrics.body_receipt = total - req.metrics.next_wait;
+        req.metrics.bytes_in = body.bytes;
+    }
+    req.request_id = resp.get_header(http::lambda_header::request_id);
 
-    if (resp.has_header(TRACE_ID_HEADER)) {
-        req.xray_trace_id = resp.get_header(TRACE_ID_HEADER);
+    if (resp.has_header(http::lambda_header::trace_id)) {
+        req.xray_trace_id = resp.get_header(http::lambda_header::trace_id);
     }
 
-    if (resp.has_header(CLIENT_CONTEXT_HEADER)) {
-        req.client_context = resp.get_header(CLIENT_CONTEXT_HEADER);
+    if (resp.has_header(http::lambda_header::client_context)) {
+        req.client_context = resp.get_header(http::lambda_header::client_context);
     }
 
-    if (resp.has_header(COGNITO_IDENTITY_HEADER)) {
-        req.cognito_identity = resp.get_header(COGNITO_IDENTITY_HEADER);
+    if (resp.has_header(http::lambda_header::cognito_identity)) {
+        req.cognito_identity = resp.get_header(http::lambda_header::cognito_identity);
     }
 
-    if (resp.has_header(FUNCTION_ARN_HEADER)) {
-        req.function_arn = resp.get_header(FUNCTION_ARN_HEADER);
+    if (resp.has_header(http::lambda_header::function_arn)) {
+        req.function_arn = resp.get_header(http::lambda_header::function_arn);
     }
 
-    if (resp.has_header(DEADLINE_MS_HEADER)) {
-        auto const& deadline_string = resp.get_header(DEADLINE_MS_HEADER);
+    if (resp.has_header(http::lambda_header::deadline_ms)) {
+        auto const& deadline_string = resp.get_header(http::lambda_header::deadline_ms);
         unsigned long ms = strtoul(deadline_string.c_str(), nullptr, 10);
         assert(ms > 0);
         assert(ms < ULONG_MAX);
         req.deadline += std::chrono::milliseconds(ms);
-        logging::log_info(
-            LOG_TAG,
-            "Received payload: %s\nTime remaining: %ld",
-            req.payload.c_str(),
-            req.get_time_remaining().count());
+        // the payload is logged truncated and only for one in every m_payload_log_sampling invocations, so logging
+        // never scales with payload size
+        if (m_payload_log_sampling && m_invocations % m_payload_log_sampling == 0) {
+            logging::log_info(
+                LOG_TAG,
+                "Received payload (%zu bytes): %.*s%s\nTime remaining: %ld",
+                body.bytes,
+                static_cast<int>(std::min(req.payload.length(), MAX_LOGGED_PAYLOAD)),
+                req.payload.data(),
+                req.payload.length() > MAX_LOGGED_PAYLOAD ? "..." : "",
+                req.get_time_remaining().count());
+        }
     }
-    return next_outcome(req);
+    m_invocations++;
+    return next_outcome(std::move(req));
 }
 
-runtime::post_outcome runtime::post_success(std::string const& request_id, invocation_response const& handler_response)
+runtime::post_outcome runtime::post_success(
+    std::string const& request_id,
+    invocation_response const& handler_response,
+    invocation_metrics& metrics)
 {
     std::string const url = m_endpoints[Endpoints::RESULT] + request_id + "/response";
-    return do_post(url, request_id, handler_response);
+    bool aborted = false;
+    auto outcome = do_post(url, request_id, handler_response, metrics, aborted);
+    if (aborted) {
+        // nothing complete reached the endpoint, so the invocation can still be failed explicitly
+        logging::log_error(LOG_TAG, "The handler aborted its streamed response for invocation %s", request_id.c_str());
+        return post_failure(
+            request_id,
+            invocation_response::failure("The handler aborted its streamed response", "StreamAborted"),
+            metrics);
+    }
+    return outcome;
 }
 
-runtime::post_outcome runtime::post_failure(std::string const& request_id, invocation_response const& handler_response)
+runtime::post_outcome runtime::post_failure(
+    std::string const& request_id,
+    invocation_response const& handler_response,
+    invocation_metrics& metrics)
 {
     std::string const url = m_endpoints[Endpoints::RESULT] + request_id + "/error";
-    return do_post(url, request_id, handler_response);
+    bool aborted = false;
+    return do_post(url, request_id, handler_response, metrics, aborted);
+}
+
+runtime::post_outcome runtime::post_init_error(invocation_response const& init_response)
+{
+    invocation_metrics metrics;
+    bool aborted = false;
+    return do_post(m_endpoints[Endpoints::INIT], "init", init_response, metrics, aborted);
 }
 
 runtime::post_outcome runtime::do_post(
     std::string const& url,
     std::string const& request_id,
-    invocation_response const& handler_response)
+    invocation_response const& handler_response,
+    invocation_metrics& metrics,
+    bool& stream_aborted)
 {
-    set_curl_post_result_options();
-    curl_easy_setopt(m_curl_handle, CURLOPT_URL, url.c_str());
+    bool const streaming = handler_response.is_streaming();
+    stream_state stream{&handler_response.get_producer(), 0, false};
+    m_response.clear();
+    m_body = body_target{&m_response, nullptr, false, false, 0};
+    byte_view const payload = handler_response.get_payload_bytes();
+    http_request const request{
+        "POST", &url, &handler_response.get_content_type(), streaming ? nullptr : &payload, streaming ? &stream : nullptr};
     logging::log_info(LOG_TAG, "Making request to %s", url.c_str());
 
-    curl_slist* headers = nullptr;
-    if (handler_response.get_content_type().empty()) {
-        headers = curl_slist_append(headers, "content-type: text/html");
-    }
-    else {
-        headers = curl_slist_append(headers, ("content-type: " + handler_response.get_content_type()).c_str());
-    }
-
-    headers = curl_slist_append(headers, "Expect:");
-    headers = curl_slist_append(headers, "transfer-encoding:");
-    headers = curl_slist_append(headers, get_user_agent_header().c_str());
-    auto const& payload = handler_response.get_payload();
-    logging::log_debug(
-        LOG_TAG, "calculating content length... %s", ("content-length: " + std::to_string(payload.length())).c_str());
-    headers = curl_slist_append(headers, ("content-length: " + std::to_string(payload.length())).c_str());
-
-    std::pair<std::string const&, size_t> ctx{payload, 0};
-    aws::http::response resp;
-    curl_easy_setopt(m_curl_handle, CURLOPT_WRITEDATA, &resp);
-    curl_easy_setopt(m_curl_handle, CURLOPT_HEADERDATA, &resp);
-    curl_easy_setopt(m_curl_handle, CURLOPT_READDATA, &ctx);
-    curl_easy_setopt(m_curl_handle, CURLOPT_HTTPHEADER, headers);
-    CURLcode curl_code = curl_easy_perform(m_curl_handle);
-    curl_slist_free_all(headers);
+    auto const start = std::chrono::steady_clock::now();
+    std::chrono::microseconds wait{0};
+    bool const received = perform(request, wait);
+    metrics.post += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    metrics.bytes_out += streaming ? stream.bytes : payload.size();
+    stream_aborted = stream.aborted;
 
-    if (curl_code != CURLE_OK) {
-        logging::log_debug(
-            LOG_TAG,
-            "CURL returned error code %d - %s, for invocation %s",
-            curl_code,
-            curl_easy_strerror(curl_code),
-            request_id.c_str());
+    if (!received) {
+        logging::log_debug(LOG_TAG, "No response to the request for invocation %s", request_id.c_str());
         return aws::http::response_code::REQUEST_NOT_MADE;
     }
 
-    long http_response_code;
-    curl_easy_getinfo(m_curl_handle, CURLINFO_RESPONSE_CODE, &http_response_code);
+    long const http_response_code = static_cast<long>(m_response.get_response_code());
 
     if (!is_success(aws::http::response_code(http_response_code))) {
         logging::log_error(
@@ -410,62 +1141,500 @@ static bool handle_post_outcome(runtime::post_outcome const& o, std::string cons
     return false;
 }
 
+static std::string json_escape(std::string const& in);
+
+// One embedded metric format record per invocation, see
+// https://docs.aws.amazon.com/AmazonCloudWatch/latest/monitoring/CloudWatch_Embedded_Metric_Format_Specification.html
+// The record is longer than a log slot; the logger carries it whole.
+static void log_emf(std::string const& request_id, invocation_metrics const& m)
+{
+    auto const timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    char metrics[1024];
+    int const length = snprintf(
+        metrics,
+        sizeof(metrics),
+        R"({"_aws":{"Timestamp":%lld,"CloudWatchMetrics":[{"Namespace":"aws-lambda-cpp","Dimensions":[[]],)"
+        R"("Metrics":[{"Name":"NextWait","Unit":"Microseconds"},{"Name":"BodyReceipt","Unit":"Microseconds"},)"
+        R"({"Name":"Handler","Unit":"Microseconds"},{"Name":"Post","Unit":"Microseconds"},)"
+        R"({"Name":"BytesIn","Unit":"Bytes"},{"Name":"BytesOut","Unit":"Bytes"},)"
+        R"({"Name":"ArenaBytes","Unit":"Bytes"},{"Name":"ArenaAllocations","Unit":"Count"}]}]},)"
+        R"("NextWait":%lld,"BodyReceipt":%lld,"Handler":%lld,"Post":%lld,"BytesIn":%zu,)"
+        R"("BytesOut":%zu,"ArenaBytes":%zu,"ArenaAllocations":%zu,"requestId":")",
+        static_cast<long long>(timestamp.count()),
+        static_cast<long long>(m.next_wait.count()),
+        static_cast<long long>(m.body_receipt.count()),
+        static_cast<long long>(m.handler.count()),
+        static_cast<long long>(m.post.count()),
+        m.bytes_in,
+        m.bytes_out,
+        m.arena_bytes,
+        m.arena_allocations);
+    if (length <= 0 || static_cast<size_t>(length) >= sizeof(metrics)) {
+        return;
+    }
+    // the request id comes from the endpoint and has no bound, so it is appended rather than formatted
+    std::string record(metrics, static_cast<size_t>(length));
+    record += json_escape(request_id);
+    record += "\"}";
+    logging::write(record.c_str(), record.size());
+}
+
+static void log_init_emf(std::chrono::microseconds duration, std::chrono::microseconds snapshot_load)
+{
+    auto const timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch());
+    char record[320];
+    int const length = snprintf(
+        record,
+        sizeof(record),
+        R"({"_aws":{"Timestamp":%lld,"CloudWatchMetrics":[{"Namespace":"aws-lambda-cpp","Dimensions":[[]],)"
+        R"("Metrics":[{"Name":"Init","Unit":"Microseconds"},{"Name":"SnapshotLoad","Unit":"Microseconds"}]}]},)"
+        R"("Init":%lld,"SnapshotLoad":%lld})",
+        static_cast<long long>(timestamp.count()),
+        static_cast<long long>(duration.count()),
+        static_cast<long long>(snapshot_load.count()));
+    if (length > 0 && static_cast<size_t>(length) < sizeof(record)) {
+        logging::write(record, static_cast<size_t>(length));
+    }
+}
+
+static void publish_metrics(
+    runtime_options const& options,
+    std::string const& request_id,
+    invocation_metrics const& metrics)
+{
+    if (options.log_metrics) {
+        log_emf(request_id, metrics);
+    }
+    if (options.on_metrics) {
+        options.on_metrics(request_id, metrics);
+    }
+}
+
+enum class post_status {
+    posted,
+    /**
+     * The result didn't reach the endpoint or was rejected; the runtime carries on with the next invocation.
+     */
+    dropped,
+    /**
+     * The runtime API reported the sandbox as broken, the runtime must stop.
+     */
+    fatal,
+};
+
+// Posts one result, retrying transient failures according to options.retries. A retry resends the same response for
+// the same request id, so the endpoint sees at most one result per invocation: if an attempt failed without an answer
+// it may still have been delivered, and a 4xx for the next attempt is taken as the endpoint refusing a second result.
+// The same holds for an attempt the transport itself sent twice.
+// 'pulled' is set once the producer of a streamed response has been called, after which it can't be sent again.
+static post_status post_with_retries(
+    runtime& rt,
+    runtime_options const& options,
+    std::string const& request_id,
+    invocation_response const& res,
+    bool const& pulled,
+    invocation_metrics& metrics)
+{
+    bool maybe_delivered = false;
+    for (size_t attempt = 1;; attempt++) {
+        auto const outcome = res.is_success() ? rt.post_success(request_id, res, metrics)
+                                              : rt.post_failure(request_id, res, metrics);
+        if (handle_post_outcome(outcome, request_id)) {
+            return post_status::posted;
+        }
+
+        auto const code = outcome.get_failure();
+        int const numeric_code = static_cast<int>(code);
+        maybe_delivered = maybe_delivered || rt.last_request_resent();
+        if (maybe_delivered && numeric_code >= 400 && numeric_code < 500 &&
+            code != aws::http::response_code::REQUEST_ENTITY_TOO_LARGE) {
+            logging::log_info(
+                LOG_TAG, "The result of invocation %s was already delivered by an earlier attempt.", request_id.c_str());
+            return post_status::posted;
+        }
+        if (code == aws::http::response_code::INTERNAL_SERVER_ERROR) {
+            logging::log_error(LOG_TAG, "The runtime API reported a non-recoverable error. Exiting!");
+            return post_status::fatal;
+        }
+        if (!is_transient(code) || pulled || attempt >= options.retries.max_attempts) {
+            logging::log_error(LOG_TAG, "Dropping the result of invocation %s.", request_id.c_str());
+            return post_status::dropped;
+        }
+
+        maybe_delivered = maybe_delivered || code == aws::http::response_code::REQUEST_NOT_MADE ||
+                          code == aws::http::response_code::GATEWAY_TIMEOUT;
+        back_off(options.retries, attempt);
+    }
+}
+
+// Posts one result and publishes its metrics, then releases the invocation's arena, which the result may have been
+// streamed from.
+static post_status post_result(
+    runtime& rt,
+    runtime_options const& options,
+    std::string const& request_id,
+    invocation_response const& res,
+    invocation_metrics& metrics,
+    invocation_arena& arena)
+{
+    logging::set_context(request_id.c_str(), "post");
+    bool pulled = false;
+    post_status status;
+    if (res.is_streaming()) {
+        auto const guarded = invocation_response::stream(
+            [&res, &pulled](char* buffer, size_t size) {
+                pulled = true;
+                return res.get_producer()(buffer, size);
+            },
+            res.get_content_type());
+        status = post_with_retries(rt, options, request_id, guarded, pulled, metrics);
+    }
+    else {
+        status = post_with_retries(rt, options, request_id, res, pulled, metrics);
+    }
+
+    arena_stats const used = arena.stats();
+    metrics.arena_bytes = used.bytes;
+    metrics.arena_allocations = used.allocations;
+    arena.reset();
+    publish_metrics(options, request_id, metrics);
+    // the sandbox may be frozen as soon as the next invocation is requested
+    logging::flush(LOG_FLUSH_TIMEOUT);
+    logging::set_context(nullptr, nullptr);
+    return status;
+}
+
+// Restores the snapshot, runs the init callback and reports how long it took, then saves the snapshot if init computed
+// any of its state. A failure is posted to the init error endpoint, in which case false is returned and no invocation
+// must be requested.
+static bool run_init(runtime& rt, init_handler const& init, runtime_options const& options)
+{
+    logging::set_context(nullptr, "init");
+    std::chrono::microseconds snapshot_load{0};
+    if (options.snapshot) {
+        options.snapshot->load();
+        snapshot_load = options.snapshot->stats().load_duration;
+    }
+
+    bool initialized = true;
+    if (init) {
+        logging::log_info(LOG_TAG, "Invoking user init");
+        auto const start = std::chrono::steady_clock::now();
+        invocation_response const res = init();
+        auto const duration =
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        logging::log_info(LOG_TAG, "User init completed in %lld us.", static_cast<long long>(duration.count()));
+
+        if (options.log_metrics) {
+            log_init_emf(duration, snapshot_load);
+        }
+        if (options.on_init_metrics) {
+            options.on_init_metrics(duration);
+        }
+
+        initialized = res.is_success();
+        if (!initialized) {
+            logging::log_error(LOG_TAG, "User init failed: %s", res.get_payload().c_str());
+            handle_post_outcome(rt.post_init_error(res), "init");
+        }
+    }
+
+    if (initialized && options.snapshot && !options.snapshot->complete()) {
+        options.snapshot->save();
+    }
+    logging::flush(LOG_FLUSH_TIMEOUT);
+    logging::set_context(nullptr, nullptr);
+    return initialized;
+}
+
+/**
+ * Posts results from its own runtime, i.e. its own connection, on a background thread. At most one result is in
+ * flight at a time, so results reach the endpoint in the order they were handed over.
+ */
+class pipelined_poster {
+public:
+    pipelined_poster(std::string const& endpoint, runtime_options const& options);
+    ~pipelined_poster();
+
+    /**
+     * Wait for the previous result to be posted, then hand over the next one, which is posted with its invocation's
+     * arena. Returns false without taking the result if posting the previous one failed fatally.
+     */
+    bool post(
+        std::string request_id,
+        invocation_response res,
+        invocation_metrics const& metrics,
+        invocation_arena& arena);
+
+private:
+    void loop();
+
+    runtime m_runtime;
+    runtime_options const& m_options;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::string m_request_id;
+    std::unique_ptr<invocation_response> m_pending;
+    invocation_metrics m_metrics;
+    invocation_arena* m_arena;
+    bool m_failed;
+    bool m_stopping;
+    std::thread m_thread; // last, so it only starts once everything it uses is constructed
+};
+
+pipelined_poster::pipelined_poster(std::string const& endpoint, runtime_options const& options)
+    : m_runtime(endpoint),
+      m_options(options),
+      m_arena(nullptr),
+      m_failed(false),
+      m_stopping(false),
+      m_thread([this] { loop(); })
+{
+}
+
+pipelined_poster::~pipelined_poster()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    m_thread.join(); // posts whatever is still pending first
+}
+
+bool pipelined_poster::post(
+    std::string request_id,
+    invocation_response res,
+    invocation_metrics const& metrics,
+    invocation_arena& arena)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return !m_pending; });
+    if (m_failed) {
+        return false;
+    }
+    m_request_id = std::move(request_id);
+    m_pending.reset(new invocation_response(std::move(res)));
+    m_metrics = metrics;
+    m_arena = &arena;
+    m_cv.notify_all();
+    return true;
+}
+
+void pipelined_poster::loop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_cv.wait(lock, [this] { return m_pending || m_stopping; });
+        if (!m_pending) {
+            return;
+        }
+        lock.unlock();
+        auto const status = post_result(m_runtime, m_options, m_request_id, *m_pending, m_metrics, *m_arena);
+        lock.lock();
+        m_failed = m_failed || status == post_status::fatal;
+        m_pending.reset();
+        m_cv.notify_all();
+    }
+}
+
 AWS_LAMBDA_RUNTIME_API
 void run_handler(std::function<invocation_response(invocation_request const&)> const& handler)
 {
-    logging::log_info(LOG_TAG, "Initializing the C++ Lambda Runtime.");
-    std::string endpoint("http://");
-    if (auto ep = std::getenv("AWS_LAMBDA_RUNTIME_API")) {
-        assert(ep);
-        logging::log_debug(LOG_TAG, "LAMBDA_SERVER_ADDRESS defined in environment as: %s", ep);
-        endpoint += ep;
-    }
+    run_handler(handler, runtime_options{});
+}
 
-    runtime rt(endpoint);
+AWS_LAMBDA_RUNTIME_API
+void run_handler(
+    std::function<invocation_response(invocation_request const&)> const& handler,
+    runtime_options const& options)
+{
+    run_consuming_handler([&handler](invocation_request&& req) { return handler(req); }, options);
+}
+
+AWS_LAMBDA_RUNTIME_API
+void run_handler(
+    init_handler const& init,
+    std::function<invocation_response(invocation_request const&)> const& handler)
+{
+    run_handler(init, handler, runtime_options{});
+}
+
+AWS_LAMBDA_RUNTIME_API
+void run_handler(
+    init_handler const& init,
+    std::function<invocation_response(invocation_request const&)> const& handler,
+    runtime_options const& options)
+{
+    run_consuming_handler(init, [&handler](invocation_request&& req) { return handler(req); }, options);
+}
 
-    size_t retries = 0;
-    size_t const max_retries = 3;
+AWS_LAMBDA_RUNTIME_API
+void run_consuming_handler(std::function<invocation_response(invocation_request&&)> const& handler)
+{
+    run_consuming_handler(init_handler{}, handler, runtime_options{});
+}
 
-    while (retries < max_retries) {
-        const auto next_outcome = rt.get_next();
+AWS_LAMBDA_RUNTIME_API
+void run_consuming_handler(
+    std::function<invocation_response(invocation_request&&)> const& handler,
+    runtime_options const& options)
+{
+    run_consuming_handler(init_handler{}, handler, options);
+}
+
+AWS_LAMBDA_RUNTIME_API
+void run_consuming_handler(
+    init_handler const& init,
+    std::function<invocation_response(invocation_request&&)> const& handler)
+{
+    run_consuming_handler(init, handler, runtime_options{});
+}
+
+// Requests and handles invocations on its own connection until it fails fatally or another worker did. A worker that
+// stops interrupts the others' requests for their next invocation, so none of them takes on another one.
+static void run_worker(
+    runtime& rt,
+    std::string const& endpoint,
+    size_t worker,
+    std::function<invocation_response(invocation_request&&)> const& handler,
+    runtime_options const& options,
+    std::atomic<bool>& stopping,
+    std::vector<runtime*> const& workers)
+{
+    struct stop_all {
+        std::atomic<bool>& stopping;
+        std::vector<runtime*> const& workers;
+        ~stop_all()
+        {
+            stopping = true;
+            for (auto other : workers) {
+                other->interrupt();
+            }
+        }
+    } const stop_others{stopping, workers};
+
+    // while a result is posted in the background the next handler already runs, so the two take turns with two
+    // arenas; the poster is done with one before the handler after next gets it
+    invocation_arena first_arena(options.arena_block_size);
+    invocation_arena second_arena(options.arena_block_size);
+    invocation_arena* const arenas[] = {&first_arena, &second_arena};
+    size_t invocations = 0;
+
+    std::unique_ptr<pipelined_poster> poster;
+    if (options.pipeline_posts) {
+        logging::log_info(LOG_TAG, "Posting results in the background.");
+        poster.reset(new pipelined_poster(endpoint, options));
+    }
+
+    size_t failures = 0;
+    while (!stopping) {
+        logging::set_context(nullptr, "next");
+        auto next_outcome = rt.get_next();
         if (!next_outcome.is_success()) {
-            if (next_outcome.get_failure() == aws::http::response_code::REQUEST_NOT_MADE) {
-                ++retries;
-                continue;
+            if (stopping) {
+                return; // interrupted
+            }
+            auto const code = next_outcome.get_failure();
+            if (!is_transient(code)) {
+                logging::log_error(
+                    LOG_TAG,
+                    "HTTP request was not successful. HTTP response code: %d. Exiting!",
+                    static_cast<int>(code));
+                return;
+            }
+            if (++failures >= options.retries.max_attempts) {
+                logging::log_error(
+                    LOG_TAG, "Exhausted all %zu attempts to get the next invocation. Exiting!", failures);
+                return;
             }
 
             logging::log_info(
                 LOG_TAG,
                 "HTTP request was not successful. HTTP response code: %d. Retrying..",
-                static_cast<int>(next_outcome.get_failure()));
-            ++retries;
+                static_cast<int>(code));
+            back_off(options.retries, failures);
             continue;
         }
 
-        retries = 0;
+        failures = 0;
 
-        auto const& req = next_outcome.get_result();
+        // the handler may consume the request, so hold on to what's needed to post its result
+        invocation_request req = std::move(next_outcome).get_result();
+        invocation_arena& arena = *arenas[poster ? invocations++ % 2 : 0];
+        req.arena = &arena;
+        req.worker = worker;
+        std::string request_id = req.request_id;
+        invocation_metrics metrics = req.metrics;
+        logging::set_context(request_id.c_str(), "handler");
         logging::log_info(LOG_TAG, "Invoking user handler");
-        invocation_response res = handler(req);
+        auto const handler_start = std::chrono::steady_clock::now();
+        invocation_response res = handler(std::move(req));
+        metrics.handler = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - handler_start);
         logging::log_info(LOG_TAG, "Invoking user handler completed.");
 
-        if (res.is_success()) {
-            const auto post_outcome = rt.post_success(req.request_id, res);
-            if (!handle_post_outcome(post_outcome, req.request_id)) {
-                return; // TODO: implement a better retry strategy
+        if (poster) {
+            if (!poster->post(std::move(request_id), std::move(res), metrics, arena)) {
+                return;
             }
         }
-        else {
-            const auto post_outcome = rt.post_failure(req.request_id, res);
-            if (!handle_post_outcome(post_outcome, req.request_id)) {
-                return; // TODO: implement a better retry strategy
-            }
+        else if (post_result(rt, options, request_id, res, metrics, arena) == post_status::fatal) {
+            return;
         }
     }
+}
 
-    if (retries == max_retries) {
-        logging::log_error(
-            LOG_TAG, "Exhausted all retries. This is probably a bug in libcurl v" LIBCURL_VERSION " Exiting!");
+AWS_LAMBDA_RUNTIME_API
+void run_consuming_handler(
+    init_handler const& init,
+    std::function<invocation_response(invocation_request&&)> const& handler,
+    runtime_options const& options)
+{
+    logging::log_info(LOG_TAG, "Initializing the C++ Lambda Runtime.");
+    install_crash_handler();
+    std::string endpoint("http://");
+    if (auto ep = std::getenv("AWS_LAMBDA_RUNTIME_API")) {
+        assert(ep);
+        logging::log_debug(LOG_TAG, "LAMBDA_SERVER_ADDRESS defined in environment as: %s", ep);
+        endpoint += ep;
+    }
+
+    runtime rt(endpoint);
+    if ((init || options.snapshot) && !run_init(rt, init, options)) {
+        return;
+    }
+
+    size_t workers = std::max<size_t>(options.workers, 1);
+    if (workers > 1 && options.sink) {
+        logging::log_error(LOG_TAG, "A payload sink can't tell the invocations of several workers apart. Running one.");
+        workers = 1;
+    }
+    rt.set_payload_sink(options.sink);
+
+    std::atomic<bool> stopping{false};
+    // every worker's runtime outlives all workers, so a stopping worker can interrupt the others
+    std::vector<std::unique_ptr<runtime>> worker_runtimes;
+    std::vector<runtime*> all{&rt};
+    for (size_t worker = 1; worker < workers; worker++) {
+        worker_runtimes.emplace_back(new runtime(endpoint));
+        all.push_back(worker_runtimes.back().get());
+    }
+    std::vector<std::thread> threads;
+    if (workers > 1) {
+        logging::log_info(LOG_TAG, "Running %zu workers.", workers);
+    }
+    for (size_t worker = 1; worker < workers; worker++) {
+        threads.emplace_back([&endpoint, &handler, &options, &stopping, &all, worker] {
+            install_crash_stack();
+            run_worker(*all[worker], endpoint, worker, handler, options, stopping, all);
+        });
+    }
+    run_worker(rt, endpoint, 0, handler, options, stopping, all);
+    for (auto& thread : threads) {
+        thread.join();
     }
 }
 
@@ -474,7 +1643,8 @@ static std::string json_escape(std::string const& in)
     std::string out;
     out.reserve(in.length()); // most strings will end up identical
     for (char ch : in) {
-        if (ch > 31 && ch != '\"' && ch != '\\') {
+        // compare as unsigned, the bytes of multi-byte UTF-8 sequences are above 127 and copied as they are
+        if (static_cast<unsigned char>(ch) > 31 && ch != '\"' && ch != '\\') {
             out.append(1, ch);
         }
         else {
@@ -523,6 +1693,46 @@ invocation_response invocation_response::success(std::string const& payload, std
     return r;
 }
 
+AWS_LAMBDA_RUNTIME_API
+invocation_response invocation_response::success(std::string&& payload, std::string const& content_type)
+{
+    invocation_response r;
+    r.m_success = true;
+    r.m_content_type = content_type;
+    r.m_payload = std::move(payload);
+    return r;
+}
+
+AWS_LAMBDA_RUNTIME_API
+invocation_response invocation_response::success(byte_view payload, std::string const& content_type)
+{
+    invocation_response r;
+    r.m_success = true;
+    r.m_content_type = content_type;
+    r.m_payload.assign(reinterpret_cast<char const*>(payload.data()), payload.size());
+    return r;
+}
+
+AWS_LAMBDA_RUNTIME_API
+invocation_response invocation_response::success(std::vector<uint8_t>&& payload, std::string const& content_type)
+{
+    invocation_response r;
+    r.m_success = true;
+    r.m_content_type = content_type;
+    r.m_bytes = std::move(payload);
+    return r;
+}
+
+AWS_LAMBDA_RUNTIME_API
+invocation_response invocation_response::stream(response_producer producer, std::string const& content_type)
+{
+    invocation_response r;
+    r.m_success = true;
+    r.m_content_type = content_type;
+    r.m_producer = std::move(producer);
+    return r;
+}
+
 AWS_LAMBDA_RUNTIME_API
 invocation_response invocation_response::failure(std::string const& error_message, std::string const& error_type)
 {
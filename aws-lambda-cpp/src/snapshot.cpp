@@ -0,0 +1,384 @@
+/*
+ * Copyright 2018-present Amazon.com, Inc. or its affiliates. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License").
+ * You may not use this file except in compliance with the License.
+ * A copy of the License is located at
+ *
+ *  http://aws.amazon.com/apache2.0
+ *
+ * or in the "license" file accompanying this file. This file is distributed
+ * on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing
+ * permissions and limitations under the License.
+ */
+
+#include "aws/lambda-runtime/snapshot.h"
+#include "aws/logging/logging.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define AWS_LAMBDA_RUNTIME_API __attribute__((visibility("default")))
+
+namespace aws {
+namespace lambda_runtime {
+
+static char const LOG_TAG[] = "LAMBDA_RUNTIME";
+static char const SNAPSHOT_MAGIC[8] = {'L', 'A', 'M', 'B', 'S', 'N', 'A', 'P'};
+// read back on a machine of the other byte order, this is no longer 1 and the file is rejected
+static uint32_t const SNAPSHOT_FORMAT = 1;
+static size_t const SNAPSHOT_ALIGNMENT = 8;
+
+// The file is a file_header followed by one section per component: a section_header, the component's name and its
+// state, the latter two each padded to SNAPSHOT_ALIGNMENT.
+struct file_header {
+    char magic[8];
+    uint32_t format;
+    uint32_t sections;
+    uint64_t size;
+    uint64_t tag;
+};
+
+struct section_header {
+    uint64_t size;
+    uint64_t checksum;
+    uint32_t version;
+    uint32_t name_length;
+};
+
+static size_t padded(size_t size)
+{
+    return (size + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+// FNV-1a over 8-byte words rather than bytes, so validating a large snapshot doesn't cost more than reading it.
+static uint64_t checksum(uint8_t const* data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+    uint64_t const prime = 1099511628211ULL;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * prime;
+    }
+    return hash;
+}
+
+// Identifies the function version the state belongs to.
+static uint64_t snapshot_tag()
+{
+    std::string tag;
+    if (auto name = std::getenv("AWS_LAMBDA_FUNCTION_NAME")) {
+        tag += name;
+    }
+    tag += ':';
+    if (auto version = std::getenv("AWS_LAMBDA_FUNCTION_VERSION")) {
+        tag += version;
+    }
+    tag += ':' + std::to_string(sizeof(void*));
+    return checksum(reinterpret_cast<uint8_t const*>(tag.data()), tag.size());
+}
+
+static bool write_all(int fd, void const* data, size_t size)
+{
+    auto p = static_cast<char const*>(data);
+    while (size > 0) {
+        ssize_t const written = ::write(fd, p, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+static bool write_padding(int fd, size_t size)
+{
+    static char const zeros[SNAPSHOT_ALIGNMENT] = {};
+    return write_all(fd, zeros, padded(size) - size);
+}
+
+static std::chrono::microseconds since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+}
+
+AWS_LAMBDA_RUNTIME_API
+std::string state_snapshot::default_directory()
+{
+    auto const directory = std::getenv("AWS_LAMBDA_SNAPSHOT_DIR");
+    return directory && *directory ? directory : "/tmp";
+}
+
+AWS_LAMBDA_RUNTIME_API
+state_snapshot::state_snapshot(std::string directory) : m_mapping(nullptr), m_mapping_size(0)
+{
+    auto const function = std::getenv("AWS_LAMBDA_FUNCTION_NAME");
+    m_path = std::move(directory) + "/aws-lambda-" + (function && *function ? function : "function") + ".snapshot";
+}
+
+AWS_LAMBDA_RUNTIME_API
+state_snapshot::~state_snapshot()
+{
+    unmap();
+}
+
+void state_snapshot::unmap()
+{
+    m_sections.clear();
+    if (m_mapping) {
+        ::munmap(m_mapping, m_mapping_size);
+        m_mapping = nullptr;
+        m_mapping_size = 0;
+    }
+}
+
+AWS_LAMBDA_RUNTIME_API
+void state_snapshot::add(std::string name, uint32_t version, save_function save, restore_function restore)
+{
+    component* target = nullptr;
+    for (auto& c : m_components) {
+        if (c.name == name) {
+            target = &c;
+            break;
+        }
+    }
+    if (!target) {
+        m_components.push_back(component{std::move(name), 0, nullptr, nullptr, false});
+        target = &m_components.back();
+    }
+    if (target->restored) {
+        m_stats.restored--;
+    }
+    target->version = version;
+    target->save = std::move(save);
+    target->restore = std::move(restore);
+    target->restored = false;
+    if (m_mapping) {
+        this->restore(*target);
+    }
+}
+
+bool state_snapshot::restore(component& c)
+{
+    for (auto const& s : m_sections) {
+        if (s.name != c.name || s.version != c.version) {
+            continue;
+        }
+        if (c.restore && c.restore(byte_view(s.data, s.size))) {
+            c.restored = true;
+            m_stats.restored++;
+        }
+        else {
+            logging::log_info(LOG_TAG, "Component %s couldn't be restored from the snapshot.", c.name.c_str());
+        }
+        return c.restored;
+    }
+    logging::log_debug(LOG_TAG, "The snapshot holds no state for component %s.", c.name.c_str());
+    return false;
+}
+
+AWS_LAMBDA_RUNTIME_API
+bool state_snapshot::load()
+{
+    auto const start = std::chrono::steady_clock::now();
+    unmap();
+    m_stats.loaded = false;
+    m_stats.bytes = 0;
+    m_stats.restored = 0;
+    for (auto& c : m_components) {
+        c.restored = false;
+    }
+
+    int const fd = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        logging::log_info(LOG_TAG, "No snapshot at %s.", m_path.c_str());
+        m_stats.load_duration = since(start);
+        return false;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(file_header)) {
+        ::close(fd);
+        logging::log_info(LOG_TAG, "Ignoring the snapshot at %s: truncated.", m_path.c_str());
+        m_stats.load_duration = since(start);
+        return false;
+    }
+    void* const mapping = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        logging::log_error(LOG_TAG, "Failed to map the snapshot at %s.", m_path.c_str());
+        m_stats.load_duration = since(start);
+        return false;
+    }
+    m_mapping = mapping;
+    m_mapping_size = static_cast<size_t>(st.st_size);
+
+    auto const base = static_cast<uint8_t const*>(m_mapping);
+    file_header header;
+    std::memcpy(&header, base, sizeof(header));
+    char const* problem = nullptr;
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header.format != SNAPSHOT_FORMAT) {
+        problem = "not a snapshot of this format";
+    }
+    else if (header.size != m_mapping_size) {
+        problem = "truncated";
+    }
+    else if (header.tag != snapshot_tag()) {
+        problem = "taken by another function version";
+    }
+
+    size_t offset = sizeof(file_header);
+    for (uint32_t i = 0; !problem && i < header.sections; i++) {
+        section_header sh;
+        if (m_mapping_size - offset < sizeof(sh)) {
+            problem = "truncated";
+            break;
+        }
+        std::memcpy(&sh, base + offset, sizeof(sh));
+        offset += sizeof(sh);
+        size_t const remaining = m_mapping_size - offset;
+        // the raw sizes are checked before they are padded, padding a size close to the maximum wraps around
+        if (sh.name_length > remaining || sh.size > remaining) {
+            problem = "truncated";
+            break;
+        }
+        size_t const name_size = padded(sh.name_length);
+        size_t const state_size = padded(static_cast<size_t>(sh.size));
+        if (remaining < name_size || remaining - name_size < state_size) {
+            problem = "truncated";
+            break;
+        }
+        section s;
+        s.name.assign(reinterpret_cast<char const*>(base + offset), sh.name_length);
+        s.version = sh.version;
+        s.data = base + offset + name_size;
+        s.size = static_cast<size_t>(sh.size);
+        if (checksum(s.data, s.size) != sh.checksum) {
+            problem = "corrupt";
+            break;
+        }
+        offset += name_size + state_size;
+        m_sections.push_back(std::move(s));
+    }
+
+    if (problem) {
+        logging::log_info(LOG_TAG, "Ignoring the snapshot at %s: %s.", m_path.c_str(), problem);
+        unmap();
+        m_stats.load_duration = since(start);
+        return false;
+    }
+
+    m_stats.loaded = true;
+    m_stats.bytes = m_mapping_size;
+    for (auto& c : m_components) {
+        restore(c);
+    }
+    m_stats.load_duration = since(start);
+    logging::log_info(
+        LOG_TAG,
+        "Restored %zu of %zu components from the snapshot at %s (%zu bytes) in %lld us.",
+        m_stats.restored,
+        m_components.size(),
+        m_path.c_str(),
+        m_stats.bytes,
+        static_cast<long long>(m_stats.load_duration.count()));
+    return true;
+}
+
+AWS_LAMBDA_RUNTIME_API
+bool state_snapshot::save()
+{
+    auto const start = std::chrono::steady_clock::now();
+    std::string const tmp = m_path + ".tmp" + std::to_string(::getpid());
+    int const fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        logging::log_error(LOG_TAG, "Failed to create the snapshot %s: %s", tmp.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    // the header is written last, once the sections and the size are known
+    file_header header;
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.format = SNAPSHOT_FORMAT;
+    header.sections = 0;
+    header.size = sizeof(header);
+    header.tag = snapshot_tag();
+    bool ok = write_all(fd, &header, sizeof(header));
+
+    std::string state;
+    for (auto const& c : m_components) {
+        state.clear();
+        if (!ok || !c.save || !c.save(state)) {
+            continue;
+        }
+        section_header sh;
+        sh.size = state.size();
+        sh.checksum = checksum(reinterpret_cast<uint8_t const*>(state.data()), state.size());
+        sh.version = c.version;
+        sh.name_length = static_cast<uint32_t>(c.name.size());
+        ok = write_all(fd, &sh, sizeof(sh)) && write_all(fd, c.name.data(), c.name.size()) &&
+             write_padding(fd, c.name.size()) && write_all(fd, state.data(), state.size()) &&
+             write_padding(fd, state.size());
+        header.sections++;
+        header.size += sizeof(sh) + padded(c.name.size()) + padded(state.size());
+    }
+
+    ok = ok && ::pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+    ok = ::close(fd) == 0 && ok;
+    // renaming over the old file leaves a mapping of it intact
+    if (!ok || std::rename(tmp.c_str(), m_path.c_str()) != 0) {
+        logging::log_error(LOG_TAG, "Failed to write the snapshot %s: %s", m_path.c_str(), std::strerror(errno));
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    m_stats.bytes = static_cast<size_t>(header.size);
+    m_stats.save_duration = since(start);
+    logging::log_info(
+        LOG_TAG,
+        "Saved %u components to the snapshot at %s (%zu bytes) in %lld us.",
+        header.sections,
+        m_path.c_str(),
+        m_stats.bytes,
+        static_cast<long long>(m_stats.save_duration.count()));
+    return true;
+}
+
+AWS_LAMBDA_RUNTIME_API
+bool state_snapshot::restored(std::string const& name) const
+{
+    for (auto const& c : m_components) {
+        if (c.name == name) {
+            return c.restored;
+        }
+    }
+    return false;
+}
+
+AWS_LAMBDA_RUNTIME_API
+bool state_snapshot::complete() const
+{
+    for (auto const& c : m_components) {
+        if (!c.restored) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace lambda_runtime
+} // namespace aws
@@ -0,0 +1,169 @@
+#include <aws/lambda-runtime/arena.h>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+using namespace aws::lambda_runtime;
+
+namespace {
+
+bool is_aligned(void const* p, size_t alignment)
+{
+    return reinterpret_cast<uintptr_t>(p) % alignment == 0;
+}
+
+TEST(ArenaTest, allocations_are_aligned)
+{
+    invocation_arena arena(256);
+    for (size_t alignment = 1; alignment <= 128; alignment *= 2) {
+        for (size_t size : {1u, 3u, 8u, 17u}) {
+            void* const p = arena.allocate(size, alignment);
+            ASSERT_TRUE(is_aligned(p, alignment)) << size << " bytes aligned to " << alignment;
+        }
+    }
+    ASSERT_TRUE(is_aligned(arena.allocate(1), alignof(std::max_align_t)));
+    // larger than the block size, so it gets a block of its own
+    ASSERT_TRUE(is_aligned(arena.allocate(1000, 512), 512));
+}
+
+TEST(ArenaTest, allocations_do_not_overlap)
+{
+    invocation_arena arena(128);
+    std::vector<unsigned char*> blocks;
+    for (size_t i = 0; i < 200; i++) {
+        auto const p = static_cast<unsigned char*>(arena.allocate(i + 1, 1));
+        std::memset(p, static_cast<int>(i), i + 1);
+        blocks.push_back(p);
+    }
+    for (size_t i = 0; i < blocks.size(); i++) {
+        for (size_t j = 0; j <= i; j++) {
+            ASSERT_EQ(static_cast<unsigned char>(i), blocks[i][j]);
+        }
+    }
+}
+
+TEST(ArenaTest, blocks_double_in_size)
+{
+    invocation_arena arena(1024);
+    ASSERT_EQ(0u, arena.stats().reserved);
+    arena.allocate(1000, 1);
+    ASSERT_EQ(1024u, arena.stats().reserved);
+    arena.allocate(1000, 1);
+    ASSERT_EQ(1024u + 2048u, arena.stats().reserved);
+    arena.allocate(3000, 1);
+    ASSERT_EQ(1024u + 2048u + 4096u, arena.stats().reserved);
+    // an allocation larger than the next block gets a block of its size
+    arena.allocate(100000, 1);
+    ASSERT_GE(arena.stats().reserved, 1024u + 2048u + 4096u + 100000u);
+
+    auto const stats = arena.stats();
+    ASSERT_EQ(4u, stats.allocations);
+    ASSERT_EQ(105000u, stats.bytes);
+    ASSERT_EQ(105000u, stats.high_water);
+}
+
+TEST(ArenaTest, reset_keeps_one_block_of_the_combined_size)
+{
+    invocation_arena arena(1024);
+    for (int i = 0; i < 6; i++) {
+        arena.allocate(1000, 1);
+    }
+    size_t const reserved = arena.stats().reserved;
+    ASSERT_GT(reserved, 6000u);
+
+    arena.reset();
+    auto stats = arena.stats();
+    ASSERT_EQ(0u, stats.allocations);
+    ASSERT_EQ(0u, stats.bytes);
+    ASSERT_EQ(6000u, stats.high_water);
+    ASSERT_EQ(reserved, stats.reserved);
+
+    // the same invocation again fits into the retained block
+    for (int i = 0; i < 6; i++) {
+        arena.allocate(1000, 1);
+    }
+    ASSERT_EQ(reserved, arena.stats().reserved);
+    arena.reset();
+    ASSERT_EQ(reserved, arena.stats().reserved);
+}
+
+TEST(ArenaTest, reset_caps_the_retained_block)
+{
+    size_t const block_size = 1024;
+    size_t const cap = block_size * invocation_arena::max_retained_blocks;
+    invocation_arena arena(block_size);
+    arena.allocate(cap * 10, 1);
+    arena.allocate(1, 1);
+    arena.reset();
+    ASSERT_EQ(cap, arena.stats().reserved);
+    ASSERT_EQ(cap * 10 + 1, arena.stats().high_water);
+
+    // a single outsized block is given back as well
+    arena.allocate(cap * 10, 1);
+    ASSERT_GT(arena.stats().reserved, cap);
+    arena.reset();
+    ASSERT_EQ(cap, arena.stats().reserved);
+
+    // what fits into the retained block doesn't grow it
+    arena.allocate(cap / 2, 1);
+    arena.reset();
+    ASSERT_EQ(cap, arena.stats().reserved);
+}
+
+TEST(ArenaTest, reset_of_an_unused_arena_reserves_nothing)
+{
+    invocation_arena arena;
+    arena.reset();
+    ASSERT_EQ(0u, arena.stats().reserved);
+    ASSERT_NE(nullptr, arena.allocate(16));
+}
+
+TEST(ArenaTest, stl_containers_allocate_from_the_arena)
+{
+    invocation_arena arena(4096);
+    {
+        arena_vector<int> v{arena_allocator<int>(arena)};
+        for (int i = 0; i < 1000; i++) {
+            v.push_back(i);
+        }
+        ASSERT_EQ(999, v.back());
+
+        arena_string s{arena_allocator<char>(arena)};
+        s.assign(1000, 'x');
+        ASSERT_EQ(1000u, s.size());
+
+        using pair_allocator = arena_allocator<std::pair<int const, arena_string>>;
+        std::map<int, arena_string, std::less<int>, pair_allocator> m{std::less<int>(), pair_allocator(arena)};
+        for (int i = 0; i < 100; i++) {
+            m.emplace(i, arena_string(std::to_string(i).c_str(), arena_allocator<char>(arena)));
+        }
+        ASSERT_EQ("42", m.at(42));
+        ASSERT_EQ(100u, m.size());
+    }
+    auto const stats = arena.stats();
+    ASSERT_GT(stats.allocations, 100u);
+    ASSERT_GE(stats.bytes, 1000 * sizeof(int) + 1000);
+}
+
+TEST(ArenaTest, allocators_compare_by_arena)
+{
+    invocation_arena a;
+    invocation_arena b;
+    arena_allocator<int> const ai(a);
+    arena_allocator<double> const ad(ai);
+    ASSERT_TRUE(ai == ad);
+    ASSERT_TRUE(ai != arena_allocator<int>(b));
+}
+
+TEST(ArenaTest, exhausted_heap_aborts)
+{
+    invocation_arena arena;
+    arena_allocator<double> allocator(arena);
+    ASSERT_DEATH(arena.allocate(static_cast<size_t>(-1) / 2), "");
+    ASSERT_DEATH(allocator.allocate(static_cast<size_t>(-1) / 4), "");
+}
+
+} // namespace
@@ -0,0 +1,73 @@
+#include <aws/logging/logging.h>
+#include <dirent.h>
+#include <thread>
+#include <unistd.h>
+#include "crash_handler.h"
+#include "gtest/gtest.h"
+
+using namespace aws::lambda_runtime;
+
+namespace {
+
+// Deep enough to run out of any thread's stack, and not a tail call the compiler could turn into a loop.
+size_t overflow(size_t depth)
+{
+    char volatile frame[1024];
+    frame[0] = static_cast<char>(depth);
+    return overflow(depth + 1) + static_cast<size_t>(frame[0]);
+}
+
+size_t thread_count()
+{
+    size_t count = 0;
+    if (DIR* tasks = opendir("/proc/self/task")) {
+        while (dirent* task = readdir(tasks)) {
+            count += task->d_name[0] != '.';
+        }
+        closedir(tasks);
+    }
+    return count;
+}
+
+// Either symbolizer's header line, written to stderr by the handler.
+char const crash_report[] = "Caught signal|Stack trace";
+
+TEST(CrashTests, stack_overflow_on_the_installing_thread_is_reported)
+{
+    ASSERT_DEATH(
+        {
+            install_crash_handler();
+            overflow(0);
+        },
+        crash_report);
+}
+
+TEST(CrashTests, stack_overflow_on_a_worker_thread_is_reported)
+{
+    ASSERT_DEATH(
+        {
+            install_crash_handler();
+            std::thread([] {
+                install_crash_stack();
+                overflow(0);
+            }).join();
+        },
+        crash_report);
+}
+
+TEST(CrashTests, flush_on_crash_does_not_create_the_log)
+{
+    // a fresh process, this one has long had a log
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    ASSERT_EXIT(
+        {
+            size_t const threads = thread_count();
+            aws::logging::flush_on_crash();
+            _exit(thread_count() == threads ? 0 : 1);
+        },
+        ::testing::ExitedWithCode(0),
+        "");
+    ::testing::FLAGS_gtest_death_test_style = "fast";
+}
+
+} // namespace
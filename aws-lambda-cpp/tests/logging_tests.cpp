@@ -0,0 +1,219 @@
+#include <aws/logging/logging.h>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "stdout_capture.h"
+#include "gtest/gtest.h"
+
+using namespace aws::logging;
+
+namespace {
+
+struct LoggingTest : public ::testing::Test {
+    stdout_capture m_stdout;
+
+    LoggingTest()
+    {
+        set_level(verbosity::debug);
+        set_format(record_format::text);
+    }
+
+    std::vector<std::string> written_lines()
+    {
+        EXPECT_TRUE(flush(std::chrono::milliseconds(5000)));
+        return m_stdout.lines();
+    }
+};
+
+// The number in "... dropped <n> log records", or 0 for any other line.
+size_t dropped_in(std::string const& line)
+{
+    auto const at = line.find("LOGGING dropped ");
+    return at == std::string::npos ? 0 : std::strtoull(line.c_str() + at + 16, nullptr, 10);
+}
+
+TEST_F(LoggingTest, records_are_written_in_order)
+{
+    for (int i = 0; i < 100; i++) {
+        log_error("TEST", "record %d", i);
+    }
+    int next = 0;
+    for (auto const& line : written_lines()) {
+        std::string const expected = "TEST record " + std::to_string(next);
+        if (line.size() >= expected.size() &&
+            line.compare(line.size() - expected.size(), expected.size(), expected) == 0) {
+            ASSERT_EQ(0u, line.find("[ERROR] ["));
+            next++;
+        }
+    }
+    ASSERT_EQ(100, next);
+}
+
+TEST_F(LoggingTest, long_text_record_is_written_whole)
+{
+    std::string const message(4000, 'x');
+    log_error("TEST", "%s", message.c_str());
+    log_error("TEST", "after");
+    auto const lines = written_lines();
+    ASSERT_EQ(2u, lines.size());
+    ASSERT_EQ(0u, lines[0].find("[ERROR] ["));
+    ASSERT_EQ("TEST " + message, lines[0].substr(lines[0].size() - message.size() - 5));
+    ASSERT_EQ("TEST after", lines[1].substr(lines[1].size() - 10));
+}
+
+TEST_F(LoggingTest, long_json_record_is_written_whole)
+{
+    set_format(record_format::json);
+    std::string const message(4000, '"');
+    log_error("TEST", "%s", message.c_str());
+    auto const lines = written_lines();
+    ASSERT_EQ(1u, lines.size());
+    ASSERT_EQ(0u, lines[0].find(R"({"timestamp":")"));
+    auto const body = lines[0].substr(lines[0].find(R"("message":")") + 11);
+    std::string escaped;
+    for (size_t i = 0; i < message.size(); i++) {
+        escaped += "\\\"";
+    }
+    ASSERT_EQ(escaped + "\"}", body);
+}
+
+// Records that just fill a slot, or one byte more, with the newline appended by write.
+TEST_F(LoggingTest, records_around_the_slot_size_are_written_whole)
+{
+    std::vector<std::string> expected;
+    for (size_t length : {510u, 511u, 512u, 513u, 1023u, 1024u, 1025u, 5000u}) {
+        expected.push_back(std::string(length, static_cast<char>('a' + expected.size())));
+        write(expected.back().data(), expected.back().size());
+    }
+    ASSERT_EQ(expected, written_lines());
+}
+
+// Threads logging records of one slot and of several at once: whatever isn't dropped comes out whole and unmixed.
+TEST_F(LoggingTest, concurrent_long_records_stay_whole)
+{
+    auto const record = [](size_t thread, size_t i) {
+        return std::to_string(thread) + ":" + std::to_string(i) + ":" +
+               std::string(i % 7 == 0 ? 3000 : 100 + i % 600, static_cast<char>('a' + thread));
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 4; t++) {
+        threads.emplace_back([&record, t] {
+            for (size_t i = 0; i < 2000; i++) {
+                auto const line = record(t, i);
+                write(line.data(), line.size());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    size_t written = 0;
+    size_t dropped = 0;
+    for (auto const& line : written_lines()) {
+        if (size_t const n = dropped_in(line)) {
+            dropped += n;
+            continue;
+        }
+        size_t const thread = std::strtoul(line.c_str(), nullptr, 10);
+        size_t const i = std::strtoul(line.c_str() + line.find(':') + 1, nullptr, 10);
+        ASSERT_EQ(record(thread, i), line);
+        written++;
+    }
+    ASSERT_EQ(4u * 2000u, written + dropped);
+}
+
+TEST_F(LoggingTest, record_too_long_for_the_ring_is_written_whole)
+{
+    std::string const huge(300 * 1024, 'h');
+    log_error("TEST", "before");
+    write(huge.data(), huge.size());
+    log_error("TEST", "after");
+    auto const lines = written_lines();
+    ASSERT_EQ(3u, lines.size());
+    ASSERT_EQ(huge, lines[1]);
+}
+
+TEST_F(LoggingTest, full_ring_counts_every_dropped_record)
+{
+    size_t const total = 20000;
+    for (size_t i = 0; i < total; i++) {
+        log_error("TEST", "record %zu", i);
+    }
+    size_t written = 0;
+    size_t dropped = 0;
+    for (auto const& line : written_lines()) {
+        if (line.find("TEST record ") != std::string::npos) {
+            written++;
+        }
+        dropped += dropped_in(line);
+    }
+    ASSERT_EQ(total, written + dropped);
+}
+
+TEST_F(LoggingTest, write_appends_a_newline)
+{
+    char const line[] = "{\"_aws\":{}}";
+    write(line, sizeof(line) - 1);
+    auto const lines = written_lines();
+    ASSERT_EQ(1u, lines.size());
+    ASSERT_EQ(line, lines[0]);
+}
+
+// The child of a death test has the ring but not the thread writing it, as after a crash: only flush_on_crash writes
+// the records.
+TEST_F(LoggingTest, flush_on_crash_writes_queued_records)
+{
+    log_error("TEST", "before the fork");
+    ASSERT_TRUE(flush(std::chrono::milliseconds(5000)));
+    ASSERT_EXIT(
+        {
+            for (int i = 0; i < 1500; i++) {
+                log_error("TEST", "record %d", i);
+            }
+            flush_on_crash();
+            _exit(0);
+        },
+        ::testing::ExitedWithCode(0),
+        "");
+
+    size_t written = 0;
+    size_t dropped = 0;
+    bool in_order = true;
+    for (auto const& line : written_lines()) {
+        auto const at = line.find("TEST record ");
+        if (at != std::string::npos) {
+            in_order = in_order && std::atoi(line.c_str() + at + 12) == static_cast<int>(written);
+            written++;
+        }
+        dropped += dropped_in(line);
+    }
+    ASSERT_TRUE(in_order);
+    ASSERT_EQ(1024u, written);
+    ASSERT_EQ(1500u - 1024u, dropped);
+}
+
+TEST_F(LoggingTest, flush_on_crash_writes_long_records_whole)
+{
+    ASSERT_EXIT(
+        {
+            for (int i = 0; i < 10; i++) {
+                std::string const line(1500, static_cast<char>('a' + i));
+                write(line.data(), line.size());
+            }
+            flush_on_crash();
+            _exit(0);
+        },
+        ::testing::ExitedWithCode(0),
+        "");
+
+    auto const lines = written_lines();
+    ASSERT_EQ(10u, lines.size());
+    for (size_t i = 0; i < lines.size(); i++) {
+        ASSERT_EQ(std::string(1500, static_cast<char>('a' + i)), lines[i]);
+    }
+}
+
+} // namespace
@@ -0,0 +1,268 @@
+#include <aws/lambda-runtime/runtime.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <string>
+#include <vector>
+#include "mock_runtime_api.h"
+#include "stdout_capture.h"
+#include "gtest/gtest.h"
+
+using namespace aws::lambda_runtime;
+using aws::lambda_runtime::benchmarks::mock_runtime_api;
+
+namespace {
+
+// Just enough of a JSON parser to tell whether a line is one valid JSON value, and to find the top-level members of
+// an object.
+class json_checker {
+public:
+    explicit json_checker(std::string const& text) : m_p(text.c_str()), m_end(text.c_str() + text.size()) {}
+
+    bool valid()
+    {
+        skip_space();
+        bool const ok = value(0);
+        skip_space();
+        return ok && m_p == m_end;
+    }
+
+    std::vector<std::string> const& top_level_members() const { return m_members; }
+
+private:
+    void skip_space()
+    {
+        while (m_p < m_end && std::strchr(" \t\r\n", *m_p)) {
+            m_p++;
+        }
+    }
+
+    bool literal(char const* word)
+    {
+        size_t const length = std::strlen(word);
+        if (static_cast<size_t>(m_end - m_p) < length || std::strncmp(m_p, word, length) != 0) {
+            return false;
+        }
+        m_p += length;
+        return true;
+    }
+
+    bool string(std::string* out)
+    {
+        if (m_p == m_end || *m_p != '"') {
+            return false;
+        }
+        for (m_p++; m_p < m_end; m_p++) {
+            auto const c = static_cast<unsigned char>(*m_p);
+            if (c == '"') {
+                m_p++;
+                return true;
+            }
+            if (c < 0x20) {
+                return false;
+            }
+            if (c == '\\') {
+                if (++m_p == m_end) {
+                    return false;
+                }
+                if (*m_p == 'u') {
+                    for (int i = 0; i < 4; i++) {
+                        if (++m_p == m_end || !std::isxdigit(static_cast<unsigned char>(*m_p))) {
+                            return false;
+                        }
+                    }
+                }
+                else if (!std::strchr("\"\\/bfnrt", *m_p)) {
+                    return false;
+                }
+            }
+            if (out) {
+                out->push_back(*m_p);
+            }
+        }
+        return false;
+    }
+
+    bool number()
+    {
+        char* end = nullptr;
+        std::strtod(m_p, &end);
+        if (end == m_p || end > m_end) {
+            return false;
+        }
+        m_p = end;
+        return true;
+    }
+
+    bool value(int depth)
+    {
+        if (m_p == m_end) {
+            return false;
+        }
+        switch (*m_p) {
+            case '{':
+                return object(depth);
+            case '[':
+                return array(depth);
+            case '"':
+                return string(nullptr);
+            case 't':
+                return literal("true");
+            case 'f':
+                return literal("false");
+            case 'n':
+                return literal("null");
+            default:
+                return number();
+        }
+    }
+
+    bool object(int depth)
+    {
+        m_p++;
+        skip_space();
+        if (m_p < m_end && *m_p == '}') {
+            m_p++;
+            return true;
+        }
+        for (;;) {
+            std::string name;
+            skip_space();
+            if (!string(&name)) {
+                return false;
+            }
+            if (depth == 0) {
+                m_members.push_back(name);
+            }
+            skip_space();
+            if (m_p == m_end || *m_p++ != ':') {
+                return false;
+            }
+            skip_space();
+            if (!value(depth + 1)) {
+                return false;
+            }
+            skip_space();
+            if (m_p == m_end) {
+                return false;
+            }
+            if (*m_p == '}') {
+                m_p++;
+                return true;
+            }
+            if (*m_p++ != ',') {
+                return false;
+            }
+        }
+    }
+
+    bool array(int depth)
+    {
+        m_p++;
+        skip_space();
+        if (m_p < m_end && *m_p == ']') {
+            m_p++;
+            return true;
+        }
+        for (;;) {
+            skip_space();
+            if (!value(depth + 1)) {
+                return false;
+            }
+            skip_space();
+            if (m_p == m_end) {
+                return false;
+            }
+            if (*m_p == ']') {
+                m_p++;
+                return true;
+            }
+            if (*m_p++ != ',') {
+                return false;
+            }
+        }
+    }
+
+    char const* m_p;
+    char const* m_end;
+    std::vector<std::string> m_members;
+};
+
+struct MetricsTest : public ::testing::Test {
+    mock_runtime_api m_api;
+    stdout_capture m_stdout;
+    runtime_options m_options;
+
+    MetricsTest()
+    {
+        EXPECT_TRUE(m_api.start());
+        setenv("AWS_LAMBDA_RUNTIME_API", m_api.endpoint().c_str(), 1);
+        m_options.log_metrics = true;
+        m_options.retries.max_attempts = 1;
+    }
+
+    // Runs the runtime until it has answered 'events' invocations and returns the EMF records it printed.
+    std::vector<std::string> emf_records(init_handler const& init, size_t events)
+    {
+        auto handler = [](invocation_request const& req) {
+            return invocation_response::success(std::string(100, 'r'), "text/plain");
+        };
+        auto runtime = std::async(std::launch::async, [&] { run_handler(init, handler, m_options); });
+        EXPECT_TRUE(m_api.wait_for_completions(events, std::chrono::seconds(10)));
+        m_api.stop();
+        runtime.wait();
+
+        std::vector<std::string> records;
+        for (auto const& line : m_stdout.lines()) {
+            if (line.compare(0, 8, R"({"_aws":)") == 0) {
+                records.push_back(line);
+            }
+        }
+        return records;
+    }
+};
+
+TEST_F(MetricsTest, checker_rejects_what_isnt_json)
+{
+    for (char const* text : {"", "{", R"({"a":1,})", R"({"a":"x...)", R"({"a":1}...)", R"(["\x"])", "[1 2]"}) {
+        ASSERT_FALSE(json_checker(text).valid()) << text;
+    }
+    ASSERT_TRUE(json_checker(R"({"a":[1,-2.5e3,true,null,{"b":"\"é"}]})").valid());
+}
+
+TEST_F(MetricsTest, invocation_metrics_are_valid_json)
+{
+    m_api.enqueue({"short-id", "{}"});
+    m_api.enqueue({std::string(1500, 'i'), "{}"}); // ids come from the endpoint and can be long
+    auto const records = emf_records(nullptr, 2);
+    ASSERT_EQ(2u, records.size());
+    for (auto const& record : records) {
+        ASSERT_GT(record.size(), 512u) << "shorter than a log slot, the test checks nothing the logger could cut";
+        json_checker checker(record);
+        ASSERT_TRUE(checker.valid()) << record;
+        auto const& members = checker.top_level_members();
+        for (char const* metric :
+             {"_aws", "requestId", "NextWait", "BodyReceipt", "Handler", "Post", "BytesIn", "BytesOut", "ArenaBytes",
+              "ArenaAllocations"}) {
+            ASSERT_NE(members.end(), std::find(members.begin(), members.end(), metric)) << metric;
+        }
+    }
+    ASSERT_NE(std::string::npos, records[1].find(R"("requestId":")" + std::string(1500, 'i') + '"'));
+}
+
+TEST_F(MetricsTest, init_metrics_are_valid_json)
+{
+    m_api.enqueue({"first", "{}"});
+    auto const records = emf_records([] { return invocation_response::success("", "text/plain"); }, 1);
+    ASSERT_EQ(2u, records.size());
+    json_checker checker(records[0]);
+    ASSERT_TRUE(checker.valid()) << records[0];
+    auto const& members = checker.top_level_members();
+    ASSERT_NE(members.end(), std::find(members.begin(), members.end(), "Init"));
+    ASSERT_TRUE(json_checker(records[1]).valid()) << records[1];
+}
+
+} // namespace
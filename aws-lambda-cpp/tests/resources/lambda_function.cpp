@@ -22,8 +22,7 @@ invocation_response echo_failure(invocation_request const& /*request*/)
 
 invocation_response binary_response(invocation_request const& /*request*/)
 {
-    const std::string png((char*)awslogo_png, awslogo_png_len);
-    return invocation_response::success(png, "image/png");
+    return invocation_response::success(byte_view(awslogo_png, awslogo_png_len), "image/png");
 }
 
 int main(int argc, char* argv[])
@@ -0,0 +1,189 @@
+#include <aws/http/response.h>
+#include <cstring>
+#include <string>
+#include "gtest/gtest.h"
+
+using aws::http::lambda_header;
+using aws::http::response;
+
+namespace {
+
+void add(response& resp, char const* line)
+{
+    resp.add_header(line, std::strlen(line));
+}
+
+TEST(ResponseTest, lambda_headers_match_in_any_case)
+{
+    response resp;
+    resp.clear();
+    add(resp, "LAMBDA-RUNTIME-AWS-REQUEST-ID: abc\r\n");
+    add(resp, "Lambda-Runtime-Deadline-Ms: 1234\r\n");
+    ASSERT_TRUE(resp.has_header(lambda_header::request_id));
+    ASSERT_EQ("abc", resp.get_header(lambda_header::request_id));
+    ASSERT_EQ("1234", resp.get_header(lambda_header::deadline_ms));
+    ASSERT_FALSE(resp.has_header(lambda_header::trace_id));
+    // the name based lookup finds the slots too
+    ASSERT_TRUE(resp.has_header("lambda-runtime-aws-request-id"));
+    ASSERT_EQ("abc", resp.get_header("lambda-runtime-aws-request-id"));
+}
+
+TEST(ResponseTest, names_with_the_lambda_prefix_are_not_all_lambda_headers)
+{
+    response resp;
+    resp.clear();
+    add(resp, "Lambda-Runtime-Aws-Request-Identifier: abc");
+    add(resp, "Lambda-Runtime-: x");
+    ASSERT_FALSE(resp.has_header(lambda_header::request_id));
+    ASSERT_EQ("abc", resp.get_header("lambda-runtime-aws-request-identifier"));
+    ASSERT_EQ("x", resp.get_header("lambda-runtime-"));
+}
+
+TEST(ResponseTest, whitespace_around_names_and_values_is_trimmed)
+{
+    response resp;
+    resp.clear();
+    add(resp, " \tLambda-Runtime-Trace-Id \t:  \t Root=1-2-3 \t\r\n");
+    add(resp, "X-Custom:value with  inner spaces\n");
+    add(resp, "X-Empty:   \r\n");
+    ASSERT_EQ("Root=1-2-3", resp.get_header(lambda_header::trace_id));
+    ASSERT_EQ("value with  inner spaces", resp.get_header("x-custom"));
+    ASSERT_TRUE(resp.has_header("x-empty"));
+    ASSERT_EQ("", resp.get_header("x-empty"));
+}
+
+TEST(ResponseTest, lines_without_a_colon_are_ignored)
+{
+    response resp;
+    resp.clear();
+    add(resp, "HTTP/1.1 200 OK\r\n");
+    add(resp, "\r\n");
+    ASSERT_FALSE(resp.has_header("http/1.1 200 ok"));
+    ASSERT_FALSE(resp.has_header(""));
+}
+
+TEST(ResponseTest, value_may_contain_colons)
+{
+    response resp;
+    resp.clear();
+    add(resp, "Lambda-Runtime-Invoked-Function-Arn: arn:aws:lambda:us-east-1:123:function:f");
+    ASSERT_EQ("arn:aws:lambda:us-east-1:123:function:f", resp.get_header(lambda_header::function_arn));
+}
+
+TEST(ResponseTest, duplicate_lambda_header_keeps_the_last_value)
+{
+    response resp;
+    resp.clear();
+    add(resp, "Lambda-Runtime-Aws-Request-Id: first");
+    add(resp, "lambda-runtime-aws-request-id: second");
+    ASSERT_EQ("second", resp.get_header(lambda_header::request_id));
+}
+
+TEST(ResponseTest, duplicate_other_header_finds_the_first_value)
+{
+    response resp;
+    resp.clear();
+    add(resp, "Set-Cookie: a=1");
+    add(resp, "SET-COOKIE: b=2");
+    ASSERT_EQ("a=1", resp.get_header("set-cookie"));
+}
+
+TEST(ResponseTest, other_headers_are_stored_with_lower_case_names)
+{
+    response resp;
+    resp.clear();
+    add(resp, "Content-Type: Application/JSON");
+    add(resp, "X-Amzn-RequestId: Mixed-Case-Value");
+    ASSERT_EQ("Application/JSON", resp.get_header("content-type"));
+    ASSERT_EQ("Mixed-Case-Value", resp.get_header("x-amzn-requestid"));
+    ASSERT_FALSE(resp.has_header("Content-Type")); // lookups take the lower-case name
+    ASSERT_FALSE(resp.has_header("content-typ"));
+    ASSERT_FALSE(resp.has_header("content-type-x"));
+}
+
+TEST(ResponseTest, clear_forgets_the_previous_request)
+{
+    response resp;
+    resp.clear();
+    add(resp, "Lambda-Runtime-Aws-Request-Id: first");
+    add(resp, "Content-Type: text/plain");
+    add(resp, "Content-Length: 5");
+    resp.append_body("hello", 5);
+
+    resp.clear();
+    ASSERT_FALSE(resp.has_header(lambda_header::request_id));
+    ASSERT_FALSE(resp.has_header("content-type"));
+    ASSERT_FALSE(resp.has_content_length());
+    ASSERT_EQ("", resp.get_body());
+
+    // the storage of the first request is reused for headers of different lengths
+    add(resp, "Lambda-Runtime-Aws-Request-Id: 2nd");
+    add(resp, "X-A: a much longer value than the one stored before");
+    add(resp, "Content-Type: json");
+    ASSERT_EQ("2nd", resp.get_header(lambda_header::request_id));
+    ASSERT_EQ("a much longer value than the one stored before", resp.get_header("x-a"));
+    ASSERT_EQ("json", resp.get_header("content-type"));
+}
+
+TEST(ResponseTest, reused_response_holds_many_headers)
+{
+    response resp;
+    for (int request = 0; request < 3; request++) {
+        resp.clear();
+        for (int i = 0; i < 50; i++) {
+            std::string const line = "X-Header-" + std::to_string(i) + ": " + std::to_string(request * 100 + i);
+            add(resp, line.c_str());
+        }
+        for (int i = 0; i < 50; i++) {
+            ASSERT_EQ(std::to_string(request * 100 + i), resp.get_header(("x-header-" + std::to_string(i)).c_str()));
+        }
+    }
+}
+
+TEST(ResponseTest, content_length_is_parsed)
+{
+    response resp;
+    resp.clear();
+    add(resp, "Content-Length: 1048576\r\n");
+    ASSERT_TRUE(resp.has_content_length());
+    ASSERT_EQ(1048576u, resp.get_content_length());
+    ASSERT_EQ("1048576", resp.get_header("content-length"));
+}
+
+TEST(ResponseTest, invalid_content_length_is_ignored)
+{
+    for (char const* line : {"Content-Length:", "Content-Length: -1", "Content-Length: 12abc", "Content-Length: 1 2",
+                             "Content-Length: 0x10"}) {
+        response resp;
+        resp.clear();
+        add(resp, line);
+        ASSERT_FALSE(resp.has_content_length()) << line;
+    }
+}
+
+TEST(ResponseTest, overflowing_content_length_is_ignored)
+{
+    response resp;
+    resp.clear();
+    std::string const max = std::to_string(static_cast<size_t>(-1) / 10 * 10 - 1);
+    add(resp, ("Content-Length: " + max).c_str());
+    ASSERT_TRUE(resp.has_content_length());
+    ASSERT_EQ(max, std::to_string(resp.get_content_length()));
+
+    resp.clear();
+    add(resp, "Content-Length: 99999999999999999999999");
+    ASSERT_FALSE(resp.has_content_length());
+}
+
+TEST(ResponseTest, bogus_content_length_does_not_limit_the_body)
+{
+    response resp;
+    resp.clear();
+    add(resp, "Content-Length: 2");
+    resp.append_body("hello", 5);
+    resp.append_body(" world", 6);
+    ASSERT_EQ("hello world", resp.take_body());
+    ASSERT_EQ("", resp.get_body());
+}
+
+} // namespace
@@ -0,0 +1,161 @@
+#include <aws/lambda-runtime/runtime.h>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mock_runtime_api.h"
+#include "stdout_capture.h"
+#include "gtest/gtest.h"
+
+using namespace aws::lambda_runtime;
+using aws::lambda_runtime::benchmarks::mock_runtime_api;
+
+namespace {
+
+// Runs the runtime against the mock runtime API with two invocations queued. The handler of the first one arranges
+// how the endpoint treats the post of its result; the second one being answered shows that the runtime carried on.
+struct PostRetryTest : public ::testing::Test {
+    mock_runtime_api m_api;
+    stdout_capture m_stdout;
+    runtime_options m_options;
+
+    PostRetryTest()
+    {
+        EXPECT_TRUE(m_api.start());
+        setenv("AWS_LAMBDA_RUNTIME_API", m_api.endpoint().c_str(), 1);
+        m_options.retries.max_attempts = 3;
+        m_options.retries.initial_backoff = std::chrono::milliseconds(1);
+        m_options.retries.max_backoff = std::chrono::milliseconds(2);
+        m_api.enqueue({"first", "{}"});
+        m_api.enqueue({"second", "{}"});
+    }
+
+    // Returns true if the runtime stopped by itself, false if it carried on until the endpoint went away.
+    bool run(std::function<void(mock_runtime_api&)> const& arrange)
+    {
+        auto handler = [&](invocation_request const& req) {
+            if (req.request_id == "first") {
+                arrange(m_api);
+            }
+            return invocation_response::success(req.request_id, "text/plain");
+        };
+        auto runtime = std::async(std::launch::async, [&] { run_handler(handler, m_options); });
+
+        auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (runtime.wait_for(std::chrono::milliseconds(1)) == std::future_status::ready) {
+                m_api.stop();
+                return true;
+            }
+            for (auto const& inv : m_api.completed()) {
+                if (inv.request_id == "second") {
+                    m_api.stop();
+                    runtime.wait();
+                    return false;
+                }
+            }
+        }
+        ADD_FAILURE() << "the runtime neither stopped nor answered the second invocation";
+        m_api.stop();
+        runtime.wait();
+        return false;
+    }
+
+    std::vector<std::string> completed_ids()
+    {
+        std::vector<std::string> ids;
+        for (auto const& inv : m_api.completed()) {
+            ids.push_back(inv.request_id);
+        }
+        return ids;
+    }
+
+    bool dropped_first() const { return m_stdout.contains("Dropping the result of invocation first"); }
+};
+
+using ids = std::vector<std::string>;
+
+TEST_F(PostRetryTest, transient_failures_are_retried)
+{
+    ASSERT_FALSE(run([](mock_runtime_api& api) { api.inject_faults(2, 503); }));
+    ASSERT_EQ((ids{"first", "second"}), completed_ids());
+    ASSERT_EQ("first", m_api.completed()[0].response);
+    ASSERT_FALSE(dropped_first());
+}
+
+TEST_F(PostRetryTest, four_xx_after_a_lost_reply_counts_as_posted)
+{
+    // the first attempt is delivered but its reply never arrives, the endpoint refuses the second one
+    ASSERT_FALSE(run([](mock_runtime_api& api) { api.drop_replies(1); }));
+    ASSERT_EQ((ids{"first", "second"}), completed_ids());
+    ASSERT_FALSE(dropped_first());
+}
+
+TEST_F(PostRetryTest, four_xx_after_a_gateway_timeout_counts_as_posted)
+{
+    ASSERT_FALSE(run([](mock_runtime_api& api) {
+        api.inject_faults(1, 504);
+        api.inject_faults(1, 400);
+    }));
+    ASSERT_EQ((ids{"second"}), completed_ids());
+    ASSERT_FALSE(dropped_first());
+}
+
+TEST_F(PostRetryTest, four_xx_on_the_first_attempt_drops_the_result)
+{
+    ASSERT_FALSE(run([](mock_runtime_api& api) { api.inject_faults(1, 400); }));
+    ASSERT_EQ((ids{"second"}), completed_ids());
+    ASSERT_TRUE(dropped_first());
+}
+
+TEST_F(PostRetryTest, payload_too_large_drops_the_result_even_after_a_lost_attempt)
+{
+    ASSERT_FALSE(run([](mock_runtime_api& api) {
+        api.inject_faults(1, 0);
+        api.inject_faults(1, 413);
+    }));
+    ASSERT_EQ((ids{"second"}), completed_ids());
+    ASSERT_TRUE(dropped_first());
+}
+
+TEST_F(PostRetryTest, internal_server_error_stops_the_runtime)
+{
+    ASSERT_TRUE(run([](mock_runtime_api& api) { api.inject_faults(1, 500); }));
+    ASSERT_TRUE(completed_ids().empty());
+    ASSERT_TRUE(m_stdout.contains("non-recoverable"));
+}
+
+// One worker fails fatally on posting its result while the other waits for its next invocation, which the endpoint
+// would keep open indefinitely: the waiting worker has to be interrupted for the runtime to stop.
+TEST_F(PostRetryTest, internal_server_error_stops_the_other_workers)
+{
+    m_options.workers = 2;
+    auto handler = [&](invocation_request const& req) {
+        if (req.request_id == "first") {
+            // meanwhile the other worker posts the result of the second invocation and requests the next one
+            m_api.wait_for_completions(1, std::chrono::seconds(5));
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            m_api.inject_faults(1, 500);
+        }
+        return invocation_response::success(req.request_id, "text/plain");
+    };
+    auto runtime = std::async(std::launch::async, [&] { run_handler(handler, m_options); });
+    bool const stopped = runtime.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+    m_api.stop();
+    runtime.wait();
+    ASSERT_TRUE(stopped);
+    ASSERT_EQ((ids{"second"}), completed_ids());
+    ASSERT_TRUE(m_stdout.contains("non-recoverable"));
+}
+
+TEST_F(PostRetryTest, exhausted_attempts_drop_the_result)
+{
+    ASSERT_FALSE(run([](mock_runtime_api& api) { api.inject_faults(3, 503); }));
+    ASSERT_EQ((ids{"second"}), completed_ids());
+    ASSERT_TRUE(dropped_first());
+}
+
+} // namespace
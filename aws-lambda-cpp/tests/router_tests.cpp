@@ -0,0 +1,147 @@
+#include <aws/lambda-runtime/runtime.h>
+#include <string>
+#include "gtest/gtest.h"
+
+using namespace aws::lambda_runtime;
+
+namespace {
+
+invocation_request request_with(std::string payload, std::string client_context = "")
+{
+    invocation_request req;
+    req.payload = std::move(payload);
+    req.client_context = std::move(client_context);
+    return req;
+}
+
+// The operation the request names, or "<none>".
+std::string operation_of(std::string payload, std::string client_context = "")
+{
+    auto const req = request_with(std::move(payload), std::move(client_context));
+    char const* op = nullptr;
+    size_t length = 0;
+    if (!invocation_router::find_operation(req, op, length)) {
+        return "<none>";
+    }
+    return std::string(op, length);
+}
+
+TEST(RouterTest, op_first)
+{
+    ASSERT_EQ("sum", operation_of(R"({"op":"sum","values":[1,2,3]})"));
+    ASSERT_EQ("sum", operation_of(" \n{ \"op\" \t: \r\n \"sum\" }"));
+    ASSERT_EQ("", operation_of(R"({"op":""})"));
+}
+
+TEST(RouterTest, op_after_other_members)
+{
+    ASSERT_EQ("sum", operation_of(R"({"a":1,"b":-2.5e3,"c":true,"d":null,"e":"x","op":"sum"})"));
+    ASSERT_EQ("sum", operation_of(R"({"a" : 1 , "b" : false , "op" : "sum"})"));
+}
+
+TEST(RouterTest, nested_objects_and_arrays_are_skipped)
+{
+    ASSERT_EQ("sum", operation_of(R"({"values":[[1,2],[3,[4,{"op":"inner"}]]],"op":"sum"})"));
+    ASSERT_EQ("sum", operation_of(R"({"nested":{"op":"inner","deeper":{"op":"x"}},"op":"sum"})"));
+    ASSERT_EQ("sum", operation_of(R"({"empty":{},"also":[],"op":"sum"})"));
+    // only top-level members count
+    ASSERT_EQ("<none>", operation_of(R"({"nested":{"op":"inner"}})"));
+    ASSERT_EQ("<none>", operation_of(R"([{"op":"sum"}])"));
+}
+
+TEST(RouterTest, strings_with_escaped_quotes_and_brackets_are_skipped)
+{
+    ASSERT_EQ("sum", operation_of(R"({"text":"say \"op\":\"x\" }","op":"sum"})"));
+    ASSERT_EQ("sum", operation_of(R"({"text":"{[}]","op":"sum"})"));
+    ASSERT_EQ("sum", operation_of(R"({"text":"ends in a backslash \\","op":"sum"})"));
+    ASSERT_EQ("sum", operation_of(R"({"a\"op":"x","op":"sum"})"));
+    ASSERT_EQ("sum", operation_of(R"({"list":["]","}","\"",{"k":"]"}],"op":"sum"})"));
+}
+
+TEST(RouterTest, escaped_op_value_names_no_operation)
+{
+    // the escape isn't decoded, so "s\u0075m" doesn't route to "sum"
+    ASSERT_EQ("<none>", operation_of(R"({"op":"s\u0075m"})"));
+    ASSERT_EQ("<none>", operation_of(R"({"op":"a\"b"})"));
+    ASSERT_EQ("<none>", operation_of(R"({"a":1,"op":"\\"})"));
+}
+
+TEST(RouterTest, op_that_is_not_a_string_names_no_operation)
+{
+    ASSERT_EQ("<none>", operation_of(R"({"op":1})"));
+    ASSERT_EQ("<none>", operation_of(R"({"op":{"name":"sum"}})"));
+    ASSERT_EQ("<none>", operation_of(R"({"op":null})"));
+}
+
+TEST(RouterTest, malformed_or_truncated_input_names_no_operation)
+{
+    for (char const* payload :
+         {"",
+          "not json",
+          "\"op\"",
+          "{",
+          "{\"",
+          "{\"op",
+          "{\"op\"",
+          "{\"op\":",
+          "{\"op\":\"sum",
+          "{\"op\":\"sum\\",
+          "{\"a\":[1,2",
+          "{\"a\":\"unterminated,\"op\":\"sum\"}",
+          "{\"a\" 1,\"op\":\"sum\"}",
+          "{\"a\":1 \"op\":\"sum\"}",
+          "{\"a\":,\"op\":\"sum\"}",
+          "{\"a\":{\"b\":\"}\",\"op\":\"sum\"}",
+          "{op:\"sum\"}"}) {
+        ASSERT_EQ("<none>", operation_of(payload)) << payload;
+    }
+}
+
+TEST(RouterTest, op_in_the_custom_client_context_comes_first)
+{
+    ASSERT_EQ("ctx", operation_of(R"({"op":"payload"})", R"({"client":{},"custom":{"op":"ctx"},"env":{}})"));
+    ASSERT_EQ("ctx", operation_of("not even json", R"({"custom":{"user":"x","op":"ctx"}})"));
+    // the payload is still looked at if the context names no operation
+    ASSERT_EQ("payload", operation_of(R"({"op":"payload"})", R"({"custom":{"user":"x"}})"));
+    ASSERT_EQ("payload", operation_of(R"({"op":"payload"})", R"({"op":"not in custom"})"));
+    ASSERT_EQ("payload", operation_of(R"({"op":"payload"})", R"({"custom":{"op":"trunc)"));
+}
+
+TEST(RouterTest, routes_to_the_registered_handler)
+{
+    invocation_router router;
+    router.route("a", [](invocation_request const&) { return invocation_response::success("from a", "text/plain"); })
+        .route("b", [](invocation_request const&) { return invocation_response::success("from b", "text/plain"); });
+    ASSERT_EQ("from a", router(request_with(R"({"op":"a"})")).get_payload());
+    ASSERT_EQ("from b", router(request_with("", R"({"custom":{"op":"b"}})")).get_payload());
+
+    router.route("a", [](invocation_request const&) { return invocation_response::success("new a", "text/plain"); });
+    ASSERT_EQ("new a", router(request_with(R"({"op":"a"})")).get_payload());
+}
+
+TEST(RouterTest, missing_and_unknown_operations_fail_without_a_fallback)
+{
+    invocation_router router;
+    router.route("a", [](invocation_request const&) { return invocation_response::success("", "text/plain"); });
+
+    auto const missing = router(request_with(R"({"x":1})"));
+    ASSERT_FALSE(missing.is_success());
+    ASSERT_NE(std::string::npos, missing.get_payload().find("MissingOperation"));
+
+    auto const unknown = router(request_with(R"({"op":"ab"})"));
+    ASSERT_FALSE(unknown.is_success());
+    ASSERT_NE(std::string::npos, unknown.get_payload().find("UnknownOperation"));
+    ASSERT_NE(std::string::npos, unknown.get_payload().find("'ab'"));
+}
+
+TEST(RouterTest, fallback_takes_missing_and_unknown_operations)
+{
+    invocation_router router;
+    router.route("a", [](invocation_request const&) { return invocation_response::success("a", "text/plain"); })
+        .fallback([](invocation_request const&) { return invocation_response::success("fallback", "text/plain"); });
+    ASSERT_EQ("fallback", router(request_with(R"({"x":1})")).get_payload());
+    ASSERT_EQ("fallback", router(request_with(R"({"op":"b"})")).get_payload());
+    ASSERT_EQ("a", router(request_with(R"({"op":"a"})")).get_payload());
+}
+
+} // namespace
@@ -0,0 +1,202 @@
+#include <aws/lambda-runtime/snapshot.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+using namespace aws::lambda_runtime;
+
+namespace {
+
+// The layout of the file, see snapshot.cpp.
+size_t const file_header_size = 32;
+size_t const section_header_size = 24;
+size_t const section_size_offset = file_header_size;
+size_t const section_checksum_offset = file_header_size + 8;
+size_t const section_name_length_offset = file_header_size + 20;
+
+struct SnapshotTest : public ::testing::Test {
+    std::string m_directory;
+    std::string m_restored;
+
+    SnapshotTest()
+    {
+        char directory[] = "/tmp/aws-lambda-snapshot-tests-XXXXXX";
+        EXPECT_NE(nullptr, mkdtemp(directory));
+        m_directory = directory;
+        setenv("AWS_LAMBDA_FUNCTION_NAME", "snapshot-test", 1);
+        setenv("AWS_LAMBDA_FUNCTION_VERSION", "1", 1);
+    }
+
+    ~SnapshotTest() override
+    {
+        state_snapshot snapshot(m_directory);
+        std::remove(snapshot.path().c_str());
+        rmdir(m_directory.c_str());
+    }
+
+    // Registers the one component of these tests: its state is "state" followed by 100 x's.
+    void add_component(state_snapshot& snapshot)
+    {
+        snapshot.add(
+            "component",
+            1,
+            [](std::string& out) {
+                out += "state" + std::string(100, 'x');
+                return true;
+            },
+            [this](byte_view state) {
+                m_restored.assign(reinterpret_cast<char const*>(state.data()), state.size());
+                return true;
+            });
+    }
+
+    std::string save()
+    {
+        state_snapshot snapshot(m_directory);
+        add_component(snapshot);
+        EXPECT_TRUE(snapshot.save());
+        return snapshot.path();
+    }
+
+    // Loads the snapshot into a fresh state_snapshot, returns whether it was valid.
+    bool load()
+    {
+        m_restored.clear();
+        state_snapshot snapshot(m_directory);
+        add_component(snapshot);
+        bool const loaded = snapshot.load();
+        EXPECT_EQ(loaded, snapshot.stats().loaded);
+        EXPECT_EQ(loaded, snapshot.restored("component"));
+        EXPECT_EQ(loaded, !m_restored.empty());
+        return loaded;
+    }
+
+    static std::string read(std::string const& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+
+    static void write(std::string const& path, std::string const& content)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(content.data(), static_cast<std::streamsize>(content.size()));
+    }
+
+    template <typename T>
+    static void patch(std::string& content, size_t offset, T value)
+    {
+        std::memcpy(&content[offset], &value, sizeof(value));
+    }
+
+    // Keeps the size in the file header in line with the file, so the sections are what's checked.
+    static void fix_size(std::string& content) { patch<uint64_t>(content, 16, content.size()); }
+};
+
+TEST_F(SnapshotTest, saved_state_is_restored)
+{
+    save();
+    ASSERT_TRUE(load());
+    ASSERT_EQ("state" + std::string(100, 'x'), m_restored);
+}
+
+TEST_F(SnapshotTest, missing_file_is_not_loaded)
+{
+    ASSERT_FALSE(load());
+}
+
+TEST_F(SnapshotTest, truncated_file_is_rejected)
+{
+    auto const path = save();
+    auto const content = read(path);
+    for (size_t size : {size_t(0), file_header_size - 1, file_header_size + 10, content.size() - 1}) {
+        write(path, content.substr(0, size));
+        ASSERT_FALSE(load()) << size << " bytes";
+    }
+}
+
+TEST_F(SnapshotTest, truncated_section_is_rejected)
+{
+    auto const path = save();
+    auto const content = read(path);
+    // the header agrees with the file, only the section runs past its end
+    for (size_t size : {file_header_size + section_header_size - 1,
+                        file_header_size + section_header_size + 4,
+                        content.size() - 8}) {
+        auto truncated = content.substr(0, size);
+        fix_size(truncated);
+        write(path, truncated);
+        ASSERT_FALSE(load()) << size << " bytes";
+    }
+}
+
+TEST_F(SnapshotTest, wrong_magic_is_rejected)
+{
+    auto const path = save();
+    auto content = read(path);
+    content[0] = 'X';
+    write(path, content);
+    ASSERT_FALSE(load());
+}
+
+TEST_F(SnapshotTest, snapshot_of_another_function_version_is_rejected)
+{
+    save();
+    setenv("AWS_LAMBDA_FUNCTION_VERSION", "2", 1);
+    ASSERT_FALSE(load());
+    setenv("AWS_LAMBDA_FUNCTION_VERSION", "1", 1);
+    ASSERT_TRUE(load());
+}
+
+TEST_F(SnapshotTest, bad_checksum_is_rejected)
+{
+    auto const path = save();
+    auto const content = read(path);
+
+    auto corrupt_state = content;
+    corrupt_state[content.size() - 20] ^= 1;
+    write(path, corrupt_state);
+    ASSERT_FALSE(load());
+
+    auto corrupt_checksum = content;
+    corrupt_checksum[section_checksum_offset] ^= 1;
+    write(path, corrupt_checksum);
+    ASSERT_FALSE(load());
+}
+
+TEST_F(SnapshotTest, oversized_section_is_rejected)
+{
+    auto const path = save();
+    auto const content = read(path);
+    // sizes that wrap around when they are padded, and ones that merely exceed the file
+    for (uint64_t size : {UINT64_MAX, UINT64_MAX - 3, UINT64_MAX - 7, uint64_t(content.size()), uint64_t(1) << 40}) {
+        auto oversized = content;
+        patch<uint64_t>(oversized, section_size_offset, size);
+        write(path, oversized);
+        ASSERT_FALSE(load()) << size;
+    }
+    for (uint32_t length : {UINT32_MAX, UINT32_MAX - 3, uint32_t(content.size())}) {
+        auto oversized = content;
+        patch<uint32_t>(oversized, section_name_length_offset, length);
+        write(path, oversized);
+        ASSERT_FALSE(load()) << length;
+    }
+}
+
+TEST_F(SnapshotTest, component_of_another_version_is_not_restored)
+{
+    save();
+    state_snapshot snapshot(m_directory);
+    snapshot.add("component", 2, nullptr, [](byte_view) { return true; });
+    ASSERT_TRUE(snapshot.load());
+    ASSERT_FALSE(snapshot.restored("component"));
+    ASSERT_FALSE(snapshot.complete());
+}
+
+} // namespace
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <aws/logging/logging.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Points stdout at a temporary file for as long as it lives, so tests can read back what the runtime logged.
+class stdout_capture {
+public:
+    stdout_capture()
+    {
+        char path[] = "/tmp/aws-lambda-runtime-tests-XXXXXX";
+        int const fd = mkstemp(path);
+        m_path = path;
+        fflush(stdout);
+        m_stdout = dup(STDOUT_FILENO);
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    }
+
+    ~stdout_capture()
+    {
+        aws::logging::flush(std::chrono::milliseconds(5000));
+        fflush(stdout);
+        dup2(m_stdout, STDOUT_FILENO);
+        close(m_stdout);
+        std::remove(m_path.c_str());
+    }
+
+    stdout_capture(stdout_capture const&) = delete;
+    stdout_capture& operator=(stdout_capture const&) = delete;
+
+    // Everything written so far, once the log has been flushed.
+    std::vector<std::string> lines() const
+    {
+        aws::logging::flush(std::chrono::milliseconds(5000));
+        std::ifstream in(m_path);
+        std::vector<std::string> lines;
+        for (std::string line; std::getline(in, line);) {
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+    bool contains(std::string const& text) const
+    {
+        for (auto const& line : lines()) {
+            if (line.find(text) != std::string::npos) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    std::string m_path;
+    int m_stdout;
+};
@@ -25,8 +25,12 @@ specific language governing permissions and limitations under the License.
 #include <aws/states/SFNClient.h>
 #include <aws/states/model/ListStateMachinesRequest.h>
 #include <aws/states/model/ListStateMachinesResult.h>
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <iterator>
 #include <libff/common/utils.hpp>
@@ -37,6 +41,9 @@ specific language governing permissions and limitations under the License.
 #include <libff/algebra/fields/fp.hpp>
 #include <libff/common/utils.hpp>
 #include <libff/common/rng.hpp>
+#include "codec.h"
+#include "batch.h"
+#include "result_codec.h"
 
 
 using namespace libff;
@@ -142,81 +149,6 @@ void DeleteFunction(Aws::String functionName)
         << outcome.GetError().GetMessage() << "\n\n";
 }
 
-// Deserialize a string into a vector
-//
-template<typename T>
-std::vector<T> deserializeToVec(std::string s_vec) {
-	std::istringstream is(s_vec.c_str());
-        return std::vector<T>{ std::istream_iterator<T>( is ), 
-                        std::istream_iterator<T>() };
-}
-
-// Deserialize a string into a single element
-//
-template<typename T>
-T deserialize(std::string s_elem) {
-	T ret;
-	std::istringstream is(s_elem.c_str());
-    is >> ret;
-	return ret;
-}
-
-// Serialize a vector into a string
-//
-template<typename T> 
-std::string serializeVec(std::vector<T> vec) {
-	std::ostringstream oss;
-	std::string str = "";
-	std::copy(vec.begin(), vec.end()-1,
-                std::ostream_iterator<T>(oss, " "));
-
-    // Now add the last element with no delimiter
-    oss << vec.back();
-	return oss.str();
-}
-
-template<typename T>
-std::string serializeFieldVec(std::vector<T> vec) {
-    std::ostringstream oss;
-    libff::bit_vector bv = libff::convert_field_element_vector_to_bit_vector<T>(vec);
-	libff::serialize_bit_vector(oss, bv);
-    return oss.str();
-}
-
-template<typename T>
-std::string serializeField(T field) {
-    std::ostringstream oss;
-    libff::bit_vector bv = libff::convert_field_element_to_bit_vector<T>(field);
-	libff::serialize_bit_vector(oss, bv);
-    return oss.str();
-}
-
-template<typename T>
-std::vector<T> deserializeFieldVec(std::string s_vec) {
-    std::istringstream is(s_vec.c_str());
-    bit_vector bv;
-    libff::deserialize_bit_vector(is, bv);
-    return libff::convert_bit_vector_to_field_element_vector<T>(bv);
-}
-
-template<typename T>
-T deserializeField(std::string s_field) {
-    std::istringstream is(s_field.c_str());
-    bit_vector bv;
-    libff::deserialize_bit_vector(is, bv);
-    return libff::convert_bit_vector_to_field_element<T>((const bit_vector)bv);
-}
-
-// Serialize a single element into a string
-//
-template<typename T> 
-std::string serialize(T elem) {
-	std::ostringstream oss;
-	std::string str = "";
-    oss << elem;
-	return oss.str();
-}
-
 void InvokeFunction(Aws::String functionName)
 {
     Aws::Lambda::Model::InvokeRequest invokeRequest;
@@ -290,68 +222,45 @@ void InvokeFunction(Aws::String functionName)
     }
 }
 
-void lambdaCallback(const LambdaClient* client, 
-                    const Model::InvokeRequest& req, 
-                    const Model::InvokeOutcome& outcome, 
-                    const std::shared_ptr<const Aws::Client::AsyncCallerContext>& context)
+// The first line of the response body of a successful invocation, or an empty string
+static Aws::String ReadFunctionResult(const Model::InvokeOutcome& outcome)
 {
-    //auto const& result = outcome.GetResult();
-
-    //printf("Outcome is success %d \n", outcome.IsSuccess());
-    //if (outcome.IsSuccess())
-    //{
-        printf("hi\n");
-        /*
-        // Lambda function result (key1 value)
-        const Aws::IOStream& payload = result.GetPayload();
-        Aws::String functionResult;
-        std::getline(payload, functionResult);
-        //std::cout << "Lambda result:\n" << functionResult << "\n\n";
-        //return functionResult;
-        auto answer = deserialize<G1<libff::bn128_pp>>(functionResult.c_str());
-        printf("%lld ", answer);
-        */
-    //}
+    if (!outcome.IsSuccess())
+    {
+        std::cout << "Invoke error: " << outcome.GetError().GetMessage() << "\n";
+        return "";
+    }
+    Aws::String functionResult;
+    std::getline(outcome.GetResult().GetPayload(), functionResult);
+    return functionResult;
 }
 
-Aws::String InvokeFunctionAsync(Aws::String functionName, Aws::Utils::Json::JsonValue jsonBody)
+// Invokes the function without waiting for it; the future holds what InvokeFunction would have returned. The client's
+// executor runs every invocation on a thread of its own, so invocations started one after the other are in flight at
+// the same time.
+std::future<Aws::String> InvokeFunctionAsync(Aws::String functionName, Aws::Utils::Json::JsonValue jsonBody)
 {
     Aws::Lambda::Model::InvokeRequest invokeRequest;
     invokeRequest.SetFunctionName(functionName);
-    invokeRequest.SetInvocationType(Aws::Lambda::Model::InvocationType::Event);//::RequestResponse);
-    //invokeRequest.SetLogType(Aws::Lambda::Model::LogType::Tail);
+    invokeRequest.SetInvocationType(Aws::Lambda::Model::InvocationType::RequestResponse);
     std::shared_ptr<Aws::IOStream> payload = Aws::MakeShared<Aws::StringStream>("");
 
     *payload << jsonBody.View().WriteReadable();
 
-    //invokeRequest.SetBody(payload);
-    //invokeRequest.SetContentType("application/text");
-    printf("invoking\n");
-    m_client->InvokeAsync(invokeRequest, lambdaCallback);
-    //auto outcome = m_client->Invoke(invokeRequest);
-    printf("done\n");
-    
-    /*
-    auto &result = outcome.GetResult();
+    invokeRequest.SetBody(payload);
+    invokeRequest.SetContentType("application/text");
 
-    printf("Outcome is success %d \n", outcome.IsSuccess());
-    if (outcome.IsSuccess())
-    {
-       // Lambda function result (key1 value)
-       Aws::IOStream& payload = result.GetPayload();
-       Aws::String functionResult;
-       std::getline(payload, functionResult);
-        std::cout << "Lambda result:\n" << functionResult << "\n\n";
-       return functionResult;
-        // Decode the result header to see requested log information 
-        auto byteLogResult = Aws::Utils::HashingUtils::Base64Decode(result.GetLogResult());
-        Aws::StringStream logResult;
-        for (unsigned i = 0; i < byteLogResult.GetLength(); i++)
-            logResult << byteLogResult.GetItem(i);
-        std::cout << "Log result header:\n" << logResult.str() << "\n\n";
-        
-    }*/
-    return "";
+    auto answer = std::make_shared<std::promise<Aws::String>>();
+    std::future<Aws::String> result = answer->get_future();
+    m_client->InvokeAsync(invokeRequest,
+        [answer](const LambdaClient*,
+                 const Model::InvokeRequest&,
+                 const Model::InvokeOutcome& outcome,
+                 const std::shared_ptr<const Aws::Client::AsyncCallerContext>&)
+        {
+            answer->set_value(ReadFunctionResult(outcome));
+        });
+    return result;
 }
 
 Aws::String InvokeFunction(Aws::String functionName, Aws::Utils::Json::JsonValue jsonBody)
@@ -368,7 +277,6 @@ Aws::String InvokeFunction(Aws::String functionName, Aws::Utils::Json::JsonValue
     invokeRequest.SetContentType("application/text");
     //printf("invoking\n");
     auto outcome = m_client->Invoke(invokeRequest);
-    //m_client->InvokeAsync(invokeRequest, lambdaCallback);
     //printf("done\n");
     auto &result = outcome.GetResult();
 
@@ -394,6 +302,9 @@ Aws::String InvokeFunction(Aws::String functionName, Aws::Utils::Json::JsonValue
     return "";
 }
 
+// Splits every instance into chunks, invokes the function on all chunks at once and sums the partial results of each
+// instance. All chunks are in flight together, so this takes about as long as the slowest chunk rather than as long as
+// all of them one after the other.
 void InvokeMultiExpInner2()
 {   
     libff::bn128_pp::init_public_params();
@@ -404,14 +315,17 @@ void InvokeMultiExpInner2()
     test_instances_t<Fr<libff::bn128_pp>> scalars =
             libff::generate_scalars<Fr<libff::bn128_pp>>(3, 1 << expn);
 
+    struct chunk {
+        size_t instance;
+        Aws::Utils::Json::JsonValue request;
+        std::future<Aws::String> answer;
+    };
+    std::vector<chunk> fanout;
+    printf("size of group elements: %zu\n", group_elements.size());
 
-    Aws::Utils::Json::JsonValue jsonPayload;
-    std::vector<G1<bn128_pp>> answers;
-    printf("size of group elements: %d\n", group_elements.size());
-    
     for (size_t i = 0; i < group_elements.size(); i++) 
     {
-        size_t chunks = group_elements[i].size() / 2;
+        const size_t chunks = std::max<size_t>(group_elements[i].size() / 2, 1);
         // Chunker
         std::vector<G1<libff::bn128_pp>>::const_iterator vec_start = group_elements[i].cbegin();
         std::vector<G1<libff::bn128_pp>>::const_iterator vec_end = group_elements[i].cend();
@@ -421,42 +335,66 @@ void InvokeMultiExpInner2()
 
         const size_t one = total/chunks;
 
-        std::vector<G1<libff::bn128_pp>> partial(chunks, G1<libff::bn128_pp>::zero());
-
         for (size_t j = 0; j < chunks; ++j)
         {
-            printf("%d\n", j);
             std::vector<G1<libff::bn128_pp>> ge{vec_start + j*one,
                 (j == chunks-1 ? vec_end : vec_start + (j+1)*one)};
             std::vector<Fr<libff::bn128_pp>> sc{scalar_start + j*one,
                 (j == chunks-1 ? scalar_end : scalar_start + (j+1)*one)};
-            std::string ge_ser = serializeVec<G1<libff::bn128_pp>>(ge);
-            Aws::String ge_str = Aws::Utils::StringUtils::URLEncode(ge_ser.c_str());
-            printf("%s\n%s\n", ge_ser.c_str(), ge_str.c_str());
-            jsonPayload.WithString("groupelements", ge_str);
-
-            std::string sc_ser = serializeFieldVec<Fr<libff::bn128_pp>>(sc);
-            Aws::String sc_str = Aws::Utils::StringUtils::URLEncode(sc_ser.c_str());
-            jsonPayload.WithString("scalars", sc_str);
-            Aws::String str("multiexp");
-            /*Aws::String answer = */InvokeFunction(str, jsonPayload);
-            //partial[j] = deserialize<G1<libff::bn128_pp>>(answer.c_str());
+            chunk c{i, encodeMultiExpRequest(ge, sc, MULTIEXP_OP_MSM_G1), {}};
+            fanout.push_back(std::move(c));
         }
+    }
 
-        //G1<libff::bn128_pp> final = G1<libff::bn128_pp>::zero();
+    const auto start = std::chrono::steady_clock::now();
+    for (auto& c : fanout)
+    {
+        c.answer = InvokeFunctionAsync("multiexp", c.request);
+    }
 
-        //for (size_t j = 0; j < chunks; ++j)
-        //{
-        //    final = final + partial[j];
-        //}
-        
-        //answers.push_back(final);
+    std::vector<G1<libff::bn128_pp>> answers(group_elements.size(), G1<libff::bn128_pp>::zero());
+    std::vector<bool> failed(group_elements.size(), false);
+    std::vector<size_t> pending(fanout.size());
+    for (size_t j = 0; j < pending.size(); ++j)
+    {
+        pending[j] = j;
     }
+    // a worker running out of time answers with its progress; that chunk is invoked again as soon as its answer is
+    // in, so resumed chunks are in flight together with the others instead of being waited on one by one
+    while (!pending.empty())
+    {
+        std::vector<size_t> resumed;
+        for (size_t j : pending)
+        {
+            chunk& c = fanout[j];
+            Aws::String const answer = c.answer.get();
+            Aws::Utils::Json::JsonValue body(answer);
+            if (body.WasParseSuccessful() && body.View().ValueExists(MULTIEXP_PARTIAL_KEY))
+            {
+                c.request.WithObject(MULTIEXP_RESUME_KEY, body.View().GetObject(MULTIEXP_PARTIAL_KEY).Materialize());
+                c.answer = InvokeFunctionAsync("multiexp", c.request);
+                resumed.push_back(j);
+                continue;
+            }
+            G1<libff::bn128_pp> partial;
+            if (!deserialize(answer.c_str(), partial)) {
+                std::cout << "Failed to decode result of chunk " << j << " of instance " << c.instance << "\n";
+                failed[c.instance] = true;
+                continue;
+            }
+            answers[c.instance] = answers[c.instance] + partial;
+        }
+        pending.swap(resumed);
+    }
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    printf("%zu chunks took %lld ms\n", fanout.size(), static_cast<long long>(elapsed.count()));
 
     //Output
-    // for(int i=0; i<answers.size(); i++)
-    //    printf("%lld ", answers[i]);
-    // printf("\n");
+    for (size_t i = 0; i < answers.size(); i++)
+    {
+        if (!failed[i])
+            std::cout << answers[i] << "\n";
+    }
 }
 
 void InvokeMultiExpInner()
@@ -475,16 +413,22 @@ void InvokeMultiExpInner()
     printf("size of group elements: %d\n", group_elements.size());
     for (size_t i = 0; i < group_elements.size(); i++) 
     {
-        std::string ge_ser = serializeVec<G1<libff::bn128_pp>>(group_elements[i]);
-        Aws::String ge_str = Aws::Utils::StringUtils::URLEncode(ge_ser.c_str());
-        jsonPayload.WithString("groupelements", ge_str);
-
-        std::string sc_ser = serializeFieldVec<Fr<libff::bn128_pp>>(scalars[i]);
-        Aws::String sc_str = Aws::Utils::StringUtils::URLEncode(sc_ser.c_str());
-        jsonPayload.WithString("scalars", sc_str);
-        
+        jsonPayload = encodeMultiExpRequest(group_elements[i], scalars[i], MULTIEXP_OP_MSM_G1);
+
         Aws::String answer = InvokeFunction("multiexp", jsonPayload);
-        answers.push_back(deserialize<G1<libff::bn128_pp>>(answer.c_str()));
+        // a worker running out of time answers with its progress, which the next invocation picks up
+        for (Aws::Utils::Json::JsonValue body(answer);
+             body.WasParseSuccessful() && body.View().ValueExists(MULTIEXP_PARTIAL_KEY);
+             body = Aws::Utils::Json::JsonValue(answer)) {
+            jsonPayload.WithObject(MULTIEXP_RESUME_KEY, body.View().GetObject(MULTIEXP_PARTIAL_KEY).Materialize());
+            answer = InvokeFunction("multiexp", jsonPayload);
+        }
+        G1<libff::bn128_pp> result;
+        if (!deserialize(answer.c_str(), result)) {
+            std::cout << "Failed to decode result of instance " << i << "\n";
+            continue;
+        }
+        answers.push_back(result);
     }
 
     //Output